@@ -0,0 +1,112 @@
+#!/bin/bash
+#
+# 本脚本用于将 chroot 环境打包为只读的压缩镜像（erofs 或 squashfs），并挂载给评测系统使用
+#
+# 用法：
+#   $0 build <srcdir> <imagedir> <name>
+#       将 <srcdir> 打包为 <imagedir>/<name>-<hash>.<erofs|squashfs>，<hash> 为镜像内容的 sha256 前 16 位，
+#       然后将 <imagedir>/<name> 这个符号链接原子地指向新镜像，并输出新镜像的路径。
+#       <srcdir> 可以是完整的 chroot 环境（基础层），也可以只包含某个语言工具链的文件（语言层），
+#       如只包含 /usr/lib/jvm 的目录树。
+#   $0 mount <mountdir> <image>...
+#       按顺序挂载基础层和语言层镜像，前面的镜像在下层。每个镜像只读挂载在 <mountdir>/layers/<hash> 下，
+#       多个镜像时再通过 overlayfs 合并为 <mountdir>/<hash>...，输出可以作为 CHROOTDIR 的路径。
+#       已经挂载过的镜像不会重复挂载，因此可以在每次启动评测系统时执行。
+#
+# 镜像文件名包含内容哈希，更新镜像时只需要 build 新镜像、重启评测系统：符号链接的切换是原子的，
+# 新的挂载点与旧的挂载点不同，正在使用旧挂载点的评测不受影响。旧镜像确认不再使用后需要手动卸载并删除。
+# 优先使用 erofs（需要 erofs-utils 和 Linux 5.4 以上），不可用时使用 squashfs（需要 squashfs-tools）。
+
+set -e
+
+error() { echo "$*" 1>&2; exit 1; }
+
+image_hash()
+{
+    local image
+    image=$(basename "$1")
+    image=${image%.*}
+    echo "${image##*-}"
+}
+
+build_image()
+{
+    [ $# -ge 3 ] || error "usage: $0 build <srcdir> <imagedir> <name>"
+
+    local SRCDIR IMAGEDIR NAME TMPIMAGE EXT HASH IMAGE
+    SRCDIR=$1; IMAGEDIR=$2; NAME=$3
+    [ -d "$SRCDIR" ] || error "source directory '$SRCDIR' does not exist"
+    mkdir -p "$IMAGEDIR"
+
+    # 固定时间戳和 UUID，相同的目录树总能得到相同的镜像，从而得到相同的哈希
+    TMPIMAGE="$IMAGEDIR/.$NAME.$$"
+    if command -v mkfs.erofs >/dev/null 2>&1; then
+        EXT=erofs
+        mkfs.erofs -zlz4hc -T0 -U 00000000-0000-0000-0000-000000000000 "$TMPIMAGE" "$SRCDIR" >&2
+    elif command -v mksquashfs >/dev/null 2>&1; then
+        EXT=squashfs
+        mksquashfs "$SRCDIR" "$TMPIMAGE" -noappend -comp zstd -all-time 0 -mkfs-time 0 >&2
+    else
+        error "neither mkfs.erofs nor mksquashfs is installed"
+    fi
+
+    HASH=$(sha256sum "$TMPIMAGE" | cut -c1-16)
+    IMAGE="$IMAGEDIR/$NAME-$HASH.$EXT"
+    mv -f "$TMPIMAGE" "$IMAGE"
+
+    # rename 是原子的，读到的符号链接要么指向旧镜像，要么指向新镜像
+    ln -sfn "$(basename "$IMAGE")" "$IMAGEDIR/.$NAME.link.$$"
+    mv -Tf "$IMAGEDIR/.$NAME.link.$$" "$IMAGEDIR/$NAME"
+    echo "$IMAGE"
+}
+
+mount_images()
+{
+    [ $# -ge 2 ] || error "usage: $0 mount <mountdir> <image>..."
+
+    local MOUNTDIR IMAGE FSTYPE HASH LAYERDIR LOWERDIRS="" NAME=""
+    MOUNTDIR=$1; shift
+    mkdir -p "$MOUNTDIR/layers"
+
+    for IMAGE in "$@"; do
+        IMAGE=$(realpath "$IMAGE")
+        [ -f "$IMAGE" ] || error "image '$IMAGE' does not exist"
+        case "$IMAGE" in
+            *.erofs) FSTYPE=erofs ;;
+            *.squashfs) FSTYPE=squashfs ;;
+            *) error "unknown image type of '$IMAGE'" ;;
+        esac
+
+        HASH=$(image_hash "$IMAGE")
+        LAYERDIR="$MOUNTDIR/layers/$HASH"
+        mkdir -p "$LAYERDIR"
+        if ! mountpoint -q "$LAYERDIR"; then
+            mount -t "$FSTYPE" -o ro,loop "$IMAGE" "$LAYERDIR" || error "unable to mount '$IMAGE'"
+        fi
+
+        # overlayfs 的 lowerdir 中前面的目录在上层
+        LOWERDIRS="$LAYERDIR${LOWERDIRS:+:$LOWERDIRS}"
+        NAME="${NAME:+$NAME-}$HASH"
+    done
+
+    if [ $# -eq 1 ]; then
+        echo "$LAYERDIR"
+        return
+    fi
+
+    # 没有 upperdir 的 overlayfs 是只读的
+    mkdir -p "$MOUNTDIR/$NAME"
+    if ! mountpoint -q "$MOUNTDIR/$NAME"; then
+        mount -t overlay overlay -o "lowerdir=$LOWERDIRS" "$MOUNTDIR/$NAME" || error "unable to merge layers into '$MOUNTDIR/$NAME'"
+    fi
+    echo "$MOUNTDIR/$NAME"
+}
+
+[ $# -ge 1 ] || error "usage: $0 build|mount ..."
+
+COMMAND=$1; shift
+case "$COMMAND" in
+    build) build_image "$@" ;;
+    mount) mount_images "$@" ;;
+    *) error "unknown command '$COMMAND'" ;;
+esac
@@ -28,6 +28,7 @@
 #   $SCRIPTMEMLIMIT 编译脚本运行内存限制
 #   $SCRIPTTIMELIMIT 编译脚本执行时间
 #   $SCRIPTFILELIMIT 编译脚本输出限制
+#   $SANITIZE 非空时编译脚本额外生成开启 AddressSanitizer 的 run.asan
 #   $E_COMPILER_ERROR 编译失败返回码
 #   $E_INTERNAL_ERROR 内部错误返回码
 
@@ -50,6 +51,7 @@ cleanexit ()
 
 CPUSET=""
 CPUSET_OPT=""
+CGROUP_OPT=""
 OPTIND=1
 while getopts "n:" opt; do
     case $opt in
@@ -67,6 +69,7 @@ shift $((OPTIND-1))
 
 if [ -n "$CPUSET" ]; then
     CPUSET_OPT="--cpuset $CPUSET"
+    CGROUP_OPT="--cgroup-leaf worker_$CPUSET"
 fi
 
 [ $# -ge 3 ] || error "Not enough arguments."
@@ -86,6 +89,9 @@ fi
 RUNNETNS_OPT=""
 [ ! -z "$RUNNETNS" ] && RUNNETNS_OPT="--netns=$RUNNETNS"
 
+NSPOOL_OPT=""
+[ -n "$RUNNSPOOL" ] && [ -n "$CPUSET" ] && [ -d "$RUNNSPOOL/worker_$CPUSET" ] && NSPOOL_OPT="--ns-pool $RUNNSPOOL/worker_$CPUSET"
+
 cd "$WORKDIR"
 RUNDIR="$WORKDIR/run-compile"
 
@@ -99,7 +105,7 @@ else
 fi
 
 $GAINROOT chmod -R 777 "$WORKDIR/compile"
-$GAINROOT chown -R "$RUNUSER" "$WORKDIR/compile"
+chown_files "$RUNUSER" "$WORKDIR/compile"
 touch compile.meta
 
 for src in "${SOURCE_FILES_SPLITTED[@]}"; do
@@ -110,6 +116,10 @@ if [ ! -z "$ENTRY_POINT" ]; then
     ENVIRONMENT_VARS="-V ENTRY_POINT=$ENTRY_POINT"
 fi
 
+if [ -n "$SANITIZE" ]; then
+    ENVIRONMENT_VARS="$ENVIRONMENT_VARS -V SANITIZE=1"
+fi
+
 mkdir -p "$RUNDIR"; chmod 777 "$RUNDIR"
 
 chmod -R +x "$COMPILE_SCRIPT"
@@ -120,24 +130,19 @@ mkdir -p "$RUNDIR/work/compile"; chmod 777 "$RUNDIR/work/compile"
 mkdir -p "$RUNDIR/merged"; chmod 777 "$RUNDIR/merged"
 mkdir -p "$RUNDIR/ofs"; chmod 777 "$RUNDIR/ofs"
 
-cat > "$RUNDIR/runguard_command" << EOF
-#!/bin/bash
-. "$JUDGE_UTILS/chroot_setup.sh"
-. "$JUDGE_UTILS/logging.sh"
-
-mount -t overlay overlay -olowerdir="$CHROOTDIR",upperdir="$RUNDIR/work",workdir="$RUNDIR/ofs" "$RUNDIR/merged"
-mount --bind "$WORKDIR/compile" "$RUNDIR/merged/judge"
-mount --bind -o ro "$COMPILE_SCRIPT" "$RUNDIR/merged/compile"
-
-chroot_start "$CHROOTDIR" "$RUNDIR/merged"
-EOF
-chmod +x "$RUNDIR/runguard_command"
+MOUNT_OPT=(
+    --mount "type=overlay,lower=$CHROOTDIR,upper=$RUNDIR/work,work=$RUNDIR/ofs,target=$RUNDIR/merged"
+    --mount "type=bind,source=$WORKDIR/compile,target=$RUNDIR/merged/judge"
+    --mount "type=bind,source=$COMPILE_SCRIPT,target=$RUNDIR/merged/compile,ro"
+    --mount "type=bind,source=/proc,target=$RUNDIR/merged/proc"
+    --mount "type=dev,target=$RUNDIR/merged/dev"
+)
 
 logmsg $LOG_DEBUG "Compiling $(pwd) with compile script $COMPILE_SCRIPT"
 
 # 调用 runguard 来执行编译命令
-runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $RUNNETNS_OPT -c \
-        --preexecute "$RUNDIR/runguard_command" \
+runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $CGROUP_OPT $RUNNETNS_OPT $NSPOOL_OPT $USERNS_OPT -c \
+        "${MOUNT_OPT[@]}" \
         --root "$RUNDIR/merged" \
         --work /judge \
         --user "$RUNUSER" \
@@ -147,12 +152,13 @@ runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $RUNNETNS_OPT -c \
         --wall-time "$SCRIPTTIMELIMIT" \
         --standard-error-file compile.tmp \
         --out-meta compile.meta \
+        --out-record compile.record \
         $ENVIRONMENT_VARS -- \
         "/compile/run" run "$SOURCE_FILES" "$@"
 
 logmsg $LOG_DEBUG "runguard exited with exitcode $exitcode"
 
-$GAINROOT chown -R "$(id -un):" "$WORKDIR/compile"
+chown_files "$(id -un):" "$WORKDIR/compile"
 chmod -R go-w+x "$WORKDIR/compile"
 
 # 检查是否编译器出错/runguard 崩溃
@@ -0,0 +1,157 @@
+/*
+ * testlib 检查器的常驻进程适配器
+ *
+ * 检查器的 main 函数在编译时通过 -Dmain=checker_main 改名，这里提供真正的 main 函数：
+ *
+ *   checker_server                          常驻模式：标准输入输出是评测系统传入的 SOCK_SEQPACKET socket，
+ *                                           每条请求消息通过 SCM_RIGHTS 附带 5 个文件描述符：
+ *                                           输入数据、选手输出、标准输出、feedback 文件夹、检查器输出文件，
+ *                                           每个请求回复一条消息，内容为十进制的返回值；评测系统关闭 socket 后退出
+ *   checker_server <input> <user> <answer> <feedback>
+ *                                           单次模式：与比较脚本的用法相同，参数均为文件夹，
+ *                                           比较 <input>/testdata.in、<user>/testdata.out、<answer>/testdata.out
+ *
+ * 每次检查都 fork 一个子进程调用 checker_main，testlib 通过 exit 结束检查不会影响常驻进程，
+ * 省去的是每个测试点启动 bash、runguard 和检查器进程（加载动态库、初始化运行时）的开销。
+ * testlib 的返回值转换为比较脚本的返回值：_ok 为 42，_wa 和 _unexpected_eof 为 43，_pe 和 _dirt 为 44，
+ * _partially 为 54 并将得分写入 feedback/score.txt，其他（包括 _fail）原样返回，评测系统视为比较失败。
+ *
+ * 环境变量 CHECKER_TIME_LIMIT 设置每次检查的 CPU 时间限制（秒）。
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int checker_main(int argc, char *argv[]);
+
+// 与 exec/utils/utils.sh 一致
+static const int RESULT_AC = 42;
+static const int RESULT_WA = 43;
+static const int RESULT_PE = 44;
+static const int RESULT_PC = 54;
+
+// testlib 的返回值
+static const int TESTLIB_OK = 0;
+static const int TESTLIB_WA = 1;
+static const int TESTLIB_PE = 2;
+static const int TESTLIB_DIRT = 4;
+static const int TESTLIB_UNEXPECTED_EOF = 8;
+static const int TESTLIB_PARTIALLY = 16;
+
+static const int REQUEST_FDS = 5;
+
+/**
+ * 在子进程中运行一次检查器，feedback 文件夹作为工作文件夹，检查器的标准输出和标准错误输出都写入 error_fd
+ * @return 转换后的返回值，检查器因信号退出时返回 -1
+ */
+static int run_checker(const char *input, const char *user, const char *answer, int feedback_fd, int error_fd) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) dup2(null_fd, STDIN_FILENO);
+        if (error_fd >= 0) {
+            dup2(error_fd, STDOUT_FILENO);
+            dup2(error_fd, STDERR_FILENO);
+        }
+        if (feedback_fd >= 0 && fchdir(feedback_fd) != 0) _exit(3);
+        if (const char *limit = getenv("CHECKER_TIME_LIMIT")) {
+            struct rlimit rl;
+            rl.rlim_cur = rl.rlim_max = strtoul(limit, nullptr, 10);
+            if (rl.rlim_cur > 0) setrlimit(RLIMIT_CPU, &rl);
+        }
+        char *args[] = {(char *)"checker", (char *)input, (char *)user, (char *)answer, nullptr};
+        exit(checker_main(4, args));  // 需要 exit 而不是 _exit，刷新检查器的输出缓冲区
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR) return -1;
+    if (!WIFEXITED(status)) return -1;
+
+    int code = WEXITSTATUS(status);
+    switch (code) {
+        case TESTLIB_OK:
+            return RESULT_AC;
+        case TESTLIB_WA:
+        case TESTLIB_UNEXPECTED_EOF:
+            return RESULT_WA;
+        case TESTLIB_PE:
+        case TESTLIB_DIRT:
+            return RESULT_PE;
+    }
+    if (code >= TESTLIB_PARTIALLY && code <= TESTLIB_PARTIALLY + 100 && feedback_fd >= 0) {
+        // 评分文件中第一个数字是分子，第二个数字是分母
+        int score_fd = openat(feedback_fd, "score.txt", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (score_fd < 0) return code;
+        dprintf(score_fd, "%d 100\n", code - TESTLIB_PARTIALLY);
+        close(score_fd);
+        return RESULT_PC;
+    }
+    return code;
+}
+
+static int check_once(char *argv[]) {
+    char input[4096], user[4096], answer[4096];
+    snprintf(input, sizeof(input), "%s/testdata.in", argv[1]);
+    snprintf(user, sizeof(user), "%s/testdata.out", argv[2]);
+    snprintf(answer, sizeof(answer), "%s/testdata.out", argv[3]);
+    int feedback_fd = open(argv[4], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int code = run_checker(input, user, answer, feedback_fd, STDERR_FILENO);
+    return code < 0 ? 1 : code;
+}
+
+static int serve() {
+    signal(SIGPIPE, SIG_IGN);
+    for (;;) {
+        char data[16];
+        char control[CMSG_SPACE(sizeof(int) * REQUEST_FDS)];
+        struct iovec iov = {data, sizeof(data)};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg(STDIN_FILENO, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;  // 评测系统关闭了 socket
+
+        int fds[REQUEST_FDS], count = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            int received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < received; ++i) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (count < REQUEST_FDS) fds[count++] = fd;
+                else close(fd);
+            }
+        }
+
+        int code = -1;
+        if (count == REQUEST_FDS && !(msg.msg_flags & MSG_CTRUNC)) {
+            // 检查器通过文件名打开文件，/proc/self/fd 下的路径在子进程中同样有效
+            char paths[3][32];
+            for (int i = 0; i < 3; ++i) snprintf(paths[i], sizeof(paths[i]), "/proc/self/fd/%d", fds[i]);
+            code = run_checker(paths[0], paths[1], paths[2], fds[3], fds[4]);
+        }
+        for (int i = 0; i < count; ++i) close(fds[i]);
+
+        char reply[16];
+        int len = snprintf(reply, sizeof(reply), "%d", code);
+        if (send(STDOUT_FILENO, reply, len, 0) < 0) return 0;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 5) return check_once(argv);
+    return serve();
+}
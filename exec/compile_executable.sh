@@ -39,6 +39,7 @@ cleanexit ()
 
 CPUSET=""
 CPUSET_OPT=""
+CGROUP_OPT=""
 OPTIND=1
 while getopts "n:" opt; do
     case $opt in
@@ -56,6 +57,7 @@ shift $((OPTIND-1))
 
 if [ -n "$CPUSET" ]; then
     CPUSET_OPT="-P $CPUSET"
+    CGROUP_OPT="--cgroup-leaf worker_$CPUSET"
 fi
 
 [ $# -ge 1 ] || error "Not enough arguments."
@@ -90,20 +92,16 @@ mkdir -m 0777 -p "$RUNDIR/ofs"
 mkdir -m 0777 -p "$RUNDIR/ofs/merged"
 mkdir -m 0755 -p "$RUNDIR/merged"
 
-cat > "$RUNDIR/runguard_command" << EOF
-#!/bin/bash
-. "$JUDGE_UTILS/chroot_setup.sh"
-
-mount -t overlay overlay -olowerdir="$CHROOTDIR",upperdir="$RUNDIR/work",workdir="$RUNDIR/ofs/merged" "$RUNDIR/merged"
-mount --bind "$WORKDIR/compile" "$RUNDIR/merged/judge"
-
-chroot_start "$CHROOTDIR" merged
-EOF
-chmod +x "$RUNDIR/runguard_command"
+MOUNT_OPT=(
+    --mount "type=overlay,lower=$CHROOTDIR,upper=$RUNDIR/work,work=$RUNDIR/ofs/merged,target=$RUNDIR/merged"
+    --mount "type=bind,source=$WORKDIR/compile,target=$RUNDIR/merged/judge"
+    --mount "type=bind,source=/proc,target=$RUNDIR/merged/proc"
+    --mount "type=dev,target=$RUNDIR/merged/dev"
+)
 
 # 调用 runguard 来执行编译命令
-runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT -c \
-        --preexecute "$RUNDIR/runguard_command" \
+runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $CGROUP_OPT $USERNS_OPT -c \
+        "${MOUNT_OPT[@]}" \
         --root "$RUNDIR/merged" \
         --work /judge \
         --user "$RUNUSER" \
@@ -113,13 +111,14 @@ runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT -c \
         --wall-time "$SCRIPTTIMELIMIT" \
         --standard-error-file compile.tmp \
         --out-meta compile.meta \
+        --out-record compile.record \
         -- \
         "./build"
 
 # 删除挂载点，因为我们已经确保有用的数据在 $WORKDIR/compile 中，因此删除挂载点即可。
 rm -rf "$RUNDIR"
 
-$GAINROOT chown -R "$(id -un):" "$WORKDIR/compile"
+chown_files "$(id -un):" "$WORKDIR/compile"
 chmod -R go-w "$WORKDIR/compile"
 
 # 检查是否编译超时，time-result 可能为空、soft-timelimit、hard-timelimit，空表示没有超时
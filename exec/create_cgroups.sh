@@ -11,6 +11,39 @@ error() { echo "$*" 1>&2; exit 1; }
 JUDGEHOSTUSER=$1; shift
 CGROUPBASE=/sys/fs/cgroup
 
+if [ -f $CGROUPBASE/cgroup.controllers ]; then
+    # cgroup v2（unified hierarchy）：在 judger 下为每个 CPU 核心预先创建一个叶子 cgroup，
+    # runguard 通过 --cgroup-leaf worker_<cpuset> 复用这些 cgroup，不必每次运行都创建、删除 cgroup
+    for i in cpuset memory; do
+        if ! grep -qw $i $CGROUPBASE/cgroup.controllers; then
+            error "Error: cgroup v2 controller $i is not available in running kernel. Unable to continue."
+        fi
+    done
+
+    CONTROLLERS="+cpuset +memory"
+    # io 控制器是可选的，开启后 runguard 可以统计程序读写块设备的字节数
+    if grep -qw io $CGROUPBASE/cgroup.controllers; then
+        CONTROLLERS="$CONTROLLERS +io"
+    fi
+
+    echo "$CONTROLLERS" > $CGROUPBASE/cgroup.subtree_control
+    mkdir -p $CGROUPBASE/judger
+    echo "$CONTROLLERS" > $CGROUPBASE/judger/cgroup.subtree_control
+
+    for ((i = 0; i < $(nproc --all); ++i)); do
+        mkdir -p $CGROUPBASE/judger/worker_$i
+    done
+
+    # rootless 模式（ROOTLESS=1）下评测系统以普通用户运行，runguard 要把受控程序移入 worker_<i>，
+    # 内核要求对源 cgroup 和目标 cgroup 的公共祖先的 cgroup.procs 有写权限，
+    # 因此评测系统本身必须运行在 judger/service 中，比如 systemd 服务设置 Delegate=yes 后
+    # 在 ExecStartPre 中以 root 执行 echo $MAINPID > /sys/fs/cgroup/judger/service/cgroup.procs
+    mkdir -p $CGROUPBASE/judger/service
+
+    chown -R $JUDGEHOSTUSER $CGROUPBASE/judger
+    exit 0
+fi
+
 for i in cpuset memory; do
     mkdir -p $CGROUPBASE/$i
     if [ ! -d $CGROUPBASE/$i/ ]; then
@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# 本脚本用于创建命名空间池
+# 为每个 CPU 核心（worker）预先创建一组 IPC、UTS、网络命名空间，并通过 bind mount 持久化到
+# <pooldir>/worker_<i>/{ipc,uts,net}，runguard 通过 --ns-pool 进入这些命名空间，不必每次运行都创建
+# 该脚本必须在每次开机后执行一次，你可以把本脚本设置为启动脚本
+# 用法： $0 <pooldir>
+# 注意，与 create_net_namespace.sh 相同，不要在网络命名空间内执行 ip link set lo up
+
+error() { echo "$*" 1>&2; exit 1; }
+
+[ $# -ge 1 ] || error "namespace pool directory required"
+
+POOLDIR=$1; shift
+
+mkdir -p "$POOLDIR"
+
+# 命名空间文件只能 bind mount 到 private 的挂载点上，做法与 ip netns add 相同
+if ! mountpoint -q "$POOLDIR"; then
+    mount --bind "$POOLDIR" "$POOLDIR"
+fi
+mount --make-private "$POOLDIR"
+
+for ((i = 0; i < $(nproc --all); ++i)); do
+    WORKERDIR="$POOLDIR/worker_$i"
+    mkdir -p "$WORKERDIR"
+    if mountpoint -q "$WORKERDIR/ipc"; then
+        continue
+    fi
+
+    touch "$WORKERDIR/ipc" "$WORKERDIR/uts" "$WORKERDIR/net"
+    unshare --ipc="$WORKERDIR/ipc" --uts="$WORKERDIR/uts" --net="$WORKERDIR/net" \
+        hostname judge || error "unable to create namespaces for worker $i"
+done
@@ -50,7 +50,7 @@ cd "$WORKDIR"
 
 mkdir -p "$WORKDIR/compile"
 $GAINROOT chmod -R 777 "$WORKDIR/compile"
-$GAINROOT chown -R "$RUNUSER" "$WORKDIR/compile"
+[ -z "$ROOTLESS" ] && $GAINROOT chown -R "$RUNUSER" "$WORKDIR/compile"
 
 cd "$WORKDIR/compile"
 
@@ -50,6 +50,7 @@ cleanexit ()
 CPUSET=""
 OPTTIME="--cpu-time"
 CPUSET_OPT=""
+CGROUP_OPT=""
 OPTIND=1
 while getopts "n:w" opt; do
     case $opt in
@@ -70,6 +71,7 @@ shift $((OPTIND-1))
 
 if [ -n "$CPUSET" ]; then
     CPUSET_OPT="-P $CPUSET"
+    CGROUP_OPT="--cgroup-leaf worker_$CPUSET"
 fi
 
 MEMLIMIT_OPT=""
@@ -110,11 +112,13 @@ RUN_SCRIPT="$1"; shift
 RAN_GEN_SYSCALL_OPT=""
 if [ -f "$RAN_GEN_COMPILE_SCRIPT/.syscall64" ]; then
     RAN_GEN_SYSCALL_OPT="--allowed-syscall=$RAN_GEN_COMPILE_SCRIPT/.syscall64"
+    [ -n "$SECCOMPCACHE" ] && RAN_GEN_SYSCALL_OPT="$RAN_GEN_SYSCALL_OPT --seccomp-cache=$SECCOMPCACHE"
 fi
 
 STD_PROG_SYSCALL_OPT=""
 if [ -f "$STD_PROG_COMPILE_SCRIPT/.syscall64" ]; then
     STD_PROG_SYSCALL_OPT="--allowed-syscall=$STD_PROG_COMPILE_SCRIPT/.syscall64"
+    [ -n "$SECCOMPCACHE" ] && STD_PROG_SYSCALL_OPT="$STD_PROG_SYSCALL_OPT --seccomp-cache=$SECCOMPCACHE"
 fi
 
 if [ ! -d "$WORKDIR" ] || [ ! -w "$WORKDIR" ] || [ ! -x "$WORKDIR" ]; then
@@ -126,6 +130,9 @@ fi
 RUNNETNS_OPT=""
 [ ! -z "$RUNNETNS" ] && RUNNETNS_OPT="--netns=$RUNNETNS"
 
+NSPOOL_OPT=""
+[ -n "$RUNNSPOOL" ] && [ -n "$CPUSET" ] && [ -d "$RUNNSPOOL/worker_$CPUSET" ] && NSPOOL_OPT="--ns-pool $RUNNSPOOL/worker_$CPUSET"
+
 cd "$WORKDIR"
 
 if [ -n "$VERBOSE" ]; then
@@ -156,23 +163,19 @@ mkdir -m 0777 -p "$RUNDIR/ofs/merged"
 mkdir -m 0777 -p "$RUNDIR/ofs/judge"
 mkdir -m 0777 -p "$RUNDIR/ofs/judge2"
 
-cat > "$RUNDIR/runguard_command" << EOF
-#!/bin/bash
-. "$JUDGE_UTILS/chroot_setup.sh"
-
-mount -t overlay overlay -olowerdir="$CHROOTDIR",upperdir="$RUNDIR/work",workdir="$RUNDIR/ofs/merged" "$RUNDIR/merged"
-mount -t overlay overlay -olowerdir="$RAN_GEN",upperdir="$WORKDIR/input",workdir="$RUNDIR/ofs/judge" "$RUNDIR/merged/judge"
-mount --bind -o ro "$RUN_SCRIPT" "$RUNDIR/merged/run"
-
-chroot_start "$CHROOTDIR" "$RUNDIR/merged"
-EOF
-chmod +x "$RUNDIR/runguard_command"
+MOUNT_OPT=(
+    --mount "type=overlay,lower=$CHROOTDIR,upper=$RUNDIR/work,work=$RUNDIR/ofs/merged,target=$RUNDIR/merged"
+    --mount "type=overlay,lower=$RAN_GEN,upper=$WORKDIR/input,work=$RUNDIR/ofs/judge,target=$RUNDIR/merged/judge"
+    --mount "type=bind,source=$RUN_SCRIPT,target=$RUNDIR/merged/run,ro"
+    --mount "type=bind,source=/proc,target=$RUNDIR/merged/proc"
+    --mount "type=dev,target=$RUNDIR/merged/dev"
+)
 
 logmsg $LOG_DEBUG "Running random generator $RAN_GEN generating $WORKDIR"
 
 # 调用 runguard 来执行随机生成器
-runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $RAN_GEN_SYSCALL_OPT $RUNNETNS_OPT \
-        --preexecute "$RUNDIR/runguard_command" \
+runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $CGROUP_OPT $RAN_GEN_SYSCALL_OPT $RUNNETNS_OPT $NSPOOL_OPT $USERNS_OPT \
+        "${MOUNT_OPT[@]}" \
         --root "$RUNDIR/merged" \
         --work /judge \
         --no-core-dumps \
@@ -218,23 +221,19 @@ cat random.err
 
 chmod -R a+rwx "$WORKDIR/input"
 
-cat > "$RUNDIR/runguard_command" << EOF
-#!/bin/bash
-. "$JUDGE_UTILS/chroot_setup.sh"
-
-mount -t overlay overlay -olowerdir="$CHROOTDIR",upperdir="$RUNDIR/work",workdir="$RUNDIR/ofs/merged" "$RUNDIR/merged"
-mount -t overlay overlay -olowerdir="$WORKDIR/input":"$STD_PROG",upperdir="$WORKDIR/output",workdir="$RUNDIR/ofs/judge2" "$RUNDIR/merged/judge"
-mount --bind -o ro "$RUN_SCRIPT" "$RUNDIR/merged/run"
-
-chroot_start "$CHROOTDIR" "$RUNDIR/merged"
-EOF
-chmod +x "$RUNDIR/runguard_command"
+MOUNT_OPT=(
+    --mount "type=overlay,lower=$CHROOTDIR,upper=$RUNDIR/work,work=$RUNDIR/ofs/merged,target=$RUNDIR/merged"
+    --mount "type=overlay,lower=$WORKDIR/input:$STD_PROG,upper=$WORKDIR/output,work=$RUNDIR/ofs/judge2,target=$RUNDIR/merged/judge"
+    --mount "type=bind,source=$RUN_SCRIPT,target=$RUNDIR/merged/run,ro"
+    --mount "type=bind,source=/proc,target=$RUNDIR/merged/proc"
+    --mount "type=dev,target=$RUNDIR/merged/dev"
+)
 
 logmsg $LOG_DEBUG "Running standard program $STD_PROG generating $WORKDIR"
 
 # 调用 runguard 来执行标准程序
-runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $MEMLIMIT_OPT $FILELIMIT_OPT $PROCLIMIT_OPT $STD_PROG_SYSCALL_OPT $RUNNETNS_OPT \
-        --preexecute "$RUNDIR/runguard_command" \
+runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT $CGROUP_OPT $MEMLIMIT_OPT $FILELIMIT_OPT $PROCLIMIT_OPT $STD_PROG_SYSCALL_OPT $RUNNETNS_OPT $NSPOOL_OPT $USERNS_OPT \
+        "${MOUNT_OPT[@]}" \
         --root "$RUNDIR/merged" \
         --work /judge \
         --no-core-dumps \
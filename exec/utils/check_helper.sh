@@ -65,7 +65,7 @@ OPTINT=1
 while getopts "n:w" opt; do
     case $opt in
         n)
-            OPTSET="$OPTARG"
+            CPUSET="$OPTARG"
             ;;
         w)
             OPTTIME="--wall-time"
@@ -80,8 +80,10 @@ shift $((OPTIND-1))
 [ "$1" == "--" ] && shift
 
 CPUSET_OPT=""
+CGROUP_OPT=""
 if [ -n "$CPUSET" ]; then
     CPUSET_OPT="-P $CPUSET"
+    CGROUP_OPT="--cgroup-leaf worker_$CPUSET"
 fi
 
 MEMLIMIT_OPT=""
@@ -121,9 +123,20 @@ BASEDIR_OPT=""
 RUNNETNS_OPT=""
 [ ! -z "$RUNNETNS" ] && RUNNETNS_OPT="--netns=$RUNNETNS"
 
+NSPOOL_OPT=""
+[ -n "$RUNNSPOOL" ] && [ -n "$CPUSET" ] && [ -d "$RUNNSPOOL/worker_$CPUSET" ] && NSPOOL_OPT="--ns-pool $RUNNSPOOL/worker_$CPUSET"
+
+# 设置了 SAMPLE_INTERVAL（毫秒）时，runguard 定时采样选手程序的资源使用情况并写入 program.samples
+SAMPLE_OPT=""
+[ -n "$SAMPLE_INTERVAL" ] && SAMPLE_OPT="--sample-interval $SAMPLE_INTERVAL --out-samples program.samples"
+
+# Landlock 运行脚本（带有 .landlock 的运行脚本）允许选手程序读取、执行的主机路径，以空格分隔
+[ -n "$LANDLOCK_RO" ] || LANDLOCK_RO="/bin /usr /lib /lib32 /lib64 /etc/ld.so.cache /dev/urandom"
+
 SYSCALL_OPT=""
 if [ -f "$COMPILE_SCRIPT/.syscall64" ]; then
     SYSCALL_OPT="--allowed-syscall=$COMPILE_SCRIPT/.syscall64"
+    [ -n "$SECCOMPCACHE" ] && SYSCALL_OPT="$SYSCALL_OPT --seccomp-cache=$SECCOMPCACHE"
 fi
 
 chmod -R a+rwx .
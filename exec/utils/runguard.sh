@@ -1,6 +1,24 @@
 unset GLOG_log_dir        # 阻止 runguard 产生日志文件，我们已将 runguard 日志输出到 system.out 中
 unset GLOG_colorlogstderr # 阻止 runguard 的 glog 输出颜色控制符
 
+# 设置了 ROOTLESS 时评测系统以普通用户运行，runguard 通过用户命名空间隔离受控程序。
+# 受控程序创建的文件在主机上直接属于评测系统用户，不需要（也无法）chown
+USERNS_OPT=""
+[ -n "$ROOTLESS" ] && USERNS_OPT="--userns"
+
+# 限制受控程序的磁盘 I/O，仅 cgroup v2 下有效
+IO_OPT=()
+[ -n "$IOMAX" ] && IO_OPT+=(--io-max "$IOMAX")
+[ -n "$IOWEIGHT" ] && IO_OPT+=(--io-weight "$IOWEIGHT")
+
+# 递归修改文件所有者，rootless 模式下跳过
+#    chown_files <owner> <file>...
+chown_files()
+{
+    [ -n "$ROOTLESS" ] && return 0
+    $GAINROOT chown -R "$@"
+}
+
 read_metadata()
 {
     local metafile
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <vector>
 
 namespace judge {
 
@@ -70,6 +71,25 @@ scoped_file_lock lock_directory(const std::filesystem::path &dir, bool shared);
  */
 void clean_locked_directory(const std::filesystem::path &dir);
 
+/**
+ * @brief 将多个 overlayfs 的 lowerdir 合并为一个等价的目录
+ * 按 overlayfs 的语义合并：靠前的目录在上层，同名的文件夹合并、同名的文件取上层的，
+ * 白化文件（whiteout）和不透明（opaque）文件夹原样保留，因此合并结果放在其他 lowerdir 之上时也是等价的。
+ * 文件通过硬链接共享，跨文件系统时复制。合并结果不能被修改，只能作为 lowerdir 使用。
+ * @param layers 要合并的文件夹，靠前的在上层
+ * @param target 合并结果，必须不存在
+ */
+void flatten_overlay_layers(const std::vector<std::filesystem::path> &layers, const std::filesystem::path &target);
+
+/**
+ * @brief 以尽可能少的数据拷贝复制文件夹
+ * 文件优先通过硬链接共享；跨文件系统时先尝试 reflink（FICLONE），再尝试在内核中拷贝（copy_file_range），
+ * 最后退回到普通的拷贝，复制的文件保留权限和修改时间。由于可能共享同一个 inode，复制结果和原文件夹都不能被修改。
+ * @param from 要复制的文件夹
+ * @param to 复制结果，必须不存在
+ */
+void link_or_clone_directory(const std::filesystem::path &from, const std::filesystem::path &to);
+
 time_t last_write_time(const std::filesystem::path &path);
 
 void last_write_time(const std::filesystem::path &path, time_t time);
@@ -1,4 +1,16 @@
 #pragma once
 
 int get_userid(const char *name);
-int get_groupid(const char *name);
\ No newline at end of file
+int get_groupid(const char *name);
+
+/**
+ * @brief 在 target 上挂载大小为 size_kb KB 的 tmpfs
+ * @return 成功返回 0，失败返回 -1 并设置 errno
+ */
+int mount_tmpfs(const char *target, long size_kb);
+
+/**
+ * @brief 卸载 target 上的文件系统，target 不是挂载点时什么也不做
+ * @return 成功返回 0，失败返回 -1 并设置 errno
+ */
+int unmount_dir(const char *target);
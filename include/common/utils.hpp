@@ -151,6 +151,12 @@ struct process_builder {
 
     process_builder &awake_period(int period, std::function<void()> callback);
 
+    /**
+     * @brief 将程序的标准输出和标准错误输出追加到文件中
+     * @param file 输出文件，不存在时创建
+     */
+    process_builder &output(const std::filesystem::path &file);
+
     /**
      * @brief 调用外部程序
      * @param args 转送给应用程序的参数列表，比如可以传入 filesystem::path 给 args[0] 来表示应用程序路径
@@ -199,6 +205,8 @@ private:
     bool epath = false;
     std::filesystem::path path;
 
+    std::filesystem::path output_file;
+
     int exitcode;
 };
 
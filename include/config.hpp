@@ -97,9 +97,11 @@ extern std::filesystem::path CACHE_DIR;
  * @brief 只存放将要评测的测试数据的文件夹，测试完成后数据将被删除
  * 若将这个文件夹放进内存盘，可以加速选手程序的 IO 性能，
  * 避免系统进入 IO 瓶颈导致评测的不公平。
+ * 同一份测试数据只暂存一次，由同时使用它的测试点共享，最后一个测试点结束后删除。
+ * 与 CACHE_DIR 在同一个文件系统上时通过硬链接暂存，否则复制（支持时使用 reflink）。
  * 
  * DATA_DIR
- * ├── ABCDEFG // 随机生成的 uuid
+ * ├── data-<pid>-<n> // 评测客户端进程号和暂存序号
  * │   ├── input // 当前测试数据组的输入数据文件夹
  * │   └── output // 当前测试数据组的输出数据文件夹
  * └── ...
@@ -143,12 +145,54 @@ extern bool USE_DATA_DIR;
  * │           │   ├── compare.err // 比较程序的 stderr 输出
  * │           │   ├── compare.meta // 比较程序的运行信息
  * │           │   └── system.out // 检查脚本的日志
- * │           └── run-...
+ * │           ├── run-...
+ * │           └── snapshot-[task id] // 依赖链上各运行文件夹合并后的快照，作为依赖该测试点的测试点的 lowerdir
  * ├── moj
  * └── mcourse
  */
 extern std::filesystem::path RUN_DIR;
 
+/**
+ * @brief 是否为每个测试点的运行文件夹挂载独立的 tmpfs
+ * tmpfs 的大小由测试点的输出限制决定，选手程序的大量输出不会写入磁盘，
+ * 也不会与其他评测任务争抢磁盘带宽。需要注意 tmpfs 的页面计入写入者所在 cgroup 的内存使用量，
+ * 因此开启后选手程序的输出文件会计入其内存使用量。
+ * 需要 root 权限，rootless 模式下挂载失败时退回到普通文件夹。
+ */
+extern bool TMPFS_RUN_DIR;
+
+/**
+ * @brief 是否在使用内置比较器时流式比较选手输出
+ * 选手程序的标准输出写入运行文件夹中的命名管道，评测系统边读取边比较，
+ * 发现无法忽略的差异或者输出远长于标准输出时立即结束选手程序并返回 Wrong Answer，选手输出不会写入磁盘。
+ * 依赖本测试点的测试点无法读取本测试点的选手输出。
+ */
+extern bool STREAM_COMPARE;
+
+/**
+ * @brief 批量评测时一次最多运行多少个测试点，不超过 1 时不批量评测
+ * 检查脚本带有 .batch 标记时（目前为 standard-trusted），评测客户端会领取同一提交中使用相同脚本、
+ * 相同限制且依赖相同测试点的其他测试点，只启动一次检查脚本和 runguard 依次运行这些测试点。
+ * 每个测试点仍然使用独立的运行文件夹、overlayfs 的 upper 层和 cgroup 计数，
+ * 但同一批测试点只能在同一个 CPU 核心上依次运行，不适合测试点数量少于评测核心数的场景。
+ */
+extern int BATCH_SIZE;
+
+/**
+ * @brief 是否使用评测系统内置的检查流程代替 standard 和 standard-trusted 检查脚本
+ * 内置检查流程（见 include/judge/standard_check.hpp）直接调用 runguard，与检查脚本的结果一致，
+ * 省去了每个测试点启动 bash 和数十个 coreutils 进程的开销。其他检查脚本不受影响。默认关闭。
+ */
+extern bool NATIVE_CHECK;
+
+/**
+ * @brief 内置检查流程是否缓存比较结果
+ * 固定测试数据的测试点以选手输出的 SHA-1 为键，在题目缓存文件夹中保存比较程序的返回值和 feedback 文件夹，
+ * 之后的提交在同一测试点上得到相同的输出时不再运行比较程序（见 include/judge/verdict_cache.hpp）。
+ * 比较程序的结果只能取决于输入数据、标准输出和选手程序写入的文件，因此默认关闭，由部署者确认后开启。
+ */
+extern bool VERDICT_CACHE;
+
 /**
  * @brief 配置好的 chroot 路径
  * 必须是通过 exec/chroot_make.sh 创建的 chroot 环境
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace judge {
+
+/**
+ * @brief 常驻检查器进程
+ * 比较程序文件夹中存在 .server 时（见 exec/compile/testlib），检查器在 runguard 中作为常驻进程运行，
+ * 评测系统通过 SOCK_SEQPACKET socket（检查器的标准输入输出）发送请求：
+ * 每条消息附带输入数据、选手输出、标准输出、feedback 文件夹和检查器输出文件 5 个文件描述符，
+ * 检查器回复一条消息，内容为十进制的返回值（与比较脚本相同，如 42 表示 Accepted）。
+ * 检查器只能访问评测系统传入的文件，因此不需要为每个测试点重新挂载测试数据文件夹。
+ */
+class checker_server {
+public:
+    /**
+     * @brief 在 runguard 中启动检查器
+     * @param compare_dir 比较程序文件夹，其中的 run 为检查器
+     * @param cpuset 检查器绑定的 CPU 核心，与评测核心相同
+     * @param workdir 检查器沙箱的 overlayfs 文件夹，启动时会被清空
+     * @throw std::system_error 无法启动 runguard
+     */
+    checker_server(const std::filesystem::path &compare_dir, const std::string &cpuset, const std::filesystem::path &workdir);
+    ~checker_server();
+
+    checker_server(const checker_server &) = delete;
+    checker_server &operator=(const checker_server &) = delete;
+
+    /**
+     * @brief 比较一个测试点的选手输出
+     * @param timeout 等待检查器回复的最长时间，单位为秒
+     * @return 检查器的返回值。超时未回复时结束检查器并返回 -1；检查器已经退出或者无法打开文件时返回空。
+     *         这两种情况下检查器都不能再使用
+     */
+    std::optional<int> check(const std::filesystem::path &input, const std::filesystem::path &user, const std::filesystem::path &answer,
+                             const std::filesystem::path &feedback, const std::filesystem::path &error_file, int timeout);
+
+    /**
+     * @brief 检查器是否仍在运行，并且是由 compare_dir 中当前的 run 启动的（比较程序没有被重新编译）
+     */
+    bool serves(const std::filesystem::path &compare_dir) const;
+
+private:
+    void stop();
+
+    std::filesystem::path compare_dir;
+    std::filesystem::file_time_type compare_time;
+    int sock = -1;
+    pid_t pid = -1;
+};
+
+/**
+ * @brief 比较程序是否支持作为常驻检查器运行
+ */
+bool has_checker_server(const std::filesystem::path &compare_dir);
+
+/**
+ * @brief 使用评测核心 cpuset 的常驻检查器比较一个测试点
+ * 每个评测核心同时只保留一个检查器，题目（比较程序文件夹）不同或者比较程序被重新编译时重新启动，
+ * 通信失败的检查器会被结束，下次调用时重新启动。
+ * @return 检查器的返回值，无法启动检查器或者通信失败时返回空，调用者应该退回到每个测试点启动一次比较程序
+ */
+std::optional<int> check_with_server(const std::filesystem::path &compare_dir, const std::string &cpuset,
+                                     const std::filesystem::path &input, const std::filesystem::path &user, const std::filesystem::path &answer,
+                                     const std::filesystem::path &feedback, const std::filesystem::path &error_file);
+
+}  // namespace judge
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace judge {
+
+/**
+ * @brief 内置比较器支持的比较方式，与 exec/compare 下的同名比较脚本语义一致
+ */
+enum class compare_mode {
+    /**
+     * @brief 对应 diff-all
+     * 忽略空白字符的数量、行末空白字符和空行后仍不一致时为 Wrong Answer，
+     * 除行末的 \r 外存在任何差异（包括文件末尾的换行符）时为 Presentation Error
+     */
+    EXACT,
+
+    /**
+     * @brief 对应 diff-ign-space
+     * 忽略空白字符的数量、行末空白字符和空行后一致即为 Accepted，否则为 Wrong Answer
+     */
+    IGNORE_SPACE,
+
+    /**
+     * @brief 对应 diff-ign-trailing
+     * 与 EXACT 相同，但只忽略行末空白字符和空行后一致即为 Accepted
+     */
+    IGNORE_TRAILING_SPACE,
+
+    /**
+     * @brief 对应 float
+     * 按空白字符切分为词法单元逐个比较，两边都是十进制实数的词法单元允许存在绝对误差或相对误差，
+     * 其他词法单元（包括 inf、nan）必须完全相同。不会返回 Presentation Error
+     */
+    FLOAT,
+
+    /**
+     * @brief 对应 gtest
+     * 不比较选手输出，而是转换选手程序生成的 test_detail.xml（见 include/judge/report_parser.hpp）
+     */
+    GTEST,
+
+    /**
+     * @brief 对应 valgrind
+     * 不比较选手输出，而是转换 valgrind 生成的 valgrind.xml（见 include/judge/report_parser.hpp）
+     */
+    VALGRIND
+};
+
+/**
+ * @brief 比较方式是否比较选手输出和标准输出，GTEST 和 VALGRIND 不能用于 compare_output、compare_files 和流式比较
+ */
+inline bool compares_output(compare_mode mode) {
+    return mode != compare_mode::GTEST && mode != compare_mode::VALGRIND;
+}
+
+/**
+ * @brief 内置比较器的比较方式和参数
+ */
+struct compare_options {
+    compare_options(compare_mode mode = compare_mode::EXACT, double absolute_error = 1e-6, double relative_error = 1e-6)
+        : mode(mode), absolute_error(absolute_error), relative_error(relative_error) {}
+
+    compare_mode mode;
+
+    /**
+     * @brief FLOAT 比较方式下，|选手答案 - 标准答案| 不超过 absolute_error
+     * 或者不超过 relative_error * |标准答案| 即视为相同
+     */
+    double absolute_error, relative_error;
+};
+
+enum class compare_result {
+    ACCEPTED,
+    WRONG_ANSWER,
+    PRESENTATION_ERROR
+};
+
+/**
+ * @brief 获取比较脚本 id 对应的内置比较方式
+ * @param compare_script 比较脚本 id，如 diff-all。float 可以在冒号后指定绝对误差和相对误差，
+ *                       如 float:1e-4 表示两者都是 1e-4，float:1e-4:1e-9 分别指定两者，默认均为 1e-6
+ * @return 没有对应的内置比较方式时返回空
+ * @throw std::invalid_argument 比较脚本 id 的参数不合法
+ */
+std::optional<compare_options> builtin_compare_options(const std::string &compare_script);
+
+/**
+ * @brief 比较选手输出和标准输出
+ * 只遍历一遍输入，不复制数据，不论输入多大都只使用常数的额外内存。
+ */
+compare_result compare_output(std::string_view user, std::string_view answer, const compare_options &options);
+
+/**
+ * @brief 预先规范化标准输出，写入 dir 中
+ * EXACT、IGNORE_SPACE 和 IGNORE_TRAILING_SPACE 在选手输出与标准输出不完全相同时需要规范化双方的输出。
+ * 标准输出在下载或生成时规范化一次，并记录行首位置索引（每 64KB 一个），
+ * 之后比较时只需要规范化选手输出，从差异所在行附近开始与规范化后的标准输出逐字节比较。
+ * 已经存在且与标准输出对应的规范化结果不会重新生成。
+ * @param answer 标准输出文件
+ * @param dir 存放规范化结果的文件夹，比较时作为 normalized 参数传入
+ * @throw std::system_error 无法读取标准输出或者写入规范化结果
+ */
+void normalize_answer(const std::filesystem::path &answer, const std::filesystem::path &dir, const compare_options &options);
+
+/**
+ * @brief 比较选手输出文件和标准输出文件
+ * 文件通过 mmap 映射到内存，已经比较过的部分会及时从映射中释放，因此可以比较远大于内存的文件。
+ * @param normalized normalize_answer 写入的文件夹，不存在规范化结果或者规范化结果与标准输出不对应时同时规范化双方的输出
+ * @throw std::system_error 无法打开或映射文件
+ */
+compare_result compare_files(const std::filesystem::path &user, const std::filesystem::path &answer, const compare_options &options,
+                             const std::filesystem::path &normalized = {});
+
+/**
+ * @brief 边接收选手输出边与标准输出比较
+ * 选手输出可以分成任意多段传入，只缓存当前未结束的一行。
+ * 一旦确定为 Wrong Answer（存在无法忽略的差异，或者输出长度远超标准输出），feed 返回 false，之后的输出不再需要传入。
+ */
+class stream_comparator {
+public:
+    /**
+     * @param normalized normalize_answer 写入的文件夹，见 compare_files
+     * @throw std::system_error 无法打开或映射标准输出文件
+     */
+    stream_comparator(const std::filesystem::path &answer, const compare_options &options, const std::filesystem::path &normalized = {});
+    ~stream_comparator();
+
+    /**
+     * @brief 传入下一段选手输出
+     * @return 已经确定为 Wrong Answer 时返回 false
+     */
+    bool feed(std::string_view data);
+
+    /**
+     * @brief 选手输出结束，返回比较结果
+     */
+    compare_result finish();
+
+private:
+    struct impl;
+    std::unique_ptr<impl> d;
+};
+
+/**
+ * @brief 从命名管道读取选手输出并与标准输出比较，选手程序的输出不会写入磁盘
+ * 写入端关闭后返回比较结果。确定为 Wrong Answer 时先调用 on_wrong_answer（用于结束选手程序），
+ * 再关闭管道使选手程序之后的写入收到 SIGPIPE。
+ * 选手程序可能还没有打开管道就退出了，此时调用者需要设置 stop，这之后管道中剩余的输出读取完毕即结束比较。
+ * @throw std::system_error 无法打开命名管道或标准输出文件，后者在读完管道中的输出后才抛出
+ */
+compare_result compare_fifo(const std::filesystem::path &fifo, const std::filesystem::path &answer, const compare_options &options,
+                            const std::atomic_bool &stop, const std::function<void()> &on_wrong_answer,
+                            const std::filesystem::path &normalized = {});
+
+}  // namespace judge
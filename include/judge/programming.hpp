@@ -13,6 +13,7 @@
 #include "judge/submission.hpp"
 #include "program.hpp"
 #include "monitor/monitor.hpp"
+#include "runguard.hpp"
 
 /**
  * 这个头文件包含提交信息
@@ -311,7 +312,7 @@ struct judge_task_result {
      * @brief 本测试点程序运行使用的内存
      * 单位为字节
      */
-    int memory_used;
+    int64_t memory_used;
 
     /**
      * @brief 错误报告
@@ -351,6 +352,13 @@ struct judge_task_result {
      */
     std::filesystem::path data_dir;
 
+    /**
+     * @brief 选手程序运行过程中的资源使用采样
+     * 仅在环境变量 SAMPLE_INTERVAL 设置了采样间隔（毫秒）且使用 cgroup v2 时有效，否则为空
+     * 可用于发现频繁换页、大部分时间在内核态的测试点，以及同一主机上其他任务的干扰
+     */
+    std::vector<runguard_sample> samples;
+
     std::vector<action_result> actions;
 };
 
@@ -398,11 +406,23 @@ struct programming_submission : public submission {
      */
     std::vector<judge_task_result> results;
 
+    /**
+     * @brief 批量评测的测试点，见 BATCH_SIZE
+     * 键为评测消息中的测试点，值为与其一起评测的所有测试点（包括键本身）
+     */
+    std::map<std::size_t, std::vector<std::size_t>> batches;
+
     /**
      * @brief 已经完成了多少个测试点的评测
      */
     std::size_t finished = 0;
 
+    /**
+     * @brief 保护运行目录快照的创建
+     * 依赖同一个测试点的多个测试点可能同时开始评测，只能有一个测试点创建快照
+     */
+    std::mutex snapshot_mut;
+
     /**
      * @brief 题目读锁，提交销毁后会自动释放锁
      * 正在评测的提交需要使用读锁锁住题目文件夹以避免题目更新时导致数据错误。
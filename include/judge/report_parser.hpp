@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+
+namespace judge {
+
+/**
+ * @brief 将 gtest 生成的 test_detail.xml 转换为评测报告，与 exec/compare/gtest 比较脚本的结果一致
+ * 在 feedback 文件夹中写入 report.txt（测试组统计和至多 10 个失败测试组的信息），部分通过时写入 score.txt。
+ * XML 以流的方式逐个标签解析，不会构建完整的文档树。
+ * @param xml 选手程序运行时生成的 test_detail.xml
+ * @param feedback 比较脚本的 feedback 文件夹
+ * @return 与比较脚本相同的返回值：42 表示全部通过，43 表示全部未通过，54 表示部分通过
+ * @throw std::runtime_error 无法读取 XML 文件、XML 格式错误或者缺少必需的属性，对应比较脚本的内部错误
+ */
+int convert_gtest_report(const std::filesystem::path &xml, const std::filesystem::path &feedback);
+
+/**
+ * @brief 将 valgrind 生成的 valgrind.xml 转换为评测报告，与 exec/compare/valgrind 比较脚本的结果一致
+ * 存在错误时将 valgrindoutput 按 xmltodict 的规则转换为 json 写入 feedback/report.txt，
+ * 其中 error、stack、frame 总是列表，frame 中去掉 obj 和 dir。
+ * @param xml 选手程序运行时 valgrind 生成的 valgrind.xml
+ * @param feedback 比较脚本的 feedback 文件夹
+ * @return 与比较脚本相同的返回值：42 表示没有内存错误，43 表示存在内存错误
+ * @throw std::runtime_error 无法读取 XML 文件、XML 格式错误或者不是 valgrind 的输出，对应比较脚本的内部错误
+ */
+int convert_valgrind_report(const std::filesystem::path &xml, const std::filesystem::path &feedback);
+
+}  // namespace judge
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace judge {
+
+/**
+ * @brief 内置检查流程的参数，与 check script 的命令行参数和环境变量一一对应
+ */
+struct standard_check_options {
+    /**
+     * @brief 为 true 时与 standard-trusted 一致：选手程序直接作为命令运行，比较脚本在宿主机上运行且不限制资源；
+     * 否则与 standard 一致：通过运行脚本运行选手程序，比较脚本在 runguard 中运行
+     */
+    bool trusted = false;
+
+    std::filesystem::path rundir;          // 运行文件夹，对应 check script 的工作文件夹
+    std::filesystem::path datadir;         // <datadir>
+    std::filesystem::path chrootdir;       // <chrootdir>
+    std::string basedir;                   // <basedir>，多个文件夹用冒号隔开
+    std::filesystem::path compile_script;  // <compile>
+    std::filesystem::path run_script;      // <run>
+    std::filesystem::path compare_script;  // <compare>
+    std::vector<std::string> run_args;     // <run args>
+
+    std::string cpuset;      // -n
+    bool wall_time = false;  // -w
+    double time_limit = 1;   // <timelimit>，单位为秒
+    int memory_limit = -1;   // MEMLIMIT，单位为 KB
+    int file_limit = -1;     // FILELIMIT，单位为 KB
+    int proc_limit = -1;     // PROCLIMIT
+
+    bool skip_compare = false;    // SKIP_COMPARE
+    bool stream_compare = false;  // STREAM_COMPARE
+
+    /**
+     * @brief 比较结果缓存文件夹（见 include/judge/verdict_cache.hpp），为空时不使用缓存
+     * 调用者需要保证文件夹只对应一个题目版本、一个测试点和一个比较程序
+     */
+    std::filesystem::path verdict_cache;
+
+    /**
+     * @brief 传给比较脚本的环境变量，如 FLOAT_ABS_ERROR=1e-4
+     */
+    std::vector<std::string> compare_env;
+};
+
+/**
+ * @brief 是否可以用内置检查流程代替 check script
+ * 只有 standard 和 standard-trusted 有内置检查流程，使用 Landlock 的运行脚本（带有 .landlock）仍然使用 check script
+ */
+bool has_standard_check(const std::string &check_script, const std::filesystem::path &run_script);
+
+/**
+ * @brief 执行内置检查流程，与 exec/check/standard 和 exec/check/standard-trusted 的语义一致
+ * 运行文件夹中会留下同样的 program.meta、program.err、feedback/ 和 system.out，
+ * 省去了启动 bash、数十次 mkdir/chmod 以及 chown -R 的开销。
+ * @return 与 check script 相同的返回值（error_codes）
+ */
+int standard_check(const standard_check_options &opt);
+
+/**
+ * @brief 根据 runguard 的 meta 文件判断选手程序的运行结果，判断顺序与 check script 一致
+ * @param metafile runguard 输出的 meta 文件
+ * @param check_exit_code 是否将非零返回值视为 Runtime Error
+ * @param message 返回写入 system.out 的说明，如 Time Limit Exceeded
+ * @return 选手程序正常结束时返回 E_ACCEPTED，否则返回对应的 error_codes
+ */
+int program_verdict(const std::filesystem::path &metafile, bool check_exit_code, std::string &message);
+
+}  // namespace judge
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace judge {
+
+/**
+ * 比较结果缓存
+ * 同一道题的大量提交会产生完全相同的输出（正确答案，或者同一种常见的错误答案），
+ * 因此以选手输出的摘要为键保存比较程序的返回值、feedback 文件夹以及比较程序的输出，
+ * 同一测试点、同一比较程序再次遇到相同的输出时直接复用，不再运行比较程序。
+ * 缓存文件夹由调用者根据题目版本、测试点和比较程序决定（见 programming.cpp），题目更新时随题目缓存文件夹一起被清空。
+ */
+
+/**
+ * @brief 计算选手输出文件夹的摘要
+ * 比较程序可以读取选手程序写入的所有文件（如 gtest 的报告），因此对文件夹中所有文件的相对路径、大小和内容计算 SHA-1。
+ * @param dir 选手程序的输出文件夹，即运行文件夹中的 run
+ * @return 摘要的十六进制表示；文件夹不存在、存在无法读取的文件或者存在非普通文件（如命名管道、符号链接）时返回空，此时不使用缓存
+ */
+std::string output_digest(const std::filesystem::path &dir);
+
+/**
+ * @brief 读取缓存的比较结果
+ * @param entry 缓存项文件夹
+ * @param rundir 运行文件夹，缓存的 feedback 文件夹、compare.out 和 compare.err 会被拷贝到这里
+ * @return 比较程序的返回值，缓存项不存在或者无法读取时返回空
+ */
+std::optional<int> load_verdict(const std::filesystem::path &entry, const std::filesystem::path &rundir);
+
+/**
+ * @brief 保存比较结果，缓存项已经存在时不做任何修改
+ * 先写入临时文件夹再重命名，其他评测核心不会读到不完整的缓存项。保存失败不影响评测，只记录日志。
+ * @param entry 缓存项文件夹
+ * @param exitcode 比较程序的返回值
+ * @param rundir 运行文件夹，保存其中的 feedback 文件夹、compare.out 和 compare.err
+ */
+void store_verdict(const std::filesystem::path &entry, int exitcode, const std::filesystem::path &rundir);
+
+}  // namespace judge
@@ -343,6 +343,13 @@ struct source_code : submission_program {
      */
     std::string entry_point;
 
+    /**
+     * @brief 是否额外编译一份开启 AddressSanitizer 的程序
+     * 编译脚本通过环境变量 SANITIZE 得知，生成的程序与 run 放在一起，名为 run.asan，供 asan 运行脚本使用。
+     * 目前只有 c 和 cpp 的编译脚本支持
+     */
+    bool sanitized_variant = false;
+
     void fetch(const std::string &cpuset, const std::filesystem::path &dir, const std::filesystem::path &chrootdir, const executable_manager &exec_mgr, program_limit limit = program_limit()) override;
     std::string get_compilation_log(const std::filesystem::path &workdir) override;
     std::unique_ptr<executable> get_compile_script(const executable_manager &exec_mgr) override;
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
 #include "common/status.hpp"
 
 namespace judge {
@@ -30,6 +33,12 @@ struct runguard_result {
      */
     double cpu_time = -1;
 
+    /**
+     * @brief 用户态退休的指令数
+     * 仅在 runguard 指定了 --count-instructions 或 --instruction-limit 时有效，否则为 -1
+     */
+    int64_t instructions = -1;
+
     int exitcode = -1;
 
     int signal = -1;
@@ -39,11 +48,61 @@ struct runguard_result {
     /**
      * @brief 实际内存使用（单位为字节）
      */
-    int memory = -1;
+    int64_t memory = -1;
 
     std::string time_result;
+
+    /**
+     * @brief 程序因超出哪项限制而被 runguard 立即结束
+     * 可能为空、wall-time、cpu-time、memory、output、instructions，空表示没有被 runguard 结束
+     */
+    std::string limit_reason;
+
+    /**
+     * @brief 程序读写块设备的字节数
+     * 仅能从 runguard 的二进制结果中读取，否则为 -1
+     */
+    int64_t read_bytes = -1;
+    int64_t write_bytes = -1;
+};
+
+/**
+ * @brief 程序运行过程中某一时刻的资源使用情况，由 runguard 的 --sample-interval 定时采样
+ * 除 memory_bytes 外都是自开始运行以来的累计值
+ */
+struct runguard_sample {
+    int64_t time_usec = 0;     // 距离开始运行的时间，单位为微秒
+    int64_t memory_bytes = 0;  // 当前内存使用量，单位为字节
+    int64_t cpu_usec = 0;
+    int64_t user_usec = 0;
+    int64_t system_usec = 0;
+    int64_t pgfault = 0;
+    int64_t pgmajfault = 0;
+    int64_t voluntary_ctxt_switches = 0;
+    int64_t nonvoluntary_ctxt_switches = 0;
+    int64_t read_bytes = -1;  // 没有启用 io 控制器时为 -1
+    int64_t write_bytes = -1;
 };
 
-runguard_result read_runguard_result(const std::filesystem::path &metafile);
+/**
+ * @brief 读取 runguard 通过 --out-meta 输出的 meta 文件的所有字段
+ * @param metafile meta 文件，不存在时返回空
+ */
+std::map<std::string, std::string> read_runguard_meta(const std::filesystem::path &metafile);
+
+/**
+ * @brief 读取 runguard 的运行结果
+ * 优先读取 --out-record 输出的二进制结果，结果文件不存在或不完整时（比如 runguard 发生内部错误）
+ * 回退到解析 --out-meta 输出的 meta 文件
+ * @param metafile runguard 输出的 meta 文件
+ * @param recordfile runguard 输出的二进制结果文件，为空表示只读取 meta 文件
+ */
+runguard_result read_runguard_result(const std::filesystem::path &metafile, const std::filesystem::path &recordfile = {});
+
+/**
+ * @brief 读取 runguard 通过 --out-samples 输出的采样结果
+ * @param samplesfile 采样结果文件，不存在时返回空列表
+ */
+std::vector<runguard_sample> read_runguard_samples(const std::filesystem::path &samplesfile);
 
 }  // namespace judge
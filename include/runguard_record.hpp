@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief runguard 写给评测系统的定长二进制运行结果
+ *
+ * runguard 与评测系统运行在同一台机器上，因此直接使用本机字节序。
+ * runguard 启动时截断结果文件，运行结束后通过一次 write 写入整个结构体，
+ * 因此评测系统读到的要么是完整的结果，要么是空文件（runguard 异常退出），
+ * 后者需要回退到解析 meta 文件。meta 文件仍然保留，供人工排查问题使用。
+ *
+ * 修改结构体布局时必须增加 RUNGUARD_RECORD_VERSION。
+ */
+struct runguard_record {
+    uint32_t magic;
+    uint32_t version;
+
+    int32_t exitcode;
+    int32_t signal;  // 没有收到信号时为 -1
+    uint32_t flags;  // RUNGUARD_RECORD_* 的组合
+    uint32_t limit_reason;  // runguard_limit_reason
+
+    int64_t wall_time_usec;
+    int64_t cpu_time_usec;
+    int64_t user_time_usec;
+    int64_t sys_time_usec;
+    int64_t memory_bytes;
+    int64_t instructions;  // 没有统计指令数时为 -1
+    int64_t read_bytes;
+    int64_t write_bytes;
+};
+
+static_assert(sizeof(runguard_record) == 88, "runguard_record layout changed");
+
+constexpr uint32_t RUNGUARD_RECORD_MAGIC = 0x44524752;  // "RGRD"
+constexpr uint32_t RUNGUARD_RECORD_VERSION = 1;
+
+constexpr uint32_t RUNGUARD_RECORD_TIME_SOFT = 1 << 0;  // 超出软时间限制
+constexpr uint32_t RUNGUARD_RECORD_TIME_HARD = 1 << 1;  // 超出硬时间限制
+constexpr uint32_t RUNGUARD_RECORD_OOM = 1 << 2;        // 内存超限
+
+/**
+ * @brief 程序因超出哪项限制而被 runguard 立即结束，与 meta 文件的 limit-reason 字段对应
+ */
+enum runguard_limit_reason : uint32_t {
+    RUNGUARD_LIMIT_NONE = 0,
+    RUNGUARD_LIMIT_WALL_TIME,
+    RUNGUARD_LIMIT_CPU_TIME,
+    RUNGUARD_LIMIT_MEMORY,
+    RUNGUARD_LIMIT_OUTPUT,
+    RUNGUARD_LIMIT_INSTRUCTIONS,
+};
@@ -132,6 +132,12 @@ struct system_config {
      * 如果时限内没有连接上文件系统，则取消请求
      */
     double file_connect_timeout;
+
+    /**
+     * @brief 内存检查工具，可选 valgrind 和 asan，题目配置中的 "memory check tool" 优先
+     * asan 只对 C/C++ 提交生效，其他语言仍然使用 valgrind
+     */
+    std::string memory_check_tool = "valgrind";
 };
 
 void from_json(const nlohmann::json &j, system_config &config);
@@ -55,10 +55,34 @@ export ELASTIC_APM_TRANSPORT_CLASS="elasticapm.transport.http.Transport"
 export CACHEDIR="$WORKDIR/cache"
 export RUNDIR="$WORKDIR/run"
 export CHROOTDIR="/chroot"
+# 使用 exec/chroot_image.sh build 打包的只读 chroot 镜像代替 CHROOTDIR，多个镜像以空格分隔，基础层在前，语言层在后
+if [ -n "$CHROOTIMAGE" ]; then
+    CHROOTDIR=$(bash "$DIR/exec/chroot_image.sh" mount "$WORKDIR/chroot" $CHROOTIMAGE)
+fi
 export CACHERANDOMDATA=2
 export RUNUSER=judge
 export RUNGROUP=judge
 export RUNNETNS=judge
+export RUNNSPOOL=/run/judge-nspool
+export SECCOMPCACHE="$CACHEDIR/seccomp"
+# 非空时评测系统以普通用户运行，runguard 通过用户命名空间隔离选手程序，需要 cgroup v2
+export ROOTLESS=""
+# 为每个测试点的运行文件夹挂载 tmpfs，选手程序的输出不落盘，取消注释以开启
+# export TMPFSRUNDIR=1
+# 内置比较器边接收选手输出边比较，发现错误时立即结束选手程序，选手输出不落盘，取消注释以开启
+# export STREAMCOMPARE=1
+# 使用 standard-trusted 检查脚本的测试点每次最多合并多少个一起运行，只启动一次检查脚本和 runguard，取消注释以开启
+# export BATCHSIZE=8
+# 使用评测系统内置的检查流程代替 standard 和 standard-trusted 检查脚本，取消注释以开启
+# export NATIVECHECK=1
+# 内置检查流程复用相同选手输出的比较结果，比较脚本的结果只取决于输入数据、标准输出和选手输出时才可以开启，取消注释以开启
+# export VERDICTCACHE=1
+# 限制选手程序在运行文件夹所在磁盘上的 I/O，格式同 cgroup v2 的 io.max，如 "wbps=52428800 wiops=1000"，为空表示不限制
+export IOMAX=""
+# 选手程序的磁盘 I/O 权重（1-10000），为空表示使用默认值 100，需要 I/O 调度器支持
+export IOWEIGHT=""
+# 采样选手程序资源使用情况的间隔（毫秒），为空表示不采样
+export SAMPLE_INTERVAL=""
 export SCRIPTTIMELIMIT=30
 echo "Running on $CORES"
 echo "Command = $DIR/bin/judge-system $ENABLE_OPT $MOJ_OPT $MCOURSE_OPT $FORTH_OPT $SICILY_OPT $@"
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "runguard_options.hpp"
+
+/**
+ * @brief cgroup v2 统一层级下 cgroup 的统计数据
+ * 所有数据都是相对于 reset_counters 调用时的增量
+ */
+struct cgroup2_usage {
+    int64_t memory_peak = 0;     // 内存使用峰值，单位为字节，内核不支持 memory.peak 时为 -1
+    int64_t cpu_usage_usec = 0;  // CPU 时间，单位为微秒
+    int64_t user_usec = 0;       // 用户态 CPU 时间，单位为微秒
+    int64_t system_usec = 0;     // 内核态 CPU 时间，单位为微秒
+    int64_t oom_kill = 0;        // 因内存超限被杀死的进程数
+    int64_t io_read_bytes = -1;  // 块设备读取字节数，没有启用 io 控制器时为 -1
+    int64_t io_write_bytes = -1;  // 块设备写入字节数，没有启用 io 控制器时为 -1
+};
+
+/**
+ * @brief cgroup v2（unified hierarchy）后端
+ *
+ * 与 libcgroup 实现的 v1 后端每次运行都创建、删除一个 cgroup 不同，v2 后端复用
+ * create_cgroups.sh 为每个 worker 预先创建的叶子 cgroup（/sys/fs/cgroup/judger/worker_<cpuset>）。
+ * 每次运行前回收之前的运行留下的页缓存，重置 memory.peak 并记录 cpu.stat、memory.events 的基准值，
+ * 子进程通过 clone3(CLONE_INTO_CGROUP) 直接创建在该 cgroup 内，
+ * 这样资源统计从子进程的第一条指令开始。
+ *
+ * 同一个叶子 cgroup 同时只能被一个 runguard 使用，构造时会通过 flock 对 cgroup 目录加锁。
+ */
+struct cgroup2_guard {
+    /**
+     * @brief 打开（必要时创建）cgroup
+     * @param cgroup_name cgroup 相对于 /sys/fs/cgroup 的路径，如 /judger/worker_0
+     * @param temporary 为真时表示该 cgroup 仅供本次运行使用，release 时会被删除
+     */
+    cgroup2_guard(const std::string &cgroup_name, bool temporary);
+
+    /**
+     * @brief 析构函数，关闭打开的文件描述符并释放 cgroup 锁
+     */
+    ~cgroup2_guard();
+
+    cgroup2_guard(const cgroup2_guard &) = delete;
+    cgroup2_guard &operator=(const cgroup2_guard &) = delete;
+
+    /**
+     * @brief 检查系统是否挂载了 cgroup v2 统一层级
+     */
+    static bool available();
+
+    /**
+     * @brief 将当前进程移入 cgroup
+     * 仅在内核不支持 clone3(CLONE_INTO_CGROUP) 时使用
+     */
+    static void attach(const std::string &cgroup_name);
+
+    /**
+     * @brief 写入内存、CPU 核心、磁盘 I/O 的限制
+     * 必须在 reset_counters 之后调用
+     */
+    void set_limits(const runguard_options &opt);
+
+    /**
+     * @brief 重置统计数据，之后调用 usage 得到的数据都是相对于此时的增量
+     */
+    void reset_counters();
+
+    /**
+     * @brief 读取自 reset_counters 以来的统计数据
+     */
+    cgroup2_usage usage();
+
+    /**
+     * @brief 杀死 cgroup 内的所有进程，并等待 cgroup 变为空
+     */
+    void kill();
+
+    /**
+     * @brief 释放 cgroup，临时 cgroup 将被删除
+     */
+    void release();
+
+    /**
+     * @brief cgroup 目录的文件描述符，用于 clone3(CLONE_INTO_CGROUP)
+     */
+    int fd() const;
+
+    /**
+     * @brief 创建监听接口文件（如 memory.events）变化的 inotify 文件描述符
+     */
+    int watch(const std::string &file);
+
+    void write(const std::string &file, const std::string &value);
+
+    std::string read(const std::string &file);
+
+    /**
+     * @brief 读取 cpu.stat、memory.events 这类 "key value" 格式的文件
+     */
+    std::map<std::string, int64_t> read_keyed(const std::string &file);
+
+private:
+    void open_cgroup();
+
+    /**
+     * @brief 通过 memory.reclaim 回收 cgroup 中之前的运行留下的页缓存
+     * @return 回收后是否只残留少量内存；内核不支持 memory.reclaim，或者存在无法回收的页面（如禁用交换空间时的 tmpfs 页面）时返回 false
+     */
+    bool reclaim();
+
+    /**
+     * @brief 设置当前工作目录所在块设备的 io.max，并设置 io.weight
+     * 未指定限制时恢复为不限制，避免复用的 cgroup 沿用上一次运行的设置
+     */
+    void set_io_limits(const runguard_options &opt);
+
+    /**
+     * @brief 累加 io.stat 中所有设备的 rbytes、wbytes
+     */
+    void read_io_stat(int64_t &rbytes, int64_t &wbytes);
+
+    std::string path;
+    bool temporary;
+    int dirfd = -1;
+    int peakfd = -1;  // memory.peak 的重置只对重置时使用的文件描述符有效，因此要一直保持打开
+    cgroup2_usage base;
+};
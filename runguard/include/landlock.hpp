@@ -0,0 +1,17 @@
+#pragma once
+
+#include "runguard_options.hpp"
+
+/**
+ * @brief 通过 Landlock 限制当前进程及其子进程可以访问的文件
+ *
+ * --landlock-ro 指定的路径只允许读取和执行，--landlock-rw 指定的路径允许任意读写，其余路径均不可访问。
+ * 限制在当前的挂载点命名空间内生效，不需要挂载 overlayfs、bind mount 和 chroot，
+ * 适用于信任的语言的快速评测。限制在 exec 之后仍然有效，并且无法被解除。
+ *
+ * 相对路径相对于调用时的工作目录解析，不存在的路径会被忽略。
+ * 内核不支持 Landlock（Linux 5.13 以下或未启用）时抛出异常，不会在没有限制的情况下运行程序。
+ *
+ * @note 必须在 chroot、chdir 之后、setuid 之前调用
+ */
+void landlock_restrict(const struct runguard_options &opt);
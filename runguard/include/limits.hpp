@@ -30,7 +30,19 @@ void cgroup_delete(const struct runguard_options &);
  */
 void set_restrictions(const struct runguard_options &opt);
 
+/**
+ * Build the seccomp filter from the allowed syscall list.
+ *
+ * Called before fork. With a cache directory, the compiled
+ * BPF program is stored under a hash of the syscall list, so
+ * following runs of the same language only read the file.
+ */
+void prepare_seccomp(const struct runguard_options &opt);
+
 /**
  * Limit syscalls
+ *
+ * Loads the filter built by prepare_seccomp with a single seccomp() call.
+ * Returns the user notification listener in audit mode, otherwise -1.
  */
-void set_seccomp(const struct runguard_options &opt);
+int set_seccomp(const struct runguard_options &opt);
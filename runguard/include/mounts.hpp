@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief runguard 在新的 mount 命名空间内执行的挂载操作
+ *
+ * 通过 --mount 指定，格式与 docker 的 --mount 类似，为逗号分隔的 key=value 列表：
+ * type=overlay,lower=<dir>[:<dir>...],upper=<dir>,work=<dir>,target=<dir>
+ *     挂载 overlayfs，lower 中靠前的文件夹位于上层，与 overlayfs 的 lowerdir 相同
+ * type=bind,source=<dir>,target=<dir>[,ro]
+ *     bind mount，指定 ro 时挂载为只读
+ * type=dev,target=<dir>
+ *     在 target 下创建 null、zero 等字符设备，与 chroot_setup.sh 中的 chroot_start 相同
+ *
+ * target 不存在时会被创建。
+ */
+struct mount_spec {
+    std::string type;
+    std::string source;
+    std::string target;
+    std::vector<std::string> lower;
+    std::string upper;
+    std::string work;
+    bool readonly = false;
+};
+
+/**
+ * @brief 解析 --mount 的参数
+ * @throw std::invalid_argument 格式错误
+ */
+mount_spec parse_mount_spec(const std::string &spec);
+
+/**
+ * @brief 按顺序执行挂载操作，替代通过 --preexecute 调用 shell 脚本执行 mount 命令
+ * @note 必须在 unshare(CLONE_NEWNS) 之后调用，退出 mount 命名空间后这些挂载点会被自动卸载
+ */
+void apply_mounts(const std::vector<mount_spec> &mounts);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "runguard_options.hpp"
+
+/**
+ * @brief 进入命名空间池中预先创建好的 IPC、UTS、网络命名空间
+ *
+ * 命名空间池由 exec/create_ns_pool.sh 在开机时为每个 worker 创建，
+ * 池中的每个命名空间通过 bind mount 持久化为 <ns_pool>/{ipc,uts,net}。
+ * 与每次运行都调用 unshare 创建新命名空间相比，setns 进入已有的命名空间几乎没有开销，
+ * 尤其省去了内核创建、销毁网络命名空间的代价。
+ * 若指定了 --netns，则网络命名空间以 --netns 为准。
+ *
+ * @note 必须在 fork 之前调用，这样 runguard 和受控程序都位于池中的命名空间内
+ */
+void nspool_enter(const struct runguard_options &opt);
+
+/**
+ * @brief 清理受控程序在池中命名空间内留下的状态，以便下一次运行复用
+ *
+ * 删除所有 System V IPC 对象（共享内存、消息队列、信号量）和 POSIX 消息队列，
+ * 并恢复 hostname 和 domainname，避免不同的提交通过残留状态通信。
+ * 网络命名空间中只有未启用的 loopback 设备，套接字随进程结束而关闭，无需清理。
+ *
+ * @note 必须在 cgroup 内所有进程都被杀死之后调用
+ */
+void nspool_reset(const struct runguard_options &opt);
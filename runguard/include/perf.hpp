@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+/**
+ * @brief 为进程创建用户态指令计数器
+ *
+ * 计数器通过 perf_event_open 创建，只统计用户态退休的指令数（不含内核态），
+ * 并在进程执行 exec 时才开始计数，子进程、线程的指令数会被累加（inherit）。
+ * 与 CPU 时间不同，指令数不受主机负载、CPU 频率的影响，同一程序同一输入的结果是可复现的。
+ *
+ * @param pid 要统计的进程，必须尚未调用 exec
+ * @param limit 指令数限制，大于 0 时，进程的指令数达到该值后当前进程会收到 SIGIO
+ * @return 计数器的文件描述符
+ */
+int instruction_counter_open(pid_t pid, int64_t limit);
+
+/**
+ * @brief 读取计数器的值，已退出的子进程的指令数也被计算在内
+ */
+int64_t instruction_counter_read(int fd);
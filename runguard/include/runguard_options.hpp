@@ -4,6 +4,8 @@
 #include <limits>
 #include <string>
 #include <vector>
+
+#include "mounts.hpp"
 using std::cout;
 using std::endl;
 
@@ -13,39 +15,58 @@ struct time_limit {
 
 struct runguard_options {
     std::string cgroupname;
+    bool cgroup_v2 = false;  // use cgroup v2 unified hierarchy instead of libcgroup (v1)
+    std::string cgroup_leaf;  // reuse pre-created cgroup /judger/<cgroup_leaf> (cgroup v2 only)
     std::string chroot_dir;
     std::string work_dir;
     size_t nproc = std::numeric_limits<size_t>::max();
     std::string preexecute;
+    std::vector<mount_spec> mounts;  // applied in the new mount namespace before preexecute
     std::string user;
     std::string group;
     int user_id = -1;
     int group_id = -1;
     std::string netns;   // network namespace name created by "ip netns add"
+    std::string ns_pool;  // directory holding pre-created ipc/uts/net namespaces of this worker
+    bool userns = false;  // run without root in a new user namespace (cgroup v2 delegation required)
+    std::vector<std::string> landlock_ro;  // paths the command may only read and execute, enables Landlock
+    std::vector<std::string> landlock_rw;  // paths the command may read and write, enables Landlock
     std::string cpuset;  // processor id to run client program.
 
     bool use_wall_limit = false;
     struct time_limit wall_limit;  // wall clock time
     bool use_cpu_limit = false;
     struct time_limit cpu_limit;  // CPU time
+    bool count_instructions = false;
+    int64_t instruction_limit = -1;  // retired user-space instructions, -1 for unlimited
 
     int64_t memory_limit = -1;  // Memory limit in bytes
     int file_limit = -1;        // Output limit
+    int io_weight = -1;         // io.weight of the sandbox cgroup (1-10000), -1 for default
+    std::string io_max;         // io.max limits (e.g. "wbps=52428800") on the block device of the working directory
     bool no_core_dumps = false;
 
     /**
      * Allowed syscall numbers
      */
     std::vector<int> syscalls;
+    std::string seccomp_cache;     // directory to cache compiled seccomp BPF programs
+    bool seccomp_audit = false;    // record disallowed syscalls instead of killing the command
+    int seccomp_notify_sock = -1;  // socket to pass the seccomp listener from child to watchdog
 
     std::string stdin_filename;
     std::string stdout_filename;
     std::string stderr_filename;
+    int stdin_fd = -1;   // inherited fd used as standard input of the command, -1 for none
+    int stdout_fd = -1;  // inherited fd used as standard output of the command, -1 for none
 
     bool preserve_sys_env = false;
     std::vector<std::string> env;
 
     std::string metafile_path;
+    std::string record_path;  // fixed-layout binary result (runguard_record) for the judge
+    int sample_interval = -1;  // resource sampling interval in milliseconds, -1 for no sampling
+    std::string samples_path;  // resource samples output (cgroup v2 only)
     std::vector<std::string> command;
 
     friend std::ostream& operator<<(std::ostream& out, runguard_options& opt);  // for debug
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cgroup2.hpp"
+
+/**
+ * @brief 程序运行过程中某一时刻的资源使用情况
+ * 除 memory_bytes 外都是自开始运行以来的累计值
+ */
+struct resource_sample {
+    int64_t time_usec = 0;     // 距离开始运行的时间，单位为微秒
+    int64_t memory_bytes = 0;  // 当前内存使用量（memory.current）
+    int64_t cpu_usec = 0;
+    int64_t user_usec = 0;
+    int64_t system_usec = 0;
+    int64_t pgfault = 0;
+    int64_t pgmajfault = 0;
+    int64_t voluntary_ctxt_switches = 0;     // 仅统计采样时仍存活的线程
+    int64_t nonvoluntary_ctxt_switches = 0;  // 仅统计采样时仍存活的线程
+    int64_t read_bytes = -1;                 // 没有启用 io 控制器时为 -1
+    int64_t write_bytes = -1;
+};
+
+/**
+ * @brief 在程序运行过程中定时采样 cgroup 的资源使用情况
+ *
+ * 内存、CPU 时间、缺页次数和 I/O 字节数取自 cgroup v2 的接口文件，
+ * 上下文切换次数取自 cgroup.threads 中各线程的 /proc/<tid>/status。
+ * 采样点数超过 MAX_SAMPLES 时每两个采样点丢弃一个，调用者应将采样间隔加倍，
+ * 这样无论程序运行多久采样结果的大小都是有限的。
+ */
+struct resource_sampler {
+    static constexpr size_t MAX_SAMPLES = 4096;
+
+    /**
+     * @param cgroup 受控程序所在的 cgroup，必须已经调用过 reset_counters
+     */
+    explicit resource_sampler(cgroup2_guard &cgroup);
+
+    /**
+     * @brief 采样一次
+     * @param time_usec 距离开始运行的时间，单位为微秒
+     * @return 采样点数达到上限、已经丢弃一半采样点时返回 true
+     */
+    bool sample(int64_t time_usec);
+
+    /**
+     * @brief 将采样结果写入文件描述符
+     * 第一行是以 # 开头的字段名，之后每行一个采样点，字段以空格分隔
+     */
+    void write(int fd) const;
+
+private:
+    cgroup2_guard &cgroup;
+    int64_t base_pgfault = 0, base_pgmajfault = 0;
+    std::vector<resource_sample> samples;
+};
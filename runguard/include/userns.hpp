@@ -0,0 +1,19 @@
+#pragma once
+
+#include "runguard_options.hpp"
+
+/**
+ * @brief 进入新的用户命名空间，使 runguard 无需 root 权限即可创建其他命名空间、挂载文件系统和 chroot
+ *
+ * 非特权进程只能将自己的 uid、gid 映射进新的用户命名空间，因此命名空间内只存在一个 uid：
+ * 运行用户（--user）的 uid 被映射为调用 runguard 的用户，gid 同理。这样：
+ * 1. 受控程序在命名空间内以非 root 用户运行，exec 时会丢弃所有 capability；
+ * 2. 受控程序创建的文件在主机上直接属于评测系统的用户，不再需要 chown -R。
+ *
+ * 命名空间内禁止调用 setgroups，受控程序会保留评测系统用户的附加组，
+ * 因此评测系统用户不应属于任何有特殊权限的组。
+ *
+ * @note 必须在创建其他命名空间之前、在 cgroup 准备完成之后调用，
+ *       用户命名空间内无法进入主机上由 root 创建的网络命名空间和命名空间池
+ */
+void userns_enter(const struct runguard_options &opt);
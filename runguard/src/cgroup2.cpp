@@ -0,0 +1,345 @@
+#include "cgroup2.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+using namespace std;
+
+static const string CGROUP2_ROOT = "/sys/fs/cgroup";
+
+cgroup2_guard::cgroup2_guard(const string &cgroup_name, bool temporary)
+    : path(CGROUP2_ROOT + cgroup_name), temporary(temporary) {
+    open_cgroup();
+}
+
+cgroup2_guard::~cgroup2_guard() {
+    if (peakfd >= 0) close(peakfd);
+    if (dirfd >= 0) close(dirfd);  // 关闭文件描述符的同时会释放 flock
+}
+
+bool cgroup2_guard::available() {
+    return access((CGROUP2_ROOT + "/cgroup.controllers").c_str(), F_OK) == 0;
+}
+
+void cgroup2_guard::attach(const string &cgroup_name) {
+    int fd = open((CGROUP2_ROOT + cgroup_name + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening cgroup.procs of {}", cgroup_name));
+    // 写入 0 表示将当前进程移入 cgroup
+    if (::write(fd, "0", 1) < 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, generic_category(), fmt::format("attaching to cgroup {}", cgroup_name));
+    }
+    close(fd);
+}
+
+void cgroup2_guard::open_cgroup() {
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        throw system_error(errno, generic_category(), fmt::format("creating cgroup {}", path));
+
+    dirfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening cgroup {}", path));
+
+    // 评测同一个 worker 上的任务是串行的，这里加锁只是为了防止意外的并发使用
+    if (flock(dirfd, LOCK_EX) != 0)
+        throw system_error(errno, generic_category(), fmt::format("locking cgroup {}", path));
+}
+
+int cgroup2_guard::fd() const {
+    return dirfd;
+}
+
+int cgroup2_guard::watch(const string &file) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), "inotify_init1");
+    if (inotify_add_watch(fd, (path + "/" + file).c_str(), IN_MODIFY) < 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, generic_category(), fmt::format("watching {}/{}", path, file));
+    }
+    return fd;
+}
+
+void cgroup2_guard::write(const string &file, const string &value) {
+    int fd = openat(dirfd, file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening {}/{}", path, file));
+    if (::write(fd, value.data(), value.size()) < 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, generic_category(), fmt::format("writing '{}' to {}/{}", value, path, file));
+    }
+    close(fd);
+}
+
+string cgroup2_guard::read(const string &file) {
+    int fd = openat(dirfd, file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening {}/{}", path, file));
+    string content;
+    char buf[4096];
+    ssize_t len;
+    while ((len = ::read(fd, buf, sizeof(buf))) > 0)
+        content.append(buf, len);
+    int err = errno;
+    close(fd);
+    if (len < 0)
+        throw system_error(err, generic_category(), fmt::format("reading {}/{}", path, file));
+    return content;
+}
+
+map<string, int64_t> cgroup2_guard::read_keyed(const string &file) {
+    map<string, int64_t> result;
+    istringstream in(read(file));
+    string key;
+    int64_t value;
+    while (in >> key >> value)
+        result[key] = value;
+    return result;
+}
+
+void cgroup2_guard::set_limits(const runguard_options &opt) {
+    if (opt.memory_limit >= 0) {
+        // reset_counters 已经清空了之前的运行留下的页缓存、tmpfs 页面，限制不需要为它们留出余量
+        write("memory.max", to_string(opt.memory_limit));
+    } else {
+        write("memory.max", "max");
+    }
+
+    // 对应 v1 中将 memory.memsw.limit_in_bytes 设为与 memory.limit_in_bytes 相同，禁止使用交换空间。
+    // 内核未开启 swap 统计时没有这个文件，此时本来就不会发生交换
+    try {
+        write("memory.swap.max", "0");
+    } catch (system_error &e) {
+        if (e.code().value() != ENOENT) throw;
+    }
+
+    // 内存超限时杀死整个 cgroup，而不是只杀死其中一个进程
+    write("memory.oom.group", "1");
+
+    if (!opt.cpuset.empty()) {
+        // TODO: cpuset.mems 需要被设置为对应的 NUMA 以避免跨 NUMA 导致内存访问慢
+        write("cpuset.mems", "0");
+        write("cpuset.cpus", opt.cpuset);
+    } else {
+        BOOST_LOG_TRIVIAL(info) << "cpuset undefined";
+    }
+
+    set_io_limits(opt);
+}
+
+/**
+ * @brief 查找文件所在的块设备，分区会被转换为所在的磁盘
+ * @return "major:minor"，文件不在块设备上（如 tmpfs、overlayfs）时返回空字符串
+ */
+static string block_device_of(const string &file) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0 || major(st.st_dev) == 0) return "";
+
+    string device = fmt::format("{}:{}", major(st.st_dev), minor(st.st_dev));
+    // io.max 只接受整个磁盘，不接受分区
+    string sysfs = "/sys/dev/block/" + device;
+    if (access((sysfs + "/partition").c_str(), F_OK) == 0) {
+        ifstream fin(sysfs + "/../dev");
+        if (!(fin >> device)) return "";
+    }
+    return device;
+}
+
+void cgroup2_guard::set_io_limits(const runguard_options &opt) {
+    // 父 cgroup 没有开启 io 控制器
+    if (faccessat(dirfd, "io.max", F_OK, 0) != 0) {
+        if (opt.io_weight > 0 || !opt.io_max.empty())
+            BOOST_LOG_TRIVIAL(warning) << "io controller is not enabled in " << path << ", ignoring io limits";
+        return;
+    }
+
+    // 选手程序的输出写在 runguard 的工作目录（运行目录）下
+    string device = block_device_of(".");
+    if (!device.empty()) {
+        write("io.max", fmt::format("{} {}", device, opt.io_max.empty() ? "rbps=max wbps=max riops=max wiops=max" : opt.io_max));
+    } else if (!opt.io_max.empty()) {
+        BOOST_LOG_TRIVIAL(info) << "working directory is not on a block device, ignoring io.max";
+    }
+
+    // io.weight 需要 I/O 调度器支持（如 BFQ 或 iocost），否则没有这个文件
+    try {
+        write("io.weight", fmt::format("default {}", opt.io_weight > 0 ? opt.io_weight : 100));
+    } catch (system_error &e) {
+        if (e.code().value() != ENOENT) throw;
+        if (opt.io_weight > 0)
+            BOOST_LOG_TRIVIAL(warning) << "io.weight is not supported by the I/O scheduler, ignoring --io-weight";
+    }
+}
+
+/**
+ * @brief 打开 memory.peak，优先以读写方式打开以便重置
+ * @param writable 返回是否以读写方式打开
+ * @return 文件描述符，内核不支持 memory.peak（Linux 5.19 之前）时返回 -1
+ */
+static int open_memory_peak(int dirfd, const string &path, bool &writable) {
+    // Linux 6.12 之前 memory.peak 是只读的，非 root 用户以读写方式打开时得到 EACCES
+    writable = true;
+    int fd = openat(dirfd, "memory.peak", O_RDWR | O_CLOEXEC);
+    if (fd < 0 && errno != ENOENT) {
+        writable = false;
+        fd = openat(dirfd, "memory.peak", O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0 && errno != ENOENT)
+        throw system_error(errno, generic_category(), fmt::format("opening {}/memory.peak", path));
+    return fd;
+}
+
+bool cgroup2_guard::reclaim() {
+    // 回收后仍然残留的少量内核对象（如 dentry、inode）可以忽略
+    const int64_t MAX_RESIDUAL_BYTES = 1 << 20;
+    int64_t current = strtoll(read("memory.current").c_str(), nullptr, 10);
+    if (current <= MAX_RESIDUAL_BYTES) return true;
+    try {
+        write("memory.reclaim", to_string(current));
+    } catch (system_error &e) {
+        // 没有全部回收时返回 EAGAIN，以实际剩余的内存为准；Linux 5.19 之前没有 memory.reclaim
+        if (e.code().value() != EAGAIN) return false;
+    }
+    return strtoll(read("memory.current").c_str(), nullptr, 10) <= MAX_RESIDUAL_BYTES;
+}
+
+void cgroup2_guard::reset_counters() {
+    // 复用的 cgroup 中残留着之前的运行留下的页缓存和 tmpfs 页面（比如上一个提交读取的大输入文件），
+    // 它们会占用本次运行的内存限制，并且在运行中被回收时使峰值偏小，因此需要先清空
+    bool recreate = !temporary && !reclaim();
+    if (recreate)
+        BOOST_LOG_TRIVIAL(info) << "memory of cgroup " << path << " cannot be reclaimed, recreating cgroup";
+
+    if (peakfd >= 0) close(peakfd);
+    bool writable;
+    peakfd = open_memory_peak(dirfd, path, writable);
+    if (peakfd < 0)
+        BOOST_LOG_TRIVIAL(warning) << "memory.peak is not supported by the kernel, falling back to maxrss";
+
+    // 自 Linux 6.12 起，向 memory.peak 写入任意内容将重置通过该文件描述符读取到的峰值，因此读写必须使用同一个文件描述符。
+    // 更旧的内核不支持重置（只读打开，或者 root 打开后写入失败），复用的 cgroup 只能通过重新创建来清空峰值
+    if (!temporary && !recreate && peakfd >= 0 && !(writable && ::write(peakfd, "reset\n", 6) >= 0)) {
+        BOOST_LOG_TRIVIAL(info) << "memory.peak cannot be reset, recreating cgroup " << path;
+        recreate = true;
+    }
+
+    // 删除 cgroup 后残留的页面不再计入重新创建的 cgroup，新的 cgroup 从零开始统计
+    if (recreate) {
+        if (peakfd >= 0) close(peakfd);
+        close(dirfd);
+        peakfd = dirfd = -1;
+        if (rmdir(path.c_str()) != 0)
+            throw system_error(errno, generic_category(), fmt::format("removing cgroup {}", path));
+        open_cgroup();
+        peakfd = open_memory_peak(dirfd, path, writable);
+    }
+
+    // memory.peak 重置后等于当前的内存使用量，其中包括清空后残留的少量内存，统计时扣除
+    base.memory_peak = strtoll(read("memory.current").c_str(), nullptr, 10);
+
+    // cpu.stat 和 memory.events 无法重置，记录基准值，统计时取差值
+    auto cpu_stat = read_keyed("cpu.stat");
+    base.cpu_usage_usec = cpu_stat["usage_usec"];
+    base.user_usec = cpu_stat["user_usec"];
+    base.system_usec = cpu_stat["system_usec"];
+    base.oom_kill = read_keyed("memory.events")["oom_kill"];
+    read_io_stat(base.io_read_bytes, base.io_write_bytes);
+}
+
+void cgroup2_guard::read_io_stat(int64_t &rbytes, int64_t &wbytes) {
+    string content;
+    try {
+        content = read("io.stat");
+    } catch (system_error &e) {
+        if (e.code().value() != ENOENT) throw;
+        rbytes = wbytes = -1;  // 父 cgroup 没有开启 io 控制器
+        return;
+    }
+
+    // 每行的格式为 "8:0 rbytes=1459200 wbytes=314773504 rios=192 wios=353 dbytes=0 dios=0"
+    rbytes = wbytes = 0;
+    istringstream in(content);
+    for (string token; in >> token;) {
+        if (token.compare(0, 7, "rbytes=") == 0)
+            rbytes += strtoll(token.c_str() + 7, nullptr, 10);
+        else if (token.compare(0, 7, "wbytes=") == 0)
+            wbytes += strtoll(token.c_str() + 7, nullptr, 10);
+    }
+}
+
+cgroup2_usage cgroup2_guard::usage() {
+    cgroup2_usage result;
+
+    if (peakfd >= 0) {
+        char buf[32] = {0};
+        if (pread(peakfd, buf, sizeof(buf) - 1, 0) < 0)
+            throw system_error(errno, generic_category(), fmt::format("reading {}/memory.peak", path));
+        result.memory_peak = max<int64_t>(strtoll(buf, nullptr, 10) - base.memory_peak, 0);
+    } else {
+        result.memory_peak = -1;
+    }
+
+    auto cpu_stat = read_keyed("cpu.stat");
+    result.cpu_usage_usec = cpu_stat["usage_usec"] - base.cpu_usage_usec;
+    result.user_usec = cpu_stat["user_usec"] - base.user_usec;
+    result.system_usec = cpu_stat["system_usec"] - base.system_usec;
+    result.oom_kill = read_keyed("memory.events")["oom_kill"] - base.oom_kill;
+    read_io_stat(result.io_read_bytes, result.io_write_bytes);
+    if (result.io_read_bytes >= 0 && base.io_read_bytes >= 0) {
+        result.io_read_bytes -= base.io_read_bytes;
+        result.io_write_bytes -= base.io_write_bytes;
+    }
+    return result;
+}
+
+void cgroup2_guard::kill() {
+    // cgroup.kill 自 Linux 5.14 起可用，可以一次性杀死 cgroup 内的所有进程（包括正在 fork 的进程）
+    try {
+        write("cgroup.kill", "1");
+    } catch (system_error &e) {
+        if (e.code().value() != ENOENT) throw;
+        istringstream procs(read("cgroup.procs"));
+        for (pid_t pid; procs >> pid;)
+            ::kill(pid, SIGKILL);
+    }
+
+    // 等待 cgroup 变为空，这样下一次运行的统计数据不会受到残留进程的影响
+    int fd = openat(dirfd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening {}/cgroup.events", path));
+    for (int retry = 0; retry < 100; ++retry) {
+        char buf[256] = {0};
+        if (pread(fd, buf, sizeof(buf) - 1, 0) < 0) break;
+        if (strstr(buf, "populated 0")) break;
+        struct pollfd pfd = {fd, POLLPRI, 0};
+        poll(&pfd, 1, 10);
+    }
+    close(fd);
+}
+
+void cgroup2_guard::release() {
+    if (!temporary) return;
+    if (peakfd >= 0) close(peakfd);
+    if (dirfd >= 0) close(dirfd);
+    peakfd = dirfd = -1;
+    if (rmdir(path.c_str()) != 0)
+        BOOST_LOG_TRIVIAL(warning) << "unable to remove cgroup " << path << ": " << strerror(errno);
+}
@@ -0,0 +1,96 @@
+#include "landlock.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <linux/landlock.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <system_error>
+
+using namespace std;
+
+// 较旧的内核头文件中没有以下定义，系统调用号在所有架构上相同
+#ifndef __NR_landlock_create_ruleset
+#define __NR_landlock_create_ruleset 444
+#define __NR_landlock_add_rule 445
+#define __NR_landlock_restrict_self 446
+#endif
+#ifndef LANDLOCK_ACCESS_FS_REFER
+#define LANDLOCK_ACCESS_FS_REFER (1ULL << 13)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_IOCTL_DEV
+#define LANDLOCK_ACCESS_FS_IOCTL_DEV (1ULL << 15)
+#endif
+
+static constexpr uint64_t ACCESS_READ = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_READ_FILE | LANDLOCK_ACCESS_FS_READ_DIR;
+
+// 只能作用于文件（而不是文件夹）的权限，为文件添加规则时只能包含这些权限
+static constexpr uint64_t ACCESS_FILE = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_WRITE_FILE | LANDLOCK_ACCESS_FS_READ_FILE |
+                                        LANDLOCK_ACCESS_FS_TRUNCATE | LANDLOCK_ACCESS_FS_IOCTL_DEV;
+
+/**
+ * @brief 当前内核支持的所有文件系统权限
+ */
+static uint64_t supported_access() {
+    int abi = syscall(__NR_landlock_create_ruleset, nullptr, 0, LANDLOCK_CREATE_RULESET_VERSION);
+    if (abi < 0)
+        throw system_error(errno, generic_category(), "Landlock is not supported by the kernel");
+
+    uint64_t access = (LANDLOCK_ACCESS_FS_MAKE_SYM << 1) - 1;          // ABI 1
+    if (abi >= 2) access |= LANDLOCK_ACCESS_FS_REFER;                   // Linux 5.19
+    if (abi >= 3) access |= LANDLOCK_ACCESS_FS_TRUNCATE;                // Linux 6.2
+    if (abi >= 5) access |= LANDLOCK_ACCESS_FS_IOCTL_DEV;               // Linux 6.10
+    return access;
+}
+
+static void add_path_rule(int ruleset, const string &path, uint64_t access) {
+    int fd = open(path.c_str(), O_PATH | O_CLOEXEC);
+    if (fd < 0) {
+        BOOST_LOG_TRIVIAL(warning) << "landlock: ignoring " << path << ": " << strerror(errno);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && !S_ISDIR(st.st_mode)) access &= ACCESS_FILE;
+
+    struct landlock_path_beneath_attr attr = {};
+    attr.allowed_access = access;
+    attr.parent_fd = fd;
+    int ret = syscall(__NR_landlock_add_rule, ruleset, LANDLOCK_RULE_PATH_BENEATH, &attr, 0);
+    int err = errno;
+    close(fd);
+    if (ret != 0)
+        throw system_error(err, generic_category(), fmt::format("adding landlock rule for {}", path));
+}
+
+void landlock_restrict(const struct runguard_options &opt) {
+    uint64_t handled = supported_access();
+
+    struct landlock_ruleset_attr attr = {};
+    attr.handled_access_fs = handled;
+    int ruleset = syscall(__NR_landlock_create_ruleset, &attr, sizeof(attr), 0);
+    if (ruleset < 0)
+        throw system_error(errno, generic_category(), "creating landlock ruleset");
+
+    for (auto &path : opt.landlock_ro) add_path_rule(ruleset, path, ACCESS_READ & handled);
+    for (auto &path : opt.landlock_rw) add_path_rule(ruleset, path, handled);
+
+    // 非特权进程必须先设置 no_new_privs，这也保证了受控程序无法通过 setuid 程序获得权限
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+        throw system_error(errno, generic_category(), "setting no_new_privs");
+    if (syscall(__NR_landlock_restrict_self, ruleset, 0) != 0)
+        throw system_error(errno, generic_category(), "enforcing landlock ruleset");
+    close(ruleset);
+
+    BOOST_LOG_TRIVIAL(info) << "landlock: restricted to " << opt.landlock_ro.size() << " read-only and "
+                            << opt.landlock_rw.size() << " read-write paths";
+}
@@ -5,14 +5,26 @@
 #include <libcgroup.h>
 #include <math.h>
 #include <seccomp.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <boost/log/trivial.hpp>
+#include <filesystem>
+#include <fstream>
 #include <system_error>
+#include <vector>
 
 #include "cgroup.hpp"
+#include "cgroup2.hpp"
+#include "landlock.hpp"
 #include "system.hpp"
 #include "utils.hpp"
 
@@ -49,6 +61,12 @@ void cgroup_create(const struct runguard_options &opt) {
 }
 
 void cgroup_attach(const struct runguard_options &opt) {
+    if (opt.cgroup_v2) {
+        // 通过 clone3(CLONE_INTO_CGROUP) 创建的子进程已经在 cgroup 中了，此时再写入 cgroup.procs 不会有影响
+        cgroup2_guard::attach(opt.cgroupname);
+        return;
+    }
+
     cgroup_guard cg(opt.cgroupname);
     cg.get_cgroup();
     cg.attach_task();
@@ -103,12 +121,11 @@ void set_restrictions(const struct runguard_options &opt) {
     setenv("HOME", ("/home/" + opt.user).c_str(), true);
 
     if (opt.use_cpu_limit) {
-        /* Setting the real hard limit one second
-		   higher: at the soft limit the kernel will send SIGXCPU at
-		   the hard limit a SIGKILL. The SIGXCPU can be caught, but is
-		   not by default and gives us a reliable way to detect if the
-		   CPU-time limit was reached. */
-        rlim_t cputime_limit = (rlim_t)ceil(opt.cpu_limit.hard);
+        /* CPU time limit is enforced by the watchdog, which reads
+		   the CPU time of the whole cgroup and kills the command
+		   right at the hard limit. RLIMIT_CPU is kept one second
+		   higher only as a fallback for a single process. */
+        rlim_t cputime_limit = (rlim_t)ceil(opt.cpu_limit.hard) + 1;
         set_rlimit(RLIMIT_CPU, cputime_limit, cputime_limit + 1);
     }
 
@@ -145,13 +162,21 @@ void set_restrictions(const struct runguard_options &opt) {
         }
 
         BOOST_LOG_TRIVIAL(info) << "chrooted to directory " << opt.chroot_dir;
+    } else if (!opt.work_dir.empty()) {
+        if (chdir(opt.work_dir.c_str()) != 0)
+            throw system_error(errno, generic_category(), "unable to chdir to workdir");
     }
 
+    // Landlock 规则需要在降低权限之前打开所有路径
+    if (!opt.landlock_ro.empty() || !opt.landlock_rw.empty())
+        landlock_restrict(opt);
+
     BOOST_LOG_TRIVIAL(debug) << "in function set_restrictions: getuid = " << getuid();
 
-    int group_id = get_groupid(opt.group.c_str());
+    // 用户命名空间内只映射了 runguard 启动时解析出的 uid 和 gid，不能再从 chroot 内的 /etc/passwd 查找
+    int group_id = opt.userns ? opt.group_id : get_groupid(opt.group.c_str());
 
-    int user_id = get_userid(opt.user.c_str());  // debug
+    int user_id = opt.userns ? opt.user_id : get_userid(opt.user.c_str());  // debug
 
     BOOST_LOG_TRIVIAL(debug) << "group_id = " << group_id << " user_id = " << user_id;
     BOOST_LOG_TRIVIAL(debug) << "in function set_restrictions: opt.group = " << opt.group << " group_id = " << group_id;
@@ -161,7 +186,8 @@ void set_restrictions(const struct runguard_options &opt) {
             throw system_error(errno, generic_category(), "unable to set group id");
         gid_t aux_groups[10];
         aux_groups[0] = group_id;
-        if (setgroups(1, aux_groups))
+        // 用户命名空间内 setgroups 已被禁止
+        if (!opt.userns && setgroups(1, aux_groups))
             throw system_error(errno, generic_category(), "unable to clear auxiliary groups");
     }
 
@@ -183,9 +209,112 @@ void set_restrictions(const struct runguard_options &opt) {
         throw runtime_error("you cannot run user command as root");
 }
 
-void set_seccomp(const struct runguard_options &opt) {
-    scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
+static vector<struct sock_filter> seccomp_program;
+
+/**
+ * @brief 计算缓存文件名，相同的系统调用列表和模式对应同一个 BPF 程序
+ */
+static string seccomp_cache_key(const struct runguard_options &opt) {
+    vector<int> syscalls = opt.syscalls;
+    sort(syscalls.begin(), syscalls.end());
+    syscalls.erase(unique(syscalls.begin(), syscalls.end()), syscalls.end());
+
+    // FNV-1a，结果与编译器、运行平台无关
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&](uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    mix(opt.seccomp_audit ? opt.seccomp_notify_sock + 1 : 0);
+    for (int syscall : syscalls) mix(syscall);
+    return fmt::format("{:016x}.bpf", hash);
+}
+
+static vector<struct sock_filter> compile_seccomp(const struct runguard_options &opt) {
+    // 审计模式下不允许的系统调用将通知 watchdog 记录后继续执行，否则直接杀死程序
+    scmp_filter_ctx ctx = seccomp_init(opt.seccomp_audit ? SCMP_ACT_NOTIFY : SCMP_ACT_KILL);
+    if (ctx == nullptr)
+        throw runtime_error("seccomp_init failed");
     for (int syscall : opt.syscalls)
         seccomp_rule_add(ctx, SCMP_ACT_ALLOW, syscall, 0);
-    seccomp_load(ctx);
+    if (opt.seccomp_audit) {
+        // 子进程需要在 exec 之前通过 sendmsg 将通知文件描述符发送给 watchdog，
+        // 此时 watchdog 还无法处理通知，因此只放行发往该 socket 的 sendmsg
+        struct scmp_arg_cmp cmp = {0, SCMP_CMP_EQ, (scmp_datum_t)opt.seccomp_notify_sock, 0};
+        seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(sendmsg), 1, cmp);
+    }
+
+    int fd = memfd_create("seccomp", MFD_CLOEXEC);
+    if (fd < 0) {
+        seccomp_release(ctx);
+        throw system_error(errno, generic_category(), "memfd_create");
+    }
+    int ret = seccomp_export_bpf(ctx, fd);
+    seccomp_release(ctx);
+    if (ret < 0) {
+        close(fd);
+        throw system_error(-ret, generic_category(), "exporting seccomp filter");
+    }
+
+    vector<struct sock_filter> program(lseek(fd, 0, SEEK_END) / sizeof(struct sock_filter));
+    ssize_t size = program.size() * sizeof(struct sock_filter);
+    if (pread(fd, program.data(), size, 0) != size) {
+        close(fd);
+        throw system_error(errno, generic_category(), "reading seccomp filter");
+    }
+    close(fd);
+    return program;
+}
+
+void prepare_seccomp(const struct runguard_options &opt) {
+    if (opt.seccomp_cache.empty()) {
+        seccomp_program = compile_seccomp(opt);
+        return;
+    }
+
+    filesystem::path cache_file = filesystem::path(opt.seccomp_cache) / seccomp_cache_key(opt);
+    {
+        ifstream fin(cache_file, ios::binary | ios::ate);
+        if (fin) {
+            seccomp_program.resize(fin.tellg() / sizeof(struct sock_filter));
+            fin.seekg(0);
+            if (fin.read((char *)seccomp_program.data(), seccomp_program.size() * sizeof(struct sock_filter)) &&
+                !seccomp_program.empty())
+                return;
+        }
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Compiling seccomp filter to " << cache_file;
+    seccomp_program = compile_seccomp(opt);
+
+    // 写入临时文件后再重命名，其他同时运行的 runguard 不会读到写了一半的文件
+    filesystem::create_directories(opt.seccomp_cache);
+    string tmp = (filesystem::path(opt.seccomp_cache) / "tmp.XXXXXX").string();
+    int fd = mkstemp(tmp.data());
+    if (fd < 0)
+        throw system_error(errno, generic_category(), "creating seccomp cache file");
+    ssize_t size = seccomp_program.size() * sizeof(struct sock_filter);
+    bool written = write(fd, seccomp_program.data(), size) == size;
+    close(fd);
+    if (!written || rename(tmp.c_str(), cache_file.c_str()) != 0) {
+        BOOST_LOG_TRIVIAL(warning) << "unable to write seccomp cache " << cache_file << ": " << strerror(errno);
+        unlink(tmp.c_str());
+    }
+}
+
+int set_seccomp(const struct runguard_options &opt) {
+    // 子进程已经放弃了 root 权限，加载 seccomp 过滤器要求设置 no_new_privs
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+        throw system_error(errno, generic_category(), "setting no_new_privs");
+
+    struct sock_fprog prog;
+    prog.len = seccomp_program.size();
+    prog.filter = seccomp_program.data();
+    unsigned int flags = opt.seccomp_audit ? SECCOMP_FILTER_FLAG_NEW_LISTENER : 0;
+    int ret = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+    if (ret < 0)
+        throw system_error(errno, generic_category(), "loading seccomp filter");
+    return opt.seccomp_audit ? ret : -1;
 }
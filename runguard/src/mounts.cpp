@@ -0,0 +1,172 @@
+#include "mounts.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/log/trivial.hpp>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+
+mount_spec parse_mount_spec(const string &spec) {
+    mount_spec result;
+    vector<string> fields;
+    boost::split(fields, spec, boost::is_any_of(","));
+    for (auto &field : fields) {
+        auto eq = field.find('=');
+        string key = field.substr(0, eq);
+        string value = eq == string::npos ? "" : field.substr(eq + 1);
+        if (key == "type")
+            result.type = value;
+        else if (key == "source" || key == "src")
+            result.source = value;
+        else if (key == "target" || key == "dst")
+            result.target = value;
+        else if (key == "lower")
+            boost::split(result.lower, value, boost::is_any_of(":"));
+        else if (key == "upper")
+            result.upper = value;
+        else if (key == "work")
+            result.work = value;
+        else if (key == "ro" || key == "readonly")
+            result.readonly = true;
+        else
+            throw invalid_argument(fmt::format("unknown mount option '{}' in '{}'", key, spec));
+    }
+
+    if (result.target.empty())
+        throw invalid_argument(fmt::format("mount target required: '{}'", spec));
+    if (result.type == "overlay") {
+        if (result.lower.empty() || result.upper.empty() || result.work.empty())
+            throw invalid_argument(fmt::format("overlay requires lower, upper and work: '{}'", spec));
+    } else if (result.type == "bind") {
+        if (result.source.empty())
+            throw invalid_argument(fmt::format("bind mount requires source: '{}'", spec));
+    } else if (result.type != "dev") {
+        throw invalid_argument(fmt::format("unknown mount type '{}'", result.type));
+    }
+    return result;
+}
+
+/**
+ * @brief 通过新的 mount API 挂载 overlayfs
+ * 每一层 lowerdir 单独通过 lowerdir+ 传入（Linux 6.8 起支持），不受 mount(2) 选项字符串长度
+ * （一个页面）的限制，依赖链很深的评测也可以挂载
+ * @return 内核不支持时返回 false
+ */
+static bool mount_overlay_fsopen(const mount_spec &m) {
+    int fsfd = fsopen("overlay", FSOPEN_CLOEXEC);
+    if (fsfd < 0) return false;
+
+    for (auto &dir : m.lower) {
+        if (fsconfig(fsfd, FSCONFIG_SET_STRING, "lowerdir+", dir.c_str(), 0) != 0) {
+            close(fsfd);
+            return false;
+        }
+    }
+
+    if (fsconfig(fsfd, FSCONFIG_SET_STRING, "upperdir", m.upper.c_str(), 0) != 0 ||
+        fsconfig(fsfd, FSCONFIG_SET_STRING, "workdir", m.work.c_str(), 0) != 0 ||
+        fsconfig(fsfd, FSCONFIG_CMD_CREATE, nullptr, nullptr, 0) != 0) {
+        int err = errno;
+        close(fsfd);
+        throw system_error(err, generic_category(), fmt::format("creating overlay on {}", m.target));
+    }
+
+    int mntfd = fsmount(fsfd, FSMOUNT_CLOEXEC, 0);
+    int err = errno;
+    close(fsfd);
+    if (mntfd < 0)
+        throw system_error(err, generic_category(), fmt::format("creating overlay mount on {}", m.target));
+    if (move_mount(mntfd, "", AT_FDCWD, m.target.c_str(), MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+        err = errno;
+        close(mntfd);
+        throw system_error(err, generic_category(), fmt::format("moving overlay mount to {}", m.target));
+    }
+    close(mntfd);
+    return true;
+}
+
+static void mount_overlay(const mount_spec &m) {
+    if (mount_overlay_fsopen(m)) return;
+
+    string options = fmt::format("lowerdir={},upperdir={},workdir={}",
+                                 boost::algorithm::join(m.lower, ":"), m.upper, m.work);
+    if (mount("overlay", m.target.c_str(), "overlay", 0, options.c_str()) != 0)
+        throw system_error(errno, generic_category(), fmt::format("mounting overlay on {}", m.target));
+}
+
+static void mount_bind(const mount_spec &m) {
+    if (mount(m.source.c_str(), m.target.c_str(), nullptr, MS_BIND | MS_REC, nullptr) != 0)
+        throw system_error(errno, generic_category(), fmt::format("binding {} to {}", m.source, m.target));
+    // bind mount 时 MS_RDONLY 会被忽略，必须重新挂载一次
+    if (m.readonly) {
+        // 用户命名空间内不允许清除从主机继承的 nosuid、nodev、noexec 等标志，重新挂载时要保留
+        unsigned long flags = MS_BIND | MS_REMOUNT | MS_RDONLY;
+        struct statvfs st;
+        if (statvfs(m.target.c_str(), &st) == 0) {
+            if (st.f_flag & ST_NOSUID) flags |= MS_NOSUID;
+            if (st.f_flag & ST_NODEV) flags |= MS_NODEV;
+            if (st.f_flag & ST_NOEXEC) flags |= MS_NOEXEC;
+            if (st.f_flag & ST_NOATIME) flags |= MS_NOATIME;
+            if (st.f_flag & ST_NODIRATIME) flags |= MS_NODIRATIME;
+            if (st.f_flag & ST_RELATIME) flags |= MS_RELATIME;
+        }
+        if (mount(nullptr, m.target.c_str(), nullptr, flags, nullptr) != 0)
+            throw system_error(errno, generic_category(), fmt::format("remounting {} read-only", m.target));
+    }
+}
+
+static void make_devices(const mount_spec &m) {
+    // 在 Docker 内 bind mount 的字符设备无法访问，因此直接重新创建字符设备
+    static const struct {
+        const char *name;
+        unsigned major, minor;
+    } devices[] = {
+        {"full", 1, 7}, {"null", 1, 3}, {"ptmx", 5, 2}, {"random", 1, 8}, {"tty", 5, 0}, {"urandom", 1, 9}};
+
+    for (auto &dev : devices) {
+        string path = m.target + "/" + dev.name;
+        unlink(path.c_str());
+        if (mknod(path.c_str(), S_IFCHR | 0666, makedev(dev.major, dev.minor)) != 0) {
+            // 用户命名空间内不允许创建设备文件，改为将主机上的设备 bind mount 到空文件上
+            if (errno != EPERM)
+                throw system_error(errno, generic_category(), fmt::format("creating device {}", path));
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+            if (fd < 0)
+                throw system_error(errno, generic_category(), fmt::format("creating {}", path));
+            close(fd);
+            string source = fmt::format("/dev/{}", dev.name);
+            if (mount(source.c_str(), path.c_str(), nullptr, MS_BIND, nullptr) != 0)
+                throw system_error(errno, generic_category(), fmt::format("binding {} to {}", source, path));
+            continue;
+        }
+        // mknod 受 umask 影响
+        if (chmod(path.c_str(), 0666) != 0)
+            throw system_error(errno, generic_category(), fmt::format("chmod {}", path));
+    }
+}
+
+void apply_mounts(const vector<mount_spec> &mounts) {
+    for (auto &m : mounts) {
+        BOOST_LOG_TRIVIAL(debug) << "mounting " << m.type << " on " << m.target;
+
+        error_code ec;
+        filesystem::create_directories(m.target, ec);
+
+        if (m.type == "overlay")
+            mount_overlay(m);
+        else if (m.type == "bind")
+            mount_bind(m);
+        else if (m.type == "dev")
+            make_devices(m);
+    }
+}
@@ -0,0 +1,90 @@
+#include "nspool.hpp"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/mount.h>
+#include <sys/msg.h>
+#include <sys/sem.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+using namespace std;
+
+static char pool_hostname[HOST_NAME_MAX + 1];
+static char pool_domainname[HOST_NAME_MAX + 1];
+
+static void enter_namespace(const string &path, int nstype) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening namespace {}", path));
+    if (setns(fd, nstype) != 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, generic_category(), fmt::format("entering namespace {}", path));
+    }
+    close(fd);
+}
+
+void nspool_enter(const struct runguard_options &opt) {
+    BOOST_LOG_TRIVIAL(info) << "Entering namespaces from pool " << opt.ns_pool;
+
+    enter_namespace(opt.ns_pool + "/ipc", CLONE_NEWIPC);
+    enter_namespace(opt.ns_pool + "/uts", CLONE_NEWUTS);
+    if (opt.netns.empty())
+        enter_namespace(opt.ns_pool + "/net", CLONE_NEWNET);
+
+    // 记录进入时的 hostname，受控程序退出后恢复
+    if (gethostname(pool_hostname, sizeof(pool_hostname)) != 0 ||
+        getdomainname(pool_domainname, sizeof(pool_domainname)) != 0)
+        throw system_error(errno, generic_category(), "getting hostname");
+}
+
+/**
+ * @brief 删除 /proc/sysvipc/<type> 中列出的所有 IPC 对象
+ * 文件第一行为表头，之后每行第二列为对象的 id
+ */
+template <typename Remove>
+static void remove_sysvipc(const string &type, Remove remove) {
+    ifstream fin("/proc/sysvipc/" + type);
+    string line;
+    getline(fin, line);
+    for (long key, id; fin >> key >> id; getline(fin, line)) {
+        if (remove(id) != 0 && errno != EINVAL && errno != EIDRM)
+            BOOST_LOG_TRIVIAL(warning) << fmt::format("unable to remove {} {}: {}", type, id, strerror(errno));
+    }
+}
+
+void nspool_reset(const struct runguard_options &opt) {
+    BOOST_LOG_TRIVIAL(info) << "Resetting namespaces in pool " << opt.ns_pool;
+
+    remove_sysvipc("shm", [](int id) { return shmctl(id, IPC_RMID, nullptr); });
+    remove_sysvipc("msg", [](int id) { return msgctl(id, IPC_RMID, nullptr); });
+    remove_sysvipc("sem", [](int id) { return semctl(id, 0, IPC_RMID); });
+
+    // POSIX 消息队列只能通过挂载 mqueue 文件系统枚举，挂载时使用的是当前进程所在的 IPC 命名空间。
+    // runguard 已经位于独立的 mount 命名空间中，这里的挂载不会影响主机
+    char mqueue_dir[] = "/tmp/runguard_mqueue_XXXXXX";
+    if (mkdtemp(mqueue_dir) == nullptr)
+        throw system_error(errno, generic_category(), "creating mqueue mount point");
+    if (mount("mqueue", mqueue_dir, "mqueue", MS_NOSUID | MS_NODEV | MS_NOEXEC, nullptr) == 0) {
+        error_code ec;
+        for (auto &entry : filesystem::directory_iterator(mqueue_dir, ec))
+            filesystem::remove(entry.path(), ec);
+        umount2(mqueue_dir, MNT_DETACH);
+    } else {
+        BOOST_LOG_TRIVIAL(warning) << "unable to mount mqueue: " << strerror(errno);
+    }
+    rmdir(mqueue_dir);
+
+    if (sethostname(pool_hostname, strlen(pool_hostname)) != 0 ||
+        setdomainname(pool_domainname, strlen(pool_domainname)) != 0)
+        throw system_error(errno, generic_category(), "restoring hostname");
+}
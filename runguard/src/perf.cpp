@@ -0,0 +1,51 @@
+#include "perf.hpp"
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <system_error>
+
+using namespace std;
+
+int instruction_counter_open(pid_t pid, int64_t limit) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;  // 不统计 runguard 在 exec 之前执行的指令
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    if (limit > 0) {
+        // 指令数达到 sample_period 时计数器溢出，通过 O_ASYNC 向计数器的所有者发送 SIGIO（inherit 时每个子进程的计数器都可能发送）
+        attr.sample_period = limit;
+        attr.wakeup_events = 1;
+    }
+
+    int fd = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), "perf_event_open");
+
+    if (limit > 0) {
+        if (fcntl(fd, F_SETOWN, getpid()) != 0 ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC) != 0) {
+            int err = errno;
+            close(fd);
+            throw system_error(err, generic_category(), "setting instruction counter owner");
+        }
+    }
+    return fd;
+}
+
+int64_t instruction_counter_read(int fd) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        throw system_error(errno, generic_category(), "reading instruction counter");
+    return (int64_t)count;
+}
@@ -2,13 +2,21 @@
 
 #include <fcntl.h>
 #include <fmt/core.h>
+#include <linux/sched.h>
+#include <linux/seccomp.h>
 #include <math.h>
 #include <seccomp.h>
 #include <signal.h>
 #include <sys/mount.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
-#include <sys/times.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/user.h>
 #include <sys/wait.h>
@@ -19,12 +27,23 @@
 #include <boost/log/trivial.hpp>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
 #include <system_error>
 
 #include "cgroup.hpp"
+#include "cgroup2.hpp"
 #include "limits.hpp"
+#include "mounts.hpp"
+#include "nspool.hpp"
+#include "perf.hpp"
 #include "runguard_options.hpp"
+#include "runguard_record.hpp"
+#include "sampler.hpp"
 #include "system.hpp"
+#include "userns.hpp"
 #include "utils.hpp"
 
 using namespace std;
@@ -41,6 +60,14 @@ int child_pid = -1;
 int efd = -1;
 static volatile sig_atomic_t received_SIGCHLD = 0;
 static volatile sig_atomic_t received_signal = -1;
+static unique_ptr<cgroup2_guard> cgroup2;  // 仅在使用 cgroup v2 时有效
+static int exec_sync[2] = {-1, -1};         // 统计指令数时，子进程要等待计数器创建后才能 exec
+static const char* volatile limit_reason = "";  // 程序因超出哪项限制而被结束
+static int notify_sock[2] = {-1, -1};           // 审计模式下子进程通过该 socket 将 seccomp 通知文件描述符发送给 watchdog
+static int notify_fd = -1;
+static set<int> audited_syscalls;
+static int recordfd = -1;  // 二进制运行结果文件
+static int samplesfd = -1;  // 资源使用采样结果文件
 
 template <typename... Args>
 void error(int err, Args&&... args) {
@@ -53,6 +80,27 @@ void append_meta(const char* key, T message) {
     metafile << key << ": " << message << endl;
 }
 
+static uint32_t limit_reason_code(const char* reason) {
+    static const map<string, uint32_t> codes = {
+        {"", RUNGUARD_LIMIT_NONE},
+        {"wall-time", RUNGUARD_LIMIT_WALL_TIME},
+        {"cpu-time", RUNGUARD_LIMIT_CPU_TIME},
+        {"memory", RUNGUARD_LIMIT_MEMORY},
+        {"output", RUNGUARD_LIMIT_OUTPUT},
+        {"instructions", RUNGUARD_LIMIT_INSTRUCTIONS}};
+    auto it = codes.find(reason);
+    return it == codes.end() ? RUNGUARD_LIMIT_NONE : it->second;
+}
+
+/**
+ * @brief 一次性写入二进制运行结果，评测系统不会读到只写了一半的结果
+ */
+static void write_record(const runguard_record& record) {
+    if (recordfd < 0) return;
+    if (pwrite(recordfd, &record, sizeof(record), 0) != (ssize_t)sizeof(record))
+        BOOST_LOG_TRIVIAL(warning) << "unable to write result record: " << strerror(errno);
+}
+
 void runguard_terminate_handler() {
     sigset_t sigs;
     /*
@@ -109,33 +157,59 @@ static void set_propagation(unsigned long flags) {
 }
 
 static void summarize_cgroup(const runguard_options& opt, int exitcode,
-                             struct timeval starttime, struct timeval endtime,
-                             struct tms startticks, struct tms endticks) {
+                             struct timespec starttime, struct timespec endtime,
+                             const struct rusage& usage, int64_t instructions) {
     static const char output_timelimit_str[4][16] = {
         "",
         "soft-timelimit",
         "hard-timelimit",
         "hard-timelimit"};
     double cpudiff;
+    // wait4 得到的 rusage 只包含受控程序及其已被回收的子进程，cgroup v2 下改用整个 cgroup 的统计数据
+    double userdiff = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1E-6;
+    double sysdiff = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1E-6;
+    bool is_oom = false;
+    runguard_record record = {};
+    record.magic = RUNGUARD_RECORD_MAGIC;
+    record.version = RUNGUARD_RECORD_VERSION;
+    // 没有 io 控制器时只能取得 rusage 中以 512 字节为单位的块数
+    record.read_bytes = (int64_t)usage.ru_inblock * 512;
+    record.write_bytes = (int64_t)usage.ru_oublock * 512;
+
+    if (cgroup2) {
+        cgroup2_usage cg_usage = cgroup2->usage();
+        // Linux 5.19 之前没有 memory.peak，只能使用单个进程的最大常驻内存
+        if (cg_usage.memory_peak < 0) cg_usage.memory_peak = (int64_t)usage.ru_maxrss * 1024;
+
+        BOOST_LOG_TRIVIAL(info) << "total memory used: " << cg_usage.memory_peak / 1024 << "kB";
+        append_meta("memory-bytes", to_string(cg_usage.memory_peak));
+        record.memory_bytes = cg_usage.memory_peak;
+        cpudiff = (double)cg_usage.cpu_usage_usec / 1e6;
+        userdiff = (double)cg_usage.user_usec / 1e6;
+        sysdiff = (double)cg_usage.system_usec / 1e6;
+        is_oom = cg_usage.oom_kill > 0;
+        if (cg_usage.io_read_bytes >= 0) {
+            record.read_bytes = cg_usage.io_read_bytes;
+            record.write_bytes = cg_usage.io_write_bytes;
+        }
+    } else {
+        cgroup_guard guard(opt.cgroupname);
+        guard.get_cgroup();  // prepare for get_controller
 
-    cgroup_guard guard(opt.cgroupname);
-    guard.get_cgroup();  // prepare for get_controller
-
-    {
-        cgroup_ctrl ctrl = guard.get_controller("memory");
-        int64_t max_usage = ctrl.get_value_int64("memory.memsw.max_usage_in_bytes");
+        {
+            cgroup_ctrl ctrl = guard.get_controller("memory");
+            int64_t max_usage = ctrl.get_value_int64("memory.memsw.max_usage_in_bytes");
 
-        BOOST_LOG_TRIVIAL(info) << "total memory used: " << max_usage / 1024 << "kB";
-        append_meta("memory-bytes", to_string(max_usage));
-    }
-    {
-        cgroup_ctrl ctrl = guard.get_controller("cpuacct");
-        int64_t cpu_time = ctrl.get_value_int64("cpuacct.usage");  // in ns
-        cpudiff = (double)cpu_time / 1e9;
-    }
+            BOOST_LOG_TRIVIAL(info) << "total memory used: " << max_usage / 1024 << "kB";
+            append_meta("memory-bytes", to_string(max_usage));
+            record.memory_bytes = max_usage;
+        }
+        {
+            cgroup_ctrl ctrl = guard.get_controller("cpuacct");
+            int64_t cpu_time = ctrl.get_value_int64("cpuacct.usage");  // in ns
+            cpudiff = (double)cpu_time / 1e9;
+        }
 
-    bool is_oom = false;
-    {
         ifstream fin("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control");
         while (fin.good()) {
             string token;
@@ -145,10 +219,6 @@ static void summarize_cgroup(const runguard_options& opt, int exitcode,
         }
     }
 
-    // 另一种实现读取是否发生 OOM 的方法：
-    // uint64_t u;
-    // assert(is_oom == (read(efd, &u, sizeof(uint64_t)) == sizeof(uint64_t)));
-
     if (is_oom)
         append_meta("memory-result", "oom");
     else
@@ -158,10 +228,14 @@ static void summarize_cgroup(const runguard_options& opt, int exitcode,
     // so our timing is correct: no child processes can survive longer than
     // our monitored process. Run time of the monitored process is actually
     // the runtime of the whole process group.
-    cgroup_kill(opt);
-    cgroup_delete(opt);
+    if (cgroup2) {
+        cgroup2->kill();
+        cgroup2->release();
+    } else {
+        cgroup_kill(opt);
+        cgroup_delete(opt);
+    }
 
-    unsigned long tps = sysconf(_SC_CLK_TCK);
     append_meta("exitcode", exitcode);
 
     if (received_signal != -1) {
@@ -169,14 +243,19 @@ static void summarize_cgroup(const runguard_options& opt, int exitcode,
     }
 
     double walldiff = (endtime.tv_sec - starttime.tv_sec) +
-                      (endtime.tv_usec - starttime.tv_usec) * 1E-6;
-    double userdiff = (double)(endticks.tms_cutime - startticks.tms_cutime) / tps;
-    double sysdiff = (double)(endticks.tms_cstime - startticks.tms_cstime) / tps;
-
-    append_meta("wall-time", fmt::format("{:.3f}", walldiff));
-    append_meta("user-time", fmt::format("{:.3f}", userdiff));
-    append_meta("sys-time", fmt::format("{:.3f}", sysdiff));
-    append_meta("cpu-time", fmt::format("{:.3f}", cpudiff));
+                      (endtime.tv_nsec - starttime.tv_nsec) * 1E-9;
+
+    append_meta("wall-time", fmt::format("{:.6f}", walldiff));
+    append_meta("user-time", fmt::format("{:.6f}", userdiff));
+    append_meta("sys-time", fmt::format("{:.6f}", sysdiff));
+    append_meta("cpu-time", fmt::format("{:.6f}", cpudiff));
+    if (instructions >= 0)
+        append_meta("instructions", instructions);
+    if (opt.seccomp_audit) {
+        string syscalls;
+        for (int nr : audited_syscalls) syscalls += to_string(nr) + " ";
+        append_meta("syscalls-audited", syscalls);
+    }
 
     BOOST_LOG_TRIVIAL(info) << fmt::format("run time: real {:.3f}, user {:.3f}, sys {:.3f}", walldiff, userdiff, sysdiff);
 
@@ -190,25 +269,50 @@ static void summarize_cgroup(const runguard_options& opt, int exitcode,
         BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (soft cpu time)";
     }
 
+    if (opt.instruction_limit > 0 && instructions > opt.instruction_limit) {
+        cpulimit |= TIMELIMIT_SOFT;
+        BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (instruction count)";
+    }
+
     append_meta("time-result", output_timelimit_str[walllimit | cpulimit]);
+    append_meta("limit-reason", (const char*)limit_reason);
+
+    record.exitcode = exitcode;
+    record.signal = received_signal;
+    record.wall_time_usec = (int64_t)llround(walldiff * 1e6);
+    record.cpu_time_usec = (int64_t)llround(cpudiff * 1e6);
+    record.user_time_usec = (int64_t)llround(userdiff * 1e6);
+    record.sys_time_usec = (int64_t)llround(sysdiff * 1e6);
+    record.instructions = instructions;
+    if ((walllimit | cpulimit) & TIMELIMIT_HARD)
+        record.flags |= RUNGUARD_RECORD_TIME_HARD;
+    else if (walllimit | cpulimit)
+        record.flags |= RUNGUARD_RECORD_TIME_SOFT;
+    if (is_oom) record.flags |= RUNGUARD_RECORD_OOM;
+    record.limit_reason = limit_reason_code(limit_reason);
+    write_record(record);
 }
 
 void terminate(int sig) {
     struct sigaction sigact;
 
-    /* Reset signal handlers to default */
+    /* Reset signal handlers to default. The inherited instruction
+       counter keeps overflowing until the child is killed, so SIGIO
+       is ignored instead: its default action would kill us. */
     sigact.sa_handler = SIG_DFL;
     sigact.sa_flags = 0;
     if (sigemptyset(&sigact.sa_mask) != 0)
         BOOST_LOG_TRIVIAL(warning) << "could not initialize signal mask";
     if (sigaction(SIGTERM, &sigact, NULL) != 0)
         BOOST_LOG_TRIVIAL(warning) << "could not restore signal handler";
-    if (sigaction(SIGALRM, &sigact, NULL) != 0)
+    sigact.sa_handler = SIG_IGN;
+    if (sigaction(SIGIO, &sigact, NULL) != 0)
         BOOST_LOG_TRIVIAL(warning) << "could not restore signal handler";
 
-    if (sig == SIGALRM) {
-        walllimit |= TIMELIMIT_HARD;
-        BOOST_LOG_TRIVIAL(warning) << "timelimit exceeded (hard wall time): aborting command";
+    if (sig == SIGIO) {
+        cpulimit |= TIMELIMIT_HARD;
+        limit_reason = "instructions";
+        BOOST_LOG_TRIVIAL(warning) << "timelimit exceeded (instruction count): aborting command";
     } else {
         BOOST_LOG_TRIVIAL(warning) << "received signal " << sig << ": aborting command";
     }
@@ -244,9 +348,41 @@ static void child_handler(int /* signal */) {
 int run_seccomp(runguard_options opt);
 int run_unshare(runguard_options opt);
 
+/**
+ * @brief 创建子进程
+ * 使用 cgroup v2 时通过 clone3(CLONE_INTO_CGROUP) 让子进程在创建时就位于目标 cgroup 中，
+ * 这样子进程从第一条指令开始就受到资源限制和统计，也省去了子进程再写入 cgroup.procs 的迁移开销。
+ * 内核不支持 clone3（Linux 5.7 之前）时回退到 fork，由 set_restrictions 将子进程移入 cgroup。
+ * @return 与 fork 相同
+ */
+static pid_t spawn_child() {
+    if (cgroup2) {
+        struct clone_args args;
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = cgroup2->fd();
+
+        pid_t pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid >= 0 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL))
+            return pid;
+        BOOST_LOG_TRIVIAL(info) << "clone3 with CLONE_INTO_CGROUP unsupported, falling back to fork";
+    }
+    return fork();
+}
+
 int runit(struct runguard_options opt) {
     set_terminate(runguard_terminate_handler);
     metafile.open(opt.metafile_path.c_str(), ofstream::out);
+    if (!opt.record_path.empty()) {
+        // 先截断结果文件，这样 runguard 异常退出时评测系统读到的是空文件而不是上一次的结果
+        recordfd = open(opt.record_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (recordfd < 0) error(errno, "opening result record {}", opt.record_path);
+    }
+    if (!opt.samples_path.empty()) {
+        samplesfd = open(opt.samples_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (samplesfd < 0) error(errno, "opening resource samples {}", opt.samples_path);
+    }
 
     {
         struct sigaction sigact;
@@ -270,15 +406,31 @@ int runit(struct runguard_options opt) {
         }
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Initializing cgroup";
+    if (opt.cgroup_v2) {
+        // cgroup v2 下优先复用 create_cgroups.sh 为每个 worker 预先创建好的 cgroup，
+        // 避免每次运行都要创建、删除 cgroup
+        bool temporary = opt.cgroup_leaf.empty();
+        if (temporary)
+            opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
+        else
+            opt.cgroupname = "/judger/" + opt.cgroup_leaf;
+
+        BOOST_LOG_TRIVIAL(info) << "Preparing cgroup v2 " << opt.cgroupname;
+
+        cgroup2 = make_unique<cgroup2_guard>(opt.cgroupname, temporary);
+        cgroup2->reset_counters();
+        cgroup2->set_limits(opt);
+    } else {
+        BOOST_LOG_TRIVIAL(info) << "Initializing cgroup";
 
-    cgroup_guard::init();
+        cgroup_guard::init();
 
-    opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
+        opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
 
-    BOOST_LOG_TRIVIAL(info) << "Creating cgroup";
+        BOOST_LOG_TRIVIAL(info) << "Creating cgroup";
 
-    cgroup_create(opt);
+        cgroup_create(opt);
+    }
 
     BOOST_LOG_TRIVIAL(info) << "Fixing Linux OOM killer";
 
@@ -310,15 +462,21 @@ int runit(struct runguard_options opt) {
         }
     }
 
-    // 另一种实现读取是否发生 OOM 的方法：
-    // if ((efd = eventfd(0, EFD_NONBLOCK)) < 0) error(errno, "requesting event fd");
-    // int cfd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/cgroup.event_control").c_str(), O_WRONLY);
-    // if (cfd < 0) error(errno, "opening cgroup.event_control");
-    // int ofd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control").c_str(), O_RDONLY);
-    // if (ofd < 0) error(errno, "opening memory.oom_control");
-    // string oom = fmt::format("{} {}", efd, ofd);
-    // if (write(cfd, oom.data(), oom.size()) < 0) error(errno, "writing cgroup.event_control");
-    // if (close(cfd) < 0) error(errno, "closing cgroup.event_control");
+    if (!cgroup2) {
+        // 通过 eventfd 接收 OOM 通知，watchdog 在发生 OOM 时立即结束程序。cgroup v2 下改为监听 memory.events
+        if ((efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) error(errno, "requesting event fd");
+        int cfd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/cgroup.event_control").c_str(), O_WRONLY);
+        if (cfd < 0) error(errno, "opening cgroup.event_control");
+        int ofd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control").c_str(), O_RDONLY);
+        if (ofd < 0) error(errno, "opening memory.oom_control");
+        string oom = fmt::format("{} {}", efd, ofd);
+        if (write(cfd, oom.data(), oom.size()) < 0) error(errno, "writing cgroup.event_control");
+        if (close(cfd) < 0) error(errno, "closing cgroup.event_control");
+        if (close(ofd) < 0) error(errno, "closing memory.oom_control");
+    }
+
+    // 用户命名空间必须最先创建，之后创建的命名空间都归属于它，runguard 在其中拥有完整的 capability
+    if (opt.userns) userns_enter(opt);
 
     unshare(CLONE_NEWNS);
 
@@ -327,15 +485,33 @@ int runit(struct runguard_options opt) {
     // 参见 unshare 命令源代码（util-linux/sys-utils/unshare.c）
     set_propagation(MS_REC | MS_PRIVATE);
 
+    if (!opt.mounts.empty()) {
+        BOOST_LOG_TRIVIAL(info) << "Applying mounts";
+        apply_mounts(opt.mounts);
+    }
+
     if (!opt.preexecute.empty()) {
+        if (opt.userns)
+            BOOST_LOG_TRIVIAL(warning) << "pre-executed command runs without capabilities in user namespace, use --mount instead";
         BOOST_LOG_TRIVIAL(info) << "Executing pre-executed command";
         if (auto ret = system(opt.preexecute.c_str()); ret != 0)
             BOOST_LOG_TRIVIAL(fatal) << "Pre-executed command failed, exitcode: " << ret;
         BOOST_LOG_TRIVIAL(info) << "Executed pre-executed command";
     }
 
-    if (!opt.syscalls.empty())
+    if (opt.count_instructions && pipe2(exec_sync, O_CLOEXEC) != 0)
+        error(errno, "creating pipe");
+
+    if (opt.seccomp_audit) {
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, notify_sock) != 0)
+            error(errno, "creating socket pair");
+        opt.seccomp_notify_sock = notify_sock[1];
+    }
+
+    if (!opt.syscalls.empty() || opt.seccomp_audit) {
+        prepare_seccomp(opt);
         return run_seccomp(opt);
+    }
     else
         return run_unshare(opt);
 }
@@ -359,9 +535,10 @@ void set_restrictions_parent(const runguard_options& opt) {
         struct sigaction sigact;
 
         /* Construct one-time signal handler to terminate() for TERM
-            and ALRM signals. */
+            signal. Time limits are watched by timerfd in watchdog(),
+            SIGIO from the instruction counter by install_sigio_handler(). */
         sigmask = emptymask;
-        if (sigaddset(&sigmask, SIGALRM) != 0 || sigaddset(&sigmask, SIGTERM) != 0)
+        if (sigaddset(&sigmask, SIGTERM) != 0 || sigaddset(&sigmask, SIGIO) != 0)
             error(errno, "setting signal mask");
 
         sigact.sa_handler = terminate;
@@ -372,27 +549,409 @@ void set_restrictions_parent(const runguard_options& opt) {
         if (sigaction(SIGTERM, &sigact, NULL) != 0) {
             error(errno, "installing signal handler");
         }
+    }
+}
 
-        if (opt.use_wall_limit) {
-            /* Kill child when we receive SIGALRM */
-            if (sigaction(SIGALRM, &sigact, NULL) != 0) {
-                error(errno, "installing signal handler");
-            }
+/**
+ * @brief 安装指令计数器溢出（SIGIO）的处理函数
+ * 必须在释放子进程之前调用，否则子进程 exec 后立即溢出时 SIGIO 的默认动作会结束 watchdog。
+ * 不使用 SA_RESETHAND：inherit 的计数器在子进程被杀死前可能多次溢出，由 terminate() 将 SIGIO 设为忽略。
+ */
+static void install_sigio_handler() {
+    struct sigaction sigact;
+    sigact.sa_handler = terminate;
+    sigact.sa_flags = SA_RESTART;
+    if (sigemptyset(&sigact.sa_mask) != 0 || sigaddset(&sigact.sa_mask, SIGTERM) != 0 || sigaddset(&sigact.sa_mask, SIGIO) != 0)
+        error(errno, "setting signal mask");
+    if (sigaction(SIGIO, &sigact, NULL) != 0)
+        error(errno, "installing signal handler");
+}
+
+/**
+ * @brief 立即杀死受控程序，并记录原因
+ */
+static void kill_child(const char* reason) {
+    limit_reason = reason;
+    BOOST_LOG_TRIVIAL(warning) << "limit exceeded (" << reason << "): killing command";
+    if (kill(-child_pid, SIGKILL) != 0 && errno != ESRCH)
+        error(errno, "sending SIGKILL to command");
+    // 脱离了进程组的进程会在 summarize_cgroup 中通过 cgroup 杀死
+}
+
+/**
+ * @brief 读取 cgroup 当前已经使用的 CPU 时间，单位为秒
+ */
+static double cgroup_cpu_time(const runguard_options& opt) {
+    if (cgroup2) return (double)cgroup2->usage().cpu_usage_usec / 1e6;
+
+    cgroup_guard guard(opt.cgroupname);
+    guard.get_cgroup();
+    return (double)guard.get_controller("cpuacct").get_value_int64("cpuacct.usage") / 1e9;
+}
+
+/**
+ * @brief 计算 cpuset（如 "0,2-3"）包含的 CPU 核心数，未指定时为系统的核心数
+ */
+static int cpuset_size(const string& cpuset) {
+    if (cpuset.empty()) return max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    int count = 0;
+    istringstream in(cpuset);
+    for (string range; getline(in, range, ',');) {
+        auto dash = range.find('-');
+        if (dash == string::npos)
+            count += 1;
+        else
+            count += stoi(range.substr(dash + 1)) - stoi(range.substr(0, dash)) + 1;
+    }
+    return max(count, 1);
+}
+
+static void arm_timer(int fd, double seconds) {
+    struct itimerspec spec = {};
+    seconds = max(seconds, 1e-3);
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - spec.it_value.tv_sec) * 1e9);
+    if (timerfd_settime(fd, 0, &spec, nullptr) != 0)
+        error(errno, "setting timer");
+}
+
+/**
+ * @brief 处理一条 seccomp 通知：记录系统调用号，并让该系统调用继续执行
+ */
+static void audit_syscall() {
+    struct seccomp_notif req;
+    struct seccomp_notif_resp resp;
+    memset(&req, 0, sizeof(req));
+    if (ioctl(notify_fd, SECCOMP_IOCTL_NOTIF_RECV, &req) != 0) {
+        if (errno == EINTR || errno == ENOENT) return;  // 发起系统调用的进程已被杀死
+        error(errno, "receiving seccomp notification");
+    }
+
+    audited_syscalls.insert(req.data.nr);
 
-            double tmpd;
-            struct itimerval itimer;
-            /* Trigger SIGALRM via setitimer:  */
-            itimer.it_interval.tv_sec = 0;
-            itimer.it_interval.tv_usec = 0;
-            itimer.it_value.tv_sec = (int)opt.wall_limit.hard;
-            itimer.it_value.tv_usec = (int)(modf(opt.wall_limit.hard, &tmpd) * 1E6);
+    memset(&resp, 0, sizeof(resp));
+    resp.id = req.id;
+    resp.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    if (ioctl(notify_fd, SECCOMP_IOCTL_NOTIF_SEND, &resp) != 0 && errno != ENOENT)
+        error(errno, "responding seccomp notification");
+}
+
+/**
+ * @brief 接收子进程发送的 seccomp 通知文件描述符
+ * 子进程在 exec 之前失败退出时不会发送，此时返回 -1
+ */
+static int receive_notify_fd() {
+    close(notify_sock[1]);
+
+    char buf[CMSG_SPACE(sizeof(int))], data;
+    struct iovec iov = {&data, 1};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = buf;
+    msg.msg_controllen = sizeof(buf);
+
+    ssize_t ret = recvmsg(notify_sock[0], &msg, MSG_CMSG_CLOEXEC);
+    close(notify_sock[0]);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (ret <= 0 || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
 
-            if (setitimer(ITIMER_REAL, &itimer, NULL) != 0) {
-                error(errno, "setting timer");
+/**
+ * @brief 子进程将 seccomp 通知文件描述符发送给 watchdog
+ */
+static void send_notify_fd(int fd) {
+    char buf[CMSG_SPACE(sizeof(int))], data = 0;
+    struct iovec iov = {&data, 1};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = buf;
+    msg.msg_controllen = sizeof(buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(notify_sock[1], &msg, 0) < 0)
+        error(errno, "sending seccomp listener");
+}
+
+/**
+ * @brief 等待受控程序退出，期间一旦超出限制就立即结束程序
+ *
+ * 通过 epoll 同时等待：
+ * 1. pidfd：子进程退出（内核不支持 pidfd_open 时使用 signalfd 接收 SIGCHLD）
+ * 2. timerfd：wall time 硬限制
+ * 3. timerfd：CPU 时间硬限制。cgroup 的 CPU 时间增长速度不会超过 cpuset 的核心数，
+ *    因此每次在 剩余 CPU 时间 / 核心数 后检查，未超限则按新的剩余时间重新设置定时器
+ * 4. OOM 通知：cgroup v2 下通过 inotify 监听 memory.events，v1 下使用 cgroup.event_control 注册的 eventfd
+ * 5. timerfd：按 --sample-interval 周期性采样资源使用情况（仅 cgroup v2）
+ *
+ * 输出超限由 RLIMIT_FSIZE 保证，内核会立即发送 SIGXFSZ。
+ */
+static void wait_for_child(const runguard_options& opt, const struct timespec& starttime) {
+    enum { EV_EXIT, EV_WALL, EV_CPU, EV_OOM, EV_NOTIFY, EV_SAMPLE };
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) error(errno, "creating epoll");
+    vector<int> fds;
+    auto watch = [&](int fd, int tag) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = tag;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) error(errno, "adding fd to epoll");
+        fds.push_back(fd);
+    };
+
+    int exitfd = syscall(SYS_pidfd_open, child_pid, 0);
+    if (exitfd < 0) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        if ((exitfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) error(errno, "creating signalfd");
+    }
+    watch(exitfd, EV_EXIT);
+
+    int wallfd = -1;
+    if (opt.use_wall_limit) {
+        if ((wallfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) error(errno, "creating timer");
+        arm_timer(wallfd, opt.wall_limit.hard);
+        watch(wallfd, EV_WALL);
+        BOOST_LOG_TRIVIAL(info) << fmt::format("setting hard wall-time limit to {:.3f} seconds", opt.wall_limit.hard);
+    }
+
+    int cpufd = -1, ncpus = cpuset_size(opt.cpuset);
+    if (opt.use_cpu_limit) {
+        if ((cpufd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) error(errno, "creating timer");
+        arm_timer(cpufd, opt.cpu_limit.hard / ncpus);
+        watch(cpufd, EV_CPU);
+    }
+
+    int oomfd = efd;
+    if (cgroup2) oomfd = cgroup2->watch("memory.events");
+    if (oomfd >= 0) watch(oomfd, EV_OOM);
+    if (notify_fd >= 0) watch(notify_fd, EV_NOTIFY);
+
+    unique_ptr<resource_sampler> sampler;
+    int samplefd = -1;
+    double sample_interval = opt.sample_interval / 1000.0;
+    auto elapsed_usec = [&]() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)(now.tv_sec - starttime.tv_sec) * 1000000 + (now.tv_nsec - starttime.tv_nsec) / 1000;
+    };
+    auto arm_sample_timer = [&]() {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = spec.it_interval.tv_sec = (time_t)sample_interval;
+        spec.it_value.tv_nsec = spec.it_interval.tv_nsec = (long)((sample_interval - (time_t)sample_interval) * 1e9);
+        if (timerfd_settime(samplefd, 0, &spec, nullptr) != 0) error(errno, "setting timer");
+    };
+    if (opt.sample_interval > 0 && samplesfd >= 0) {
+        if (cgroup2) {
+            sampler = make_unique<resource_sampler>(*cgroup2);
+            if ((samplefd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) error(errno, "creating timer");
+            arm_sample_timer();
+            watch(samplefd, EV_SAMPLE);
+            sampler->sample(0);
+        } else {
+            BOOST_LOG_TRIVIAL(warning) << "resource sampling requires cgroup v2, ignoring --sample-interval";
+        }
+    }
+
+    // SIGCHLD 一直处于屏蔽状态，signalfd 创建之前产生的 SIGCHLD 仍会保持 pending，不会被错过
+    for (bool exited = false; !exited;) {
+        struct epoll_event events[4];
+        int n = epoll_wait(epfd, events, 4, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;  // SIGTERM 等信号的处理函数已经杀死了子进程
+            error(errno, "waiting for events");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            switch (events[i].data.u32) {
+                case EV_EXIT:
+                    exited = true;
+                    break;
+                case EV_WALL: {
+                    // 定时器只触发一次，不读取的话 epoll 会在子进程退出前一直返回它
+                    uint64_t expirations;
+                    if (read(wallfd, &expirations, sizeof(expirations)) < 0) error(errno, "reading timer");
+                    walllimit |= TIMELIMIT_HARD;
+                    kill_child("wall-time");
+                } break;
+                case EV_CPU: {
+                    uint64_t expirations;
+                    if (read(cpufd, &expirations, sizeof(expirations)) < 0) error(errno, "reading timer");
+                    double remaining = opt.cpu_limit.hard - cgroup_cpu_time(opt);
+                    if (remaining <= 0) {
+                        cpulimit |= TIMELIMIT_HARD;
+                        kill_child("cpu-time");
+                    } else {
+                        arm_timer(cpufd, remaining / ncpus);
+                    }
+                } break;
+                case EV_NOTIFY:
+                    if (events[i].events & EPOLLHUP) {
+                        // 受控程序的所有进程都已退出
+                        epoll_ctl(epfd, EPOLL_CTL_DEL, notify_fd, nullptr);
+                        break;
+                    }
+                    audit_syscall();
+                    break;
+                case EV_SAMPLE: {
+                    uint64_t expirations;
+                    if (read(samplefd, &expirations, sizeof(expirations)) < 0) error(errno, "reading timer");
+                    if (sampler->sample(elapsed_usec())) {
+                        // 采样点数达到上限，丢弃了一半的采样点，采样间隔相应加倍
+                        sample_interval *= 2;
+                        arm_sample_timer();
+                    }
+                } break;
+                case EV_OOM: {
+                    char buf[4096];
+                    if (read(oomfd, buf, sizeof(buf)) < 0 && errno != EAGAIN) error(errno, "reading oom event");
+                    // memory.events 在达到内存限制（max）时也会变化，只有发生 OOM kill 才结束程序
+                    if (!cgroup2 || cgroup2->usage().oom_kill > 0)
+                        kill_child("memory");
+                } break;
             }
-            BOOST_LOG_TRIVIAL(info) << fmt::format("setting hard wall-time limit to {:.3f} seconds", opt.wall_limit.hard);
         }
     }
+
+    for (int fd : fds)
+        if (fd != efd) close(fd);
+    close(epfd);
+
+    if (sampler) {
+        // 子进程退出时再采样一次，这样最后一个采样点就是最终的累计值
+        sampler->sample(elapsed_usec());
+        try {
+            sampler->write(samplesfd);
+        } catch (system_error& e) {
+            BOOST_LOG_TRIVIAL(warning) << e.what();
+        }
+    }
+}
+
+/**
+ * @brief 监控子进程直到其退出，并将统计结果写入 meta 文件
+ * @return 子进程的退出码
+ */
+static int watchdog(const runguard_options& opt) {
+    // watchdog 持有管道的一端时，子进程退出后另一端读不到 EOF，也不会因为写入而收到 SIGPIPE
+    if (opt.stdin_fd >= 0) close(opt.stdin_fd);
+    if (opt.stdout_fd >= 0 && opt.stdout_fd != opt.stdin_fd) close(opt.stdout_fd);
+
+    int64_t instructions = -1;
+    int counter = -1;
+    if (exec_sync[1] >= 0) {
+        if (opt.instruction_limit > 0) install_sigio_handler();
+        try {
+            counter = instruction_counter_open(child_pid, opt.instruction_limit);
+        } catch (system_error& e) {
+            // 子进程在 exec 之前就已经失败退出了
+            if (e.code().value() != ESRCH) throw;
+        }
+        if (write(exec_sync[1], "", 1) < 0)
+            error(errno, "releasing child process");
+        close(exec_sync[0]);
+        close(exec_sync[1]);
+    }
+
+    if (notify_sock[0] >= 0)
+        notify_fd = receive_notify_fd();
+
+    set_restrictions_parent(opt);
+
+    int status, exitcode;
+    struct rusage usage;
+    struct timespec starttime, endtime;
+    // 使用单调时钟，避免系统时间被调整时影响 wall time
+    if (clock_gettime(CLOCK_MONOTONIC, &starttime) != 0)
+        error(errno, "getting time");
+    wait_for_child(opt, starttime);
+    if (wait4(child_pid, &status, 0, &usage) == -1)
+        error(errno, "wait4");
+
+    BOOST_LOG_TRIVIAL(info) << "child process exited";
+
+    if (clock_gettime(CLOCK_MONOTONIC, &endtime) != 0)
+        error(errno, "getting time");
+
+    if (WIFEXITED(status)) {
+        exitcode = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        // In linux, exitcode is no larger than 127.
+        received_signal = WTERMSIG(status);
+        exitcode = received_signal + 128;
+        switch (received_signal) {
+            case SIGXCPU:
+                cpulimit |= TIMELIMIT_HARD;
+                if (!*limit_reason) limit_reason = "cpu-time";
+                BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (hard limit)";
+                break;
+            case SIGXFSZ:
+                if (!*limit_reason) limit_reason = "output";
+                BOOST_LOG_TRIVIAL(warning) << "Output Limit Exceeded";
+                break;
+            default:
+                BOOST_LOG_TRIVIAL(warning) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
+                break;
+        }
+    } else if (WIFSTOPPED(status)) {
+        received_signal = WSTOPSIG(status);
+        exitcode = received_signal + 128;
+        BOOST_LOG_TRIVIAL(warning) << "Command stopped with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
+    } else {
+        throw runtime_error(fmt::format("unknown status: {:x}", status));
+    }
+
+    if (setuid(getuid()) != 0)
+        error(errno, "dropping root privileges");
+
+    if (counter >= 0) {
+        // 杀死 cgroup 内残留的进程前读取，此时已退出的子进程的指令数都已累加
+        instructions = instruction_counter_read(counter);
+        close(counter);
+    }
+
+    summarize_cgroup(opt, exitcode, starttime, endtime, usage, instructions);
+
+    return exitcode;
+}
+
+/**
+ * @brief 子进程 exec 之前调用，将 --standard-input-fd/--standard-output-fd 继承来的文件描述符作为标准输入输出
+ * 交互题中选手程序和交互器运行在两个 runguard 中，调用者创建管道连接两者，数据直接在内核的管道缓冲区中传递，不经过 runguard 转发。
+ * 两者可以是同一个文件描述符（比如 socket），此时受控程序通过标准输入输出与调用者双向通信。
+ * 必须在 set_restrictions 之后调用，否则 runguard 输出到标准输出的日志会混入交互数据
+ */
+static void redirect_inherited_fds(const runguard_options& opt) {
+    if (opt.stdin_fd >= 0 && dup2(opt.stdin_fd, STDIN_FILENO) < 0)
+        error(errno, "redirecting standard input to fd {}", opt.stdin_fd);
+    if (opt.stdout_fd >= 0 && dup2(opt.stdout_fd, STDOUT_FILENO) < 0)
+        error(errno, "redirecting standard output to fd {}", opt.stdout_fd);
+    if (opt.stdin_fd > STDERR_FILENO) close(opt.stdin_fd);
+    if (opt.stdout_fd > STDERR_FILENO && opt.stdout_fd != opt.stdin_fd) close(opt.stdout_fd);
+}
+
+/**
+ * @brief 子进程 exec 之前调用，等待父进程创建好指令计数器
+ */
+static void wait_exec_sync() {
+    if (exec_sync[0] < 0) return;
+    char c;
+    close(exec_sync[1]);
+    if (read(exec_sync[0], &c, 1) != 1)
+        error(errno, "waiting for instruction counter");
+    close(exec_sync[0]);
 }
 
 int run_unshare(runguard_options opt) {
@@ -417,11 +976,18 @@ int run_unshare(runguard_options opt) {
      * 
      * unshare 函数必须放在 fork 之前，这是因为 unshare 本身执行速度很慢，不可以将其运行时间计入选手程序运行时间
      */
-    if (opt.netns.empty()) {
+    if (!opt.ns_pool.empty()) {
+        // IPC、UTS、网络命名空间复用命名空间池中预先创建好的，运行结束后由 nspool_reset 清理
+        unshare(CLONE_FILES | CLONE_NEWPID | CLONE_SYSVSEM);
+        nspool_enter(opt);
+    } else if (opt.netns.empty()) {
         BOOST_LOG_TRIVIAL(info) << "Creating new network namespace";
         unshare(CLONE_FILES | CLONE_NEWPID | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_SYSVSEM | CLONE_NEWNET);
     } else {
         unshare(CLONE_FILES | CLONE_NEWPID | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_SYSVSEM);
+    }
+
+    if (!opt.netns.empty()) {
         int netfd = open(("/var/run/netns/" + opt.netns).c_str(), O_RDONLY);
         if (netfd == -1) error(errno, "opening netns fd " + opt.netns);
         BOOST_LOG_TRIVIAL(info) << "Associating with existing network namespace " << opt.netns;
@@ -434,7 +1000,7 @@ int run_unshare(runguard_options opt) {
 
     BOOST_LOG_TRIVIAL(info) << "Starting user program";
 
-    switch (child_pid = fork()) {
+    switch (child_pid = spawn_child()) {
         case -1:
             throw system_error(errno, system_category(), "unable to fork");
         case 0: {  // child process, run the command
@@ -447,12 +1013,14 @@ int run_unshare(runguard_options opt) {
                 freopen(opt.stdin_filename.c_str(), "r", stdin);
 
             set_restrictions(opt);
+            redirect_inherited_fds(opt);
 
             auto& cmd = opt.command;
             char** args = new char*[cmd.size() + 1];
             for (size_t i = 0; i < cmd.size(); ++i) args[i] = cmd[i].data();
             args[cmd.size()] = 0;
 
+            wait_exec_sync();
             execvp(args[0], args);
 
             BOOST_LOG_TRIVIAL(debug) << "execvp first param = " << args[0];
@@ -460,52 +1028,10 @@ int run_unshare(runguard_options opt) {
             error(errno, "unable to start command {}", cmd[0]);
         } break;
         default: {  // watchdog
-            set_restrictions_parent(opt);
-
-            int status, exitcode;
-            struct tms startticks, endticks;
-            struct timeval starttime, endtime;
-            if (times(&startticks) == (clock_t)-1)
-                error(errno, "getting start clock ticks");
-            if (gettimeofday(&starttime, NULL))
-                error(errno, "getting time");
-            if (waitpid(child_pid, &status, 0) == -1)
-                error(errno, "waitpid");
-
-            BOOST_LOG_TRIVIAL(info) << "child process exited";
-
-            if (times(&endticks) == (clock_t)-1)
-                error(errno, "getting end clock ticks");
-            if (gettimeofday(&endtime, NULL))
-                error(errno, "getting time");
-
-            if (WIFEXITED(status)) {
-                exitcode = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                // In linux, exitcode is no larger than 127.
-                received_signal = WTERMSIG(status);
-                exitcode = received_signal + 128;
-                switch (received_signal) {
-                    case SIGXCPU:
-                        cpulimit |= TIMELIMIT_HARD;
-                        BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (hard limit)";
-                        break;
-                    default:
-                        BOOST_LOG_TRIVIAL(warning) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-                        break;
-                }
-            } else if (WIFSTOPPED(status)) {
-                received_signal = WSTOPSIG(status);
-                exitcode = received_signal + 128;
-                BOOST_LOG_TRIVIAL(warning) << "Command stopped with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-            } else {
-                throw runtime_error(fmt::format("unknown status: {:x}", status));
-            }
+            int exitcode = watchdog(opt);
 
-            if (setuid(getuid()) != 0)
-                error(errno, "dropping root privileges");
-
-            summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks);
+            if (!opt.ns_pool.empty())
+                nspool_reset(opt);
 
             return exitcode;
         } break;
@@ -516,7 +1042,7 @@ int run_unshare(runguard_options opt) {
 
 int run_seccomp(runguard_options opt) {
     BOOST_LOG_TRIVIAL(info) << "Monitoring user program by seccomp";
-    switch (child_pid = fork()) {
+    switch (child_pid = spawn_child()) {
         case -1:
             // using error results in warning: this statement may fall through
             throw system_error(errno, generic_category(), "unable to fork");
@@ -529,64 +1055,22 @@ int run_seccomp(runguard_options opt) {
                 freopen(opt.stdin_filename.c_str(), "r", stdin);
 
             set_restrictions(opt);
+            redirect_inherited_fds(opt);
 
             auto& cmd = opt.command;
             char** args = new char*[cmd.size() + 1];
             for (size_t i = 0; i < cmd.size(); ++i) args[i] = cmd[i].data();
             args[cmd.size()] = 0;
 
-            set_seccomp(opt);
+            wait_exec_sync();
+            if (int listener = set_seccomp(opt); listener >= 0)
+                send_notify_fd(listener);  // 通知文件描述符带有 O_CLOEXEC，exec 时会自动关闭
 
             execvp(args[0], args);
             error(errno, "unable to start command {}", cmd[0]);
         } break;
         default: {  // watchdog
-            set_restrictions_parent(opt);
-
-            int status, exitcode;
-            struct tms startticks, endticks;
-            struct timeval starttime, endtime;
-            if (times(&startticks) == (clock_t)-1)
-                error(errno, "getting start clock ticks");
-            if (gettimeofday(&starttime, NULL))
-                error(errno, "getting time");
-            if (waitpid(child_pid, &status, 0) == -1)
-                error(errno, "waitpid");
-
-            if (times(&endticks) == (clock_t)-1)
-                error(errno, "getting end clock ticks");
-            if (gettimeofday(&endtime, NULL))
-                error(errno, "getting time");
-
-            if (WIFEXITED(status)) {
-                exitcode = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                // In linux, exitcode is no larger than 127.
-                received_signal = WTERMSIG(status);
-                exitcode = received_signal + 128;
-                switch (received_signal) {
-                    case SIGXCPU:
-                        cpulimit |= TIMELIMIT_HARD;
-                        BOOST_LOG_TRIVIAL(warning) << "Time Limit Exceeded (hard limit)";
-                        break;
-                    default:
-                        BOOST_LOG_TRIVIAL(warning) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-                        break;
-                }
-            } else if (WIFSTOPPED(status)) {
-                received_signal = WSTOPSIG(status);
-                exitcode = received_signal + 128;
-                BOOST_LOG_TRIVIAL(warning) << "Command stopped with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
-            } else {
-                throw runtime_error(fmt::format("unknown status: {:x}", status));
-            }
-
-            if (setuid(getuid()) != 0)
-                error(errno, "dropping root privileges");
-
-            summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks);
-
-            return exitcode;
+            return watchdog(opt);
         } break;
     }
 
@@ -14,7 +14,12 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <system_error>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cgroup2.hpp"
 #include "run.hpp"
 #include "system.hpp"
 #include "utils.hpp"
@@ -93,6 +98,171 @@ void init_boost_log() {
     boost::log::add_console_log(std::cout, boost::log::keywords::format = log_format);
 }
 
+/**
+ * @brief 将命令行参数应用到 opt 上
+ * 可以多次指定的参数（--mount、-V、--landlock-*）追加到已有的列表后，
+ * 因此 --batch 文件中每行的参数可以在命令行参数的基础上应用
+ * @return 参数不合法时返回 false
+ */
+static bool apply_options(const boost::program_options::variables_map& vm, runguard_options& opt) {
+    if (vm.count("root")) {
+        opt.chroot_dir = vm["root"].as<string>();
+    }
+
+    if (vm.count("user")) {
+        opt.user = vm["user"].as<string>();
+        opt.user_id = get_userid(opt.user.c_str());
+        opt.group_id = get_groupid(opt.user.c_str());  // debug: default the same
+    }
+
+    // if (vm.count("group") || vm.count("user")) { // origin
+    if (vm.count("group")) {  // debug
+        opt.group = vm["group"].as<string>();
+        opt.group_id = get_groupid(opt.group.c_str());
+    }
+
+    if (vm.count("netns")) opt.netns = vm["netns"].as<string>();
+    if (vm.count("ns-pool")) opt.ns_pool = vm["ns-pool"].as<string>();
+    if (vm.count("preexecute")) opt.preexecute = vm["preexecute"].as<string>();
+    if (vm.count("mount")) {
+        try {
+            for (auto& spec : vm["mount"].as<vector<string>>())
+                opt.mounts.push_back(parse_mount_spec(spec));
+        } catch (invalid_argument& e) {
+            cerr << e.what() << endl;
+            return false;
+        }
+    }
+    if (vm.count("work")) opt.work_dir = vm["work"].as<string>();
+    if (vm.count("landlock-ro")) {
+        auto& paths = vm["landlock-ro"].as<vector<string>>();
+        opt.landlock_ro.insert(opt.landlock_ro.end(), paths.begin(), paths.end());
+    }
+    if (vm.count("landlock-rw")) {
+        auto& paths = vm["landlock-rw"].as<vector<string>>();
+        opt.landlock_rw.insert(opt.landlock_rw.end(), paths.begin(), paths.end());
+    }
+
+    if (vm.count("variable")) {
+        auto& env = vm["variable"].as<vector<string>>();
+        opt.env.insert(opt.env.end(), env.begin(), env.end());
+    }
+
+    if (vm.count("wall-time")) opt.use_wall_limit = true, opt.wall_limit = vm["wall-time"].as<time_limit>();
+    if (vm.count("cpu-time")) {
+        opt.use_cpu_limit = true, opt.cpu_limit = vm["cpu-time"].as<time_limit>();
+        if (!opt.use_wall_limit) {
+            // wall limit must be taken
+            opt.use_wall_limit = true;
+            opt.wall_limit = opt.cpu_limit;
+            opt.wall_limit.hard *= 3;
+            opt.wall_limit.soft *= 3;
+        }
+    }
+    if (vm.count("count-instructions")) opt.count_instructions = true;
+    if (vm.count("instruction-limit")) {
+        opt.count_instructions = true;
+        opt.instruction_limit = vm["instruction-limit"].as<size_t>();
+    }
+    if (vm.count("memory-limit")) {
+        opt.memory_limit = vm["memory-limit"].as<size_t>();
+        if (opt.memory_limit != (opt.memory_limit * 1024) / 1024)
+            opt.memory_limit = -1;
+        else
+            opt.memory_limit *= 1024;
+    }
+    if (vm.count("file-limit")) {
+        opt.file_limit = vm["file-limit"].as<size_t>();
+        if (opt.file_limit != (opt.file_limit * 1024) / 1024)
+            opt.file_limit = -1;
+        else
+            opt.file_limit *= 1024;
+    }
+    if (vm.count("nproc")) opt.nproc = vm["nproc"].as<size_t>();
+    if (vm.count("io-weight")) opt.io_weight = vm["io-weight"].as<int>();
+    if (vm.count("io-max")) opt.io_max = vm["io-max"].as<string>();
+    if (vm.count("no-core-dumps")) opt.no_core_dumps = true;
+    if (vm.count("allowed-syscall")) {
+        filesystem::path p = vm["allowed-syscall"].as<string>();
+        if (filesystem::exists(p)) {
+            ifstream fin(p);
+            for (int no; fin >> no;) opt.syscalls.push_back(no);
+        }
+    }
+    if (vm.count("seccomp-cache")) opt.seccomp_cache = vm["seccomp-cache"].as<string>();
+    if (vm.count("seccomp-audit")) opt.seccomp_audit = true;
+    if (vm.count("cpuset")) opt.cpuset = vm["cpuset"].as<string>();
+    if (vm.count("cgroup-leaf")) opt.cgroup_leaf = vm["cgroup-leaf"].as<string>();
+    opt.cgroup_v2 = cgroup2_guard::available();
+    if (vm.count("userns")) {
+        if (!opt.cgroup_v2) {
+            cerr << "--userns requires cgroup v2" << endl;
+            return false;
+        }
+        // 主机上的网络命名空间和命名空间池归属于初始用户命名空间，无法在新的用户命名空间内进入
+        opt.userns = true;
+        opt.netns.clear();
+        opt.ns_pool.clear();
+    }
+    if (vm.count("standard-input-file")) opt.stdin_filename = vm["standard-input-file"].as<string>();
+    if (vm.count("standard-output-file")) opt.stdout_filename = vm["standard-output-file"].as<string>();
+    if (vm.count("standard-error-file")) opt.stderr_filename = vm["standard-error-file"].as<string>();
+    if (vm.count("standard-input-fd")) opt.stdin_fd = vm["standard-input-fd"].as<int>();
+    if (vm.count("standard-output-fd")) opt.stdout_fd = vm["standard-output-fd"].as<int>();
+    if (vm.count("environment")) opt.preserve_sys_env = true;
+    if (vm.count("out-meta")) opt.metafile_path = vm["out-meta"].as<string>();
+    if (vm.count("out-record")) opt.record_path = vm["out-record"].as<string>();
+    if (vm.count("sample-interval")) opt.sample_interval = vm["sample-interval"].as<int>();
+    if (vm.count("out-samples")) opt.samples_path = vm["out-samples"].as<string>();
+    if (vm.count("cmd")) opt.command = vm["cmd"].as<vector<string>>();
+    return true;
+}
+
+/**
+ * @brief 依次执行 batch 文件中的每次运行
+ * 每行是一次运行额外的参数（按 shell 的规则切分），在命令行参数的基础上应用。
+ * 每次运行都在单独的子进程中调用 runit，挂载点命名空间、overlayfs 的 upper 层、PID 命名空间和 cgroup 的计数都是新的，
+ * 隔离程度与分别启动 runguard 相同，省去的是 sudo、runguard 进程的启动和参数解析。
+ * @return 所有运行都已执行时返回 0，某次运行的结果通过其 meta 文件得知
+ */
+static int run_batch(const string& batch_file, const boost::program_options::options_description& desc, const runguard_options& base) {
+    namespace po = boost::program_options;
+    ifstream fin(batch_file);
+    if (!fin) {
+        cerr << "unable to open batch file " << batch_file << endl;
+        return 1;
+    }
+
+    int ret = 0;
+    for (string line; getline(fin, line);) {
+        if (line.find_first_not_of(" \t") == string::npos) continue;
+
+        runguard_options opt = base;
+        try {
+            po::variables_map vm;
+            po::store(po::command_line_parser(po::split_unix(line)).options(desc).run(), vm);
+            if (!apply_options(vm, opt)) {
+                ret = 1;
+                continue;
+            }
+        } catch (po::error& e) {
+            cerr << "batch line '" << line << "': " << e.what() << endl;
+            ret = 1;
+            continue;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) throw system_error(errno, generic_category(), "unable to fork for batch run");
+        if (pid == 0) _exit(runit(opt));
+
+        int status;
+        while (waitpid(pid, &status, 0) < 0)
+            if (errno != EINTR) throw system_error(errno, generic_category(), "waiting for batch run");
+        BOOST_LOG_TRIVIAL(debug) << "batch run '" << line << "' finished with status " << status;
+    }
+    return ret;
+}
+
 int main(int argc, const char* argv[]) {
     ofstream out("/var/log/judge-system/runguard/label", std::ofstream::out);
     string s = "BOOST_log_dir = " + string{filesystem::path(getenv("BOOST_log_dir")).u8string()};
@@ -114,21 +284,40 @@ int main(int argc, const char* argv[]) {
         ("work", po::value<string>(), "work directory for command")
         ("group,g", po::value<string>(), "run command under group with groupname or group id. If only 'user' is set, this defaults to the same")
         ("netns", po::value<string>(), "run command in specified network namespace, if not specified, runguard will create a new network namespace every time")
+        ("ns-pool", po::value<string>(), "enter pre-created ipc, uts and net namespaces in directory instead of creating new ones, see exec/create_ns_pool.sh")
+        ("userns", "run without root privileges in a new user namespace, --netns and --ns-pool are ignored")
         ("wall-time,T", po::value<time_limit>(), "kill command after wall time clock seconds (floating point is acceptable)")
         ("cpu-time,t", po::value<time_limit>(), "set maximum CPU time (floating point is acceptable) consumption of the command in seconds")
+        ("instruction-limit", po::value<size_t>(), "kill command after it retires the given number of user-space instructions, implies --count-instructions")
+        ("count-instructions", "count retired user-space instructions of the command by perf_event_open")
         ("memory-limit,m", po::value<size_t>(), "set maximum memory consumption of the command in KB")
         ("file-limit,f", po::value<size_t>(), "set maximum created file size of the command in KB")
+        ("io-weight", po::value<int>(), "set proportional disk I/O weight (1-10000, default 100) of the command (cgroup v2 only)")
+        ("io-max", po::value<string>(), "limit disk I/O of the command on the device of working directory, in io.max format (e.g. \"wbps=52428800 wiops=1000\", cgroup v2 only)")
         ("nproc,p", po::value<size_t>(), "set maximum process living simutanously")
         ("cpuset,P", po::value<string>(), "set the processor IDs that can only be used (e.g. \"0,2-3\")")
+        ("cgroup-leaf", po::value<string>(), "reuse the cgroup /judger/<name> instead of creating a new one every time (cgroup v2 only)")
         ("allowed-syscall", po::value<string>(), "set the limited syscall numbers in file separated by spaces")
+        ("seccomp-cache", po::value<string>(), "cache compiled seccomp filters in directory")
+        ("seccomp-audit", "record syscalls not in the allowed list to meta file and let them continue, instead of killing the command (for profiling only)")
         ("no-core-dumps,c", "disable core dumps")
         ("preexecute", po::value<string>(), "run command in new mount namespace before user program execution")
+        ("landlock-ro", po::value<vector<string>>(), "confine the command by Landlock, allowing only reading and executing files beneath the path, can be specified multiple times")
+        ("landlock-rw", po::value<vector<string>>(), "confine the command by Landlock, allowing reading and writing files beneath the path, can be specified multiple times")
+        ("mount", po::value<vector<string>>(), "mount in new mount namespace before preexecute, can be specified multiple times "
+                                               "(e.g. --mount type=overlay,lower=a:b,upper=u,work=w,target=t --mount type=bind,source=s,target=t,ro --mount type=dev,target=t/dev)")
         ("standard-input-file,i", po::value<string>(), "redirect command standard input fd to file")
         ("standard-output-file,o", po::value<string>(), "redirect command standard output fd to file")
         ("standard-error-file,e", po::value<string>(), "redirect command standard error fd to file")
+        ("standard-input-fd", po::value<int>(), "use the inherited fd (e.g. a pipe end) as command standard input, runguard itself closes it after forking")
+        ("standard-output-fd", po::value<int>(), "use the inherited fd (e.g. a pipe end) as command standard output, runguard itself closes it after forking")
         ("environment,E", "preseve system environment variables (or only PATH is loaded)")
         ("variable,V", po::value<vector<string>>(), "add additional environment variables (e.g. -Vkey1=value1 -Vkey2=value2)")
         ("out-meta,M", po::value<string>(), "write runguard monitor results (run time, exitcode, memory usage, ...) to file")
+        ("out-record", po::value<string>(), "write runguard monitor results as a fixed-layout binary record to file")
+        ("sample-interval", po::value<int>(), "sample memory, CPU, page faults, context switches and I/O of the command every given milliseconds (cgroup v2 only)")
+        ("out-samples", po::value<string>(), "write resource samples taken by --sample-interval to file")
+        ("batch", po::value<string>(), "run command once for each line in file, each line gives additional options of the run (e.g. --mount ... --out-meta ...), runs are isolated as separate invocations")
         ("cmd", po::value<vector<string>>()->composing()->required(), "commands")
         ("help", "display this help text")
         ("version", "display version of this application");
@@ -164,73 +353,11 @@ int main(int argc, const char* argv[]) {
         return 0;
     }
 
-    if (vm.count("root")) {
-        opt.chroot_dir = vm["root"].as<string>();
-    }
-
-    if (vm.count("user")) {
-        opt.user = vm["user"].as<string>();
-        opt.user_id = get_userid(opt.user.c_str());
-        opt.group_id = get_groupid(opt.user.c_str());  // debug: default the same
-    }
-
-    // if (vm.count("group") || vm.count("user")) { // origin
-    if (vm.count("group")) {  // debug
-        opt.group = vm["group"].as<string>();
-        opt.group_id = get_groupid(opt.group.c_str());
-    }
-
-    if (vm.count("netns")) opt.netns = vm["netns"].as<string>();
-    if (vm.count("preexecute")) opt.preexecute = vm["preexecute"].as<string>();
-    if (vm.count("work")) opt.work_dir = vm["work"].as<string>();
-
-    if (vm.count("variable")) {
-        opt.env = vm["variable"].as<vector<string>>();
-    }
-
-    if (vm.count("wall-time")) opt.use_wall_limit = true, opt.wall_limit = vm["wall-time"].as<time_limit>();
-    if (vm.count("cpu-time")) {
-        opt.use_cpu_limit = true, opt.cpu_limit = vm["cpu-time"].as<time_limit>();
-        if (!opt.use_wall_limit) {
-            // wall limit must be taken
-            opt.use_wall_limit = true;
-            opt.wall_limit = opt.cpu_limit;
-            opt.wall_limit.hard *= 3;
-            opt.wall_limit.soft *= 3;
-        }
-    }
-    if (vm.count("memory-limit")) {
-        opt.memory_limit = vm["memory-limit"].as<size_t>();
-        if (opt.memory_limit != (opt.memory_limit * 1024) / 1024)
-            opt.memory_limit = -1;
-        else
-            opt.memory_limit *= 1024;
-    }
-    if (vm.count("file-limit")) {
-        opt.file_limit = vm["file-limit"].as<size_t>();
-        if (opt.file_limit != (opt.file_limit * 1024) / 1024)
-            opt.file_limit = -1;
-        else
-            opt.file_limit *= 1024;
-    }
-    if (vm.count("nproc")) opt.nproc = vm["nproc"].as<size_t>();
-    if (vm.count("no-core-dumps")) opt.no_core_dumps = true;
-    if (vm.count("allowed-syscall")) {
-        filesystem::path p = vm["allowed-syscall"].as<string>();
-        if (filesystem::exists(p)) {
-            ifstream fin(p);
-            for (int no; fin >> no;) opt.syscalls.push_back(no);
-        }
-    }
-    if (vm.count("cpuset")) opt.cpuset = vm["cpuset"].as<string>();
-    if (vm.count("standard-input-file")) opt.stdin_filename = vm["standard-input-file"].as<string>();
-    if (vm.count("standard-output-file")) opt.stdout_filename = vm["standard-output-file"].as<string>();
-    if (vm.count("standard-error-file")) opt.stderr_filename = vm["standard-error-file"].as<string>();
-    if (vm.count("environment")) opt.preserve_sys_env = true;
-    if (vm.count("out-meta")) opt.metafile_path = vm["out-meta"].as<string>();
-    opt.command = vm["cmd"].as<vector<string>>();
+    if (!apply_options(vm, opt)) return 1;
 
     BOOST_LOG_TRIVIAL(debug) << "opt: " << opt;
 
+    if (vm.count("batch")) return run_batch(vm["batch"].as<string>(), desc, opt);
+
     return runit(opt);
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "sampler.hpp"
+
+#include <errno.h>
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+using namespace std;
+
+resource_sampler::resource_sampler(cgroup2_guard &cgroup) : cgroup(cgroup) {
+    // memory.stat 中的缺页次数无法重置，记录基准值
+    auto stat = cgroup.read_keyed("memory.stat");
+    base_pgfault = stat["pgfault"];
+    base_pgmajfault = stat["pgmajfault"];
+}
+
+bool resource_sampler::sample(int64_t time_usec) {
+    resource_sample s;
+    s.time_usec = time_usec;
+    s.memory_bytes = strtoll(cgroup.read("memory.current").c_str(), nullptr, 10);
+
+    cgroup2_usage usage = cgroup.usage();
+    s.cpu_usec = usage.cpu_usage_usec;
+    s.user_usec = usage.user_usec;
+    s.system_usec = usage.system_usec;
+    s.read_bytes = usage.io_read_bytes;
+    s.write_bytes = usage.io_write_bytes;
+
+    auto stat = cgroup.read_keyed("memory.stat");
+    s.pgfault = stat["pgfault"] - base_pgfault;
+    s.pgmajfault = stat["pgmajfault"] - base_pgmajfault;
+
+    istringstream threads(cgroup.read("cgroup.threads"));
+    for (pid_t tid; threads >> tid;) {
+        // 线程可能已经退出，忽略读取失败
+        ifstream status(fmt::format("/proc/{}/status", tid));
+        for (string key; status >> key;) {
+            if (key == "voluntary_ctxt_switches:") {
+                int64_t value;
+                if (status >> value) s.voluntary_ctxt_switches += value;
+            } else if (key == "nonvoluntary_ctxt_switches:") {
+                int64_t value;
+                if (status >> value) s.nonvoluntary_ctxt_switches += value;
+            }
+        }
+    }
+
+    samples.push_back(s);
+    if (samples.size() < MAX_SAMPLES) return false;
+
+    // 保留偶数下标的采样点，第一个采样点总是被保留
+    size_t j = 0;
+    for (size_t i = 0; i < samples.size(); i += 2) samples[j++] = samples[i];
+    samples.resize(j);
+    return true;
+}
+
+void resource_sampler::write(int fd) const {
+    string content =
+        "# time_usec memory_bytes cpu_usec user_usec system_usec pgfault pgmajfault "
+        "voluntary_ctxt_switches nonvoluntary_ctxt_switches read_bytes write_bytes\n";
+    for (auto &s : samples)
+        content += fmt::format("{} {} {} {} {} {} {} {} {} {} {}\n",
+                               s.time_usec, s.memory_bytes, s.cpu_usec, s.user_usec, s.system_usec,
+                               s.pgfault, s.pgmajfault, s.voluntary_ctxt_switches, s.nonvoluntary_ctxt_switches,
+                               s.read_bytes, s.write_bytes);
+    if (::write(fd, content.data(), content.size()) != (ssize_t)content.size())
+        throw system_error(errno, generic_category(), "writing resource samples");
+}
@@ -0,0 +1,42 @@
+#include "userns.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <system_error>
+
+using namespace std;
+
+static void write_proc_file(const string &path, const string &content) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("opening {}", path));
+    if (write(fd, content.data(), content.size()) < 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, generic_category(), fmt::format("writing '{}' to {}", content, path));
+    }
+    close(fd);
+}
+
+void userns_enter(const struct runguard_options &opt) {
+    uid_t outer_uid = geteuid();
+    gid_t outer_gid = getegid();
+    uid_t inner_uid = opt.user_id >= 0 ? opt.user_id : outer_uid;
+    gid_t inner_gid = opt.group_id >= 0 ? opt.group_id : outer_gid;
+
+    BOOST_LOG_TRIVIAL(info) << fmt::format("Entering user namespace, mapping uid {} to {}, gid {} to {}",
+                                           inner_uid, outer_uid, inner_gid, outer_gid);
+
+    if (unshare(CLONE_NEWUSER) != 0)
+        throw system_error(errno, generic_category(), "creating user namespace");
+
+    // 非特权进程写入 gid_map 之前必须禁止 setgroups，否则进程可以借此丢弃附加组以绕过"拒绝某组访问"的权限设置
+    write_proc_file("/proc/self/setgroups", "deny");
+    write_proc_file("/proc/self/uid_map", fmt::format("{} {} 1\n", inner_uid, outer_uid));
+    write_proc_file("/proc/self/gid_map", fmt::format("{} {} 1\n", inner_gid, outer_gid));
+}
@@ -1,3 +1,5 @@
+// 通过 ptrace 统计程序使用的系统调用，会显著拖慢程序运行。
+// 推荐改用 runguard --seccomp-audit，结果写入 meta 文件的 syscalls-audited 字段
 #include <iostream>
 #include <sys/ptrace.h>
 #include <sys/types.h>
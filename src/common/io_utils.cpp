@@ -1,12 +1,19 @@
 #include "common/io_utils.hpp"
 #include "logging.hpp"
+#include <fcntl.h>
+#include <linux/fs.h>
 #include <sys/file.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 #include <utime.h>
 #include <algorithm>
 #include <fstream>
+#include <map>
+#include <set>
 #include "common/exceptions.hpp"
 
 namespace judge {
@@ -136,6 +143,158 @@ void clean_locked_directory(const std::filesystem::path &dir) {
     }
 }
 
+// overlayfs 以 root 挂载时使用 trusted.*，在用户命名空间内挂载时使用 user.*
+static const char *OVERLAY_OPAQUE_XATTRS[] = {"trusted.overlay.opaque", "user.overlay.opaque"};
+
+/**
+ * @brief 返回文件夹上标记为不透明的扩展属性名，不是不透明文件夹时返回 nullptr
+ */
+static const char *overlay_opaque_xattr(const fs::path &dir) {
+    for (const char *name : OVERLAY_OPAQUE_XATTRS) {
+        char value;
+        if (lgetxattr(dir.c_str(), name, &value, 1) == 1 && value == 'y')
+            return name;
+    }
+    return nullptr;
+}
+
+static void flatten_link_or_copy(const fs::path &from, const fs::path &to) {
+    if (link(from.c_str(), to.c_str()) == 0) return;
+    if (errno != EXDEV)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to link " + from.string() + " to " + to.string()));
+
+    struct stat st;
+    if (lstat(from.c_str(), &st) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to stat " + from.string()));
+    if (S_ISREG(st.st_mode)) {
+        fs::copy_file(from, to);
+    } else if (S_ISLNK(st.st_mode)) {
+        fs::copy_symlink(from, to);
+    } else if (mknod(to.c_str(), st.st_mode, st.st_rdev) != 0) {  // 白化文件是设备号为 0/0 的字符设备
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to create " + to.string()));
+    }
+    if (lchown(to.c_str(), st.st_uid, st.st_gid) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to change owner of " + to.string()));
+}
+
+/**
+ * @param dirs 同一路径在各层中的文件夹，靠前的在上层，不包括被不透明文件夹遮住的层
+ */
+static void flatten_directory(const vector<fs::path> &dirs, const fs::path &target) {
+    struct stat st;
+    if (lstat(dirs.front().c_str(), &st) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to stat " + dirs.front().string()));
+    // 文件夹的权限在填充完内容后再设置，否则无法在只读的文件夹（如 overlayfs 的 workdir）中创建文件
+    if (mkdir(target.c_str(), 0700) != 0 || lchown(target.c_str(), st.st_uid, st.st_gid) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to create directory " + target.string()));
+    // 最下层是不透明文件夹时，合并结果也必须是不透明的，才能继续遮住合并结果下面的层
+    if (const char *opaque = overlay_opaque_xattr(dirs.back())) {
+        if (lsetxattr(target.c_str(), opaque, "y", 1, 0) != 0)
+            BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to mark " + target.string() + " opaque"));
+    }
+
+    set<string> seen;
+    map<string, vector<fs::path>> subdirs;
+    set<string> closed;  // 遇到了不透明文件夹，下面的层不再参与合并
+    for (auto &dir : dirs) {
+        for (auto &entry : fs::directory_iterator(dir)) {
+            string name = entry.path().filename().string();
+            bool is_dir = entry.is_directory() && !entry.is_symlink();
+            if (seen.count(name)) {
+                // 上层的同名文件夹没有被遮住时，与下层的同名文件夹合并；其余情况下层的文件被遮住
+                if (is_dir && subdirs.count(name) && !closed.count(name)) {
+                    subdirs[name].push_back(entry.path());
+                    if (overlay_opaque_xattr(entry.path())) closed.insert(name);
+                }
+                continue;
+            }
+            seen.insert(name);
+
+            if (is_dir) {
+                subdirs[name].push_back(entry.path());
+                if (overlay_opaque_xattr(entry.path())) closed.insert(name);
+            } else {
+                flatten_link_or_copy(entry.path(), target / name);
+            }
+        }
+    }
+
+    for (auto &[name, layers] : subdirs)
+        flatten_directory(layers, target / name);
+
+    if (chmod(target.c_str(), st.st_mode & 07777) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to change mode of " + target.string()));
+}
+
+void flatten_overlay_layers(const vector<fs::path> &layers, const fs::path &target) {
+    vector<fs::path> dirs;
+    for (auto &layer : layers) {
+        dirs.push_back(layer);
+        if (overlay_opaque_xattr(layer)) break;
+    }
+    flatten_directory(dirs, target);
+}
+
+/**
+ * @brief 跨文件系统复制普通文件，依次尝试 reflink、copy_file_range 和普通的拷贝
+ * 保留权限和修改时间，与硬链接一样可以通过修改时间判断文件是否改变
+ */
+static void clone_file(const fs::path &from, const fs::path &to, const struct stat &st) {
+    mode_t mode = st.st_mode;
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to open " + from.string()));
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode & 07777);
+    if (out < 0) {
+        int err = errno;
+        close(in);
+        BOOST_THROW_EXCEPTION(system_error(err, system_category(), "unable to create " + to.string()));
+    }
+
+    bool copied = ioctl(out, FICLONE, in) == 0;
+    if (!copied) {
+        // tmpfs 等不支持 reflink 的文件系统上，copy_file_range 仍然可以省去拷贝到用户空间的开销
+        ssize_t n;
+        while ((n = copy_file_range(in, nullptr, out, nullptr, 1 << 30, 0)) > 0)
+            ;
+        copied = n == 0;
+    }
+    close(in);
+    close(out);
+    if (!copied) fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+    if (chmod(to.c_str(), mode & 07777) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to change mode of " + to.string()));
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    if (utimensat(AT_FDCWD, to.c_str(), times, 0) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to change modification time of " + to.string()));
+}
+
+void link_or_clone_directory(const fs::path &from, const fs::path &to) {
+    struct stat st;
+    if (stat(from.c_str(), &st) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to stat " + from.string()));
+    if (mkdir(to.c_str(), 0700) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to create directory " + to.string()));
+
+    for (auto &entry : fs::directory_iterator(from)) {
+        fs::path target = to / entry.path().filename();
+        if (entry.is_directory()) {
+            link_or_clone_directory(entry.path(), target);
+        } else if (link(entry.path().c_str(), target.c_str()) != 0) {
+            // 跨文件系统、硬链接数达到上限或者 protected_hardlinks 不允许时复制
+            if (errno != EXDEV && errno != EMLINK && errno != EPERM)
+                BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to link " + entry.path().string() + " to " + target.string()));
+            struct stat file_st;
+            if (stat(entry.path().c_str(), &file_st) != 0)
+                BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to stat " + entry.path().string()));
+            clone_file(entry.path(), target, file_st);
+        }
+    }
+
+    if (chmod(to.c_str(), st.st_mode & 07777) != 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to change mode of " + to.string()));
+}
+
 time_t last_write_time(const fs::path &path) {
     struct stat attr;
     if (stat(path.c_str(), &attr) != 0)
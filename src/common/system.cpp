@@ -3,6 +3,8 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
+#include <stdio.h>
+#include <sys/mount.h>
 
 int get_userid(const char *name)
 {
@@ -25,3 +27,19 @@ int get_groupid(const char *name)
     if (!g || errno) return -1;
     return (int) g->gr_gid;
 }
+
+int mount_tmpfs(const char *target, long size_kb)
+{
+    char options[64];
+
+    snprintf(options, sizeof(options), "size=%ldk,mode=0755", size_kb);
+    return mount("tmpfs", target, "tmpfs", MS_NOSUID | MS_NODEV, options);
+}
+
+int unmount_dir(const char *target)
+{
+    if (umount2(target, MNT_DETACH) == 0) return 0;
+    // target 不是挂载点
+    if (errno == EINVAL) return 0;
+    return -1;
+}
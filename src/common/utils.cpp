@@ -1,5 +1,6 @@
 #include "common/utils.hpp"
 
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <unistd.h>
 using namespace std;
@@ -16,6 +17,11 @@ process_builder &process_builder::awake_period(int period, std::function<void()>
     return *this;
 }
 
+process_builder &process_builder::output(const std::filesystem::path &file) {
+    this->output_file = file;
+    return *this;
+}
+
 int process_builder::exec_program(const char **argv) {
     // 使用 POSIX 提供的函数来实现外部程序调用
     pid_t pid;
@@ -29,6 +35,10 @@ int process_builder::exec_program(const char **argv) {
                 set_env(key, value);
             }
             if (epath) filesystem::current_path(path);
+            if (!output_file.empty()) {
+                int fd = open(output_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+                if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0) _exit(EXIT_FAILURE);
+            }
             execvp(argv[0], (char **)argv);
             _exit(EXIT_FAILURE);
         default:  // 父进程
@@ -16,6 +16,11 @@ filesystem::path CACHE_DIR;
 filesystem::path DATA_DIR;
 bool USE_DATA_DIR = false;
 filesystem::path RUN_DIR;
+bool TMPFS_RUN_DIR = false;
+bool STREAM_COMPARE = false;
+int BATCH_SIZE = 1;
+bool NATIVE_CHECK = false;
+bool VERDICT_CACHE = false;
 filesystem::path CHROOT_DIR;
 filesystem::path SCRIPT_DIR;
 bool DEBUG = false;
@@ -0,0 +1,202 @@
+#include "judge/checker_server.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include "common/defer.hpp"
+#include "common/utils.hpp"
+#include "config.hpp"
+#include "logging.hpp"
+
+namespace judge {
+using namespace std;
+
+static constexpr int REQUEST_FDS = 5;
+
+checker_server::checker_server(const filesystem::path &compare_dir, const string &cpuset, const filesystem::path &workdir)
+    : compare_dir(compare_dir), compare_time(filesystem::last_write_time(compare_dir / "run")) {
+    string runguard = get_env("RUNGUARD", "");
+    if (runguard.empty()) throw system_error(ENOENT, generic_category(), "RUNGUARD is not set");
+
+    // 清空上一个检查器的 overlayfs 上层
+    error_code ec;
+    filesystem::remove_all(workdir, ec);
+    filesystem::create_directories(workdir / "work" / "compare");
+    filesystem::create_directories(workdir / "ofs");
+    filesystem::create_directories(workdir / "merged");
+    filesystem::permissions(workdir / "ofs", filesystem::perms::all);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0)
+        throw system_error(errno, system_category(), "socketpair");
+
+    vector<string> args{runguard};
+    if (!get_env("DEBUG", "").empty()) args.push_back("-v");
+    if (!cpuset.empty()) args.insert(args.end(), {"-P", cpuset});
+    if (!get_env("ROOTLESS", "").empty()) args.push_back("--userns");
+    args.insert(args.end(), {
+        "--mount", "type=overlay,lower=" + CHROOT_DIR.string() + ",upper=" + (workdir / "work").string() + ",work=" + (workdir / "ofs").string() + ",target=" + (workdir / "merged").string(),
+        "--mount", "type=bind,source=" + compare_dir.string() + ",target=" + (workdir / "merged" / "compare").string() + ",ro",
+        "--mount", "type=bind,source=/proc,target=" + (workdir / "merged" / "proc").string(),
+        "--mount", "type=dev,target=" + (workdir / "merged" / "dev").string(),
+        "--root", (workdir / "merged").string(), "--work", "/compare", "--no-core-dumps",
+        "--user", get_env("RUNUSER", ""), "--group", get_env("RUNGROUP", ""),
+        "--memory-limit", to_string(SCRIPT_MEM_LIMIT), "--file-limit", to_string(SCRIPT_FILE_LIMIT),
+        "--standard-input-fd", to_string(fds[1]), "--standard-output-fd", to_string(fds[1]),
+        "--standard-error-file", (workdir / "server.err").string(), "--out-meta", (workdir / "server.meta").string(),
+        "-VONLINE_JUDGE=1", "-VCHECKER_TIME_LIMIT=" + to_string(SCRIPT_TIME_LIMIT), "--", "/compare/run"});
+
+    vector<char *> argv;
+    for (auto &arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    // runguard 的日志输出到标准输出
+    int logfd = open((workdir / "server.log").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    pid = fork();
+    if (pid == 0) {
+        if (logfd >= 0) {
+            dup2(logfd, STDOUT_FILENO);
+            dup2(logfd, STDERR_FILENO);
+        }
+        fcntl(fds[1], F_SETFD, 0);  // 只有检查器一端需要传给 runguard
+        execv(argv[0], argv.data());
+        _exit(EXIT_FAILURE);
+    }
+    int fork_errno = errno;
+    if (logfd >= 0) close(logfd);
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        throw system_error(fork_errno, system_category(), "unable to fork");
+    }
+    sock = fds[0];
+    LOG_INFO << "Started checker server " << compare_dir << " on cpuset " << cpuset << ", pid " << pid;
+}
+
+checker_server::~checker_server() {
+    stop();
+}
+
+void checker_server::stop() {
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+    if (pid > 0) {
+        // 检查器空闲时关闭 socket 就会退出，正在检查时需要 runguard 结束它
+        kill(pid, SIGTERM);
+        while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR)
+            ;
+        pid = -1;
+    }
+}
+
+bool checker_server::serves(const filesystem::path &dir) const {
+    error_code ec;
+    return sock >= 0 && dir == compare_dir && filesystem::last_write_time(dir / "run", ec) == compare_time && !ec;
+}
+
+optional<int> checker_server::check(const filesystem::path &input, const filesystem::path &user, const filesystem::path &answer,
+                                    const filesystem::path &feedback, const filesystem::path &error_file, int timeout) {
+    if (sock < 0) return nullopt;
+
+    int fds[REQUEST_FDS] = {
+        open(input.c_str(), O_RDONLY | O_CLOEXEC),
+        open(user.c_str(), O_RDONLY | O_CLOEXEC),
+        open(answer.c_str(), O_RDONLY | O_CLOEXEC),
+        open(feedback.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC),
+        open(error_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)};
+    defer {
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+    };
+    // 选手程序可能没有产生输出文件，与比较脚本一致视为空输出
+    if (fds[1] < 0) fds[1] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    for (int fd : fds)
+        if (fd < 0) return nullopt;
+
+    char data[] = "check";
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct iovec iov = {data, sizeof(data) - 1};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+        LOG_WARN << "Checker server " << compare_dir << " is gone: " << strerror(errno);
+        stop();
+        return nullopt;
+    }
+
+    struct pollfd pfd = {sock, POLLIN, 0};
+    int ret;
+    while ((ret = poll(&pfd, 1, timeout * 1000)) < 0 && errno == EINTR)
+        ;
+    if (ret == 0) {
+        LOG_WARN << "Checker server " << compare_dir << " did not reply in " << timeout << " seconds";
+        stop();
+        return -1;
+    }
+
+    char reply[16] = {};
+    ssize_t n = recv(sock, reply, sizeof(reply) - 1, 0);
+    if (n <= 0) {
+        LOG_WARN << "Checker server " << compare_dir << " exited unexpectedly";
+        stop();
+        return nullopt;
+    }
+    return atoi(reply);
+}
+
+bool has_checker_server(const filesystem::path &compare_dir) {
+    return filesystem::exists(compare_dir / ".server");
+}
+
+static mutex servers_mut;
+static map<string, unique_ptr<checker_server>> servers;  // 评测核心 -> 常驻检查器
+
+optional<int> check_with_server(const filesystem::path &compare_dir, const string &cpuset,
+                                const filesystem::path &input, const filesystem::path &user, const filesystem::path &answer,
+                                const filesystem::path &feedback, const filesystem::path &error_file) {
+    // 每个评测核心只有一个评测客户端，因此只有查找时需要加锁
+    unique_ptr<checker_server> *server;
+    {
+        scoped_lock guard(servers_mut);
+        server = &servers[cpuset];
+    }
+
+    if (!*server || !(*server)->serves(compare_dir)) {
+        server->reset();
+        try {
+            *server = make_unique<checker_server>(compare_dir, cpuset, RUN_DIR / "checker-server" / ("worker_" + cpuset));
+        } catch (exception &e) {
+            LOG_WARN << "Unable to start checker server " << compare_dir << ": " << e.what();
+            return nullopt;
+        }
+    }
+
+    // 检查器的每次检查受 CHECKER_TIME_LIMIT 的 CPU 时间限制，墙上时间与 runguard 的默认值一样放宽到 3 倍
+    optional<int> result = (*server)->check(input, user, answer, feedback, error_file, SCRIPT_TIME_LIMIT * 3);
+    if (!result) server->reset();
+    return result;
+}
+
+}  // namespace judge
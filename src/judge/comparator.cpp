@@ -0,0 +1,811 @@
+#include "judge/comparator.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+#include "common/exceptions.hpp"
+
+namespace judge {
+using namespace std;
+
+namespace {
+
+// 每比较这么多字节释放一次已经比较过的映射，控制比较大文件时的内存占用
+constexpr size_t RELEASE_CHUNK = 64 << 20;
+
+// 流式比较时，选手输出超过标准输出长度的两倍且至少多出这么多字节时直接判定为 Wrong Answer
+constexpr size_t STREAM_MARGIN = 1 << 20;
+
+/**
+ * @brief 与 diff --ignore-space-change 相同，换行符以外的 isspace 字符都视为空白字符
+ */
+inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * @brief 返回 a 和 b 第一个不同的字节的下标，完全相同时返回 n
+ */
+size_t mismatch_offset(const char *a, const char *b, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+        if (mask != 0xffff) return i + __builtin_ctz(~mask);
+    }
+#endif
+    for (; i < n && a[i] == b[i]; ++i)
+        ;
+    return i;
+}
+
+/**
+ * @brief 返回 [p, end) 中第一个空白字符的位置，没有时返回 end
+ */
+const char *find_space(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i lower = _mm_set1_epi8('\t' - 1);
+    const __m128i upper = _mm_set1_epi8('\r' + 1);
+    for (; p + 16 <= end; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        // 大于 127 的字节在有符号比较下是负数，不会落在 [\t, \r] 中
+        __m128i control = _mm_and_si128(_mm_cmpgt_epi8(x, lower), _mm_cmplt_epi8(x, upper));
+        if (int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, space), control)))
+            return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p < end && !is_space(*p); ++p)
+        ;
+    return p;
+}
+
+/**
+ * @brief 只读映射的文件
+ */
+struct mapped_file {
+    explicit mapped_file(const filesystem::path &path) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to open " + path.string()));
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int err = errno;
+            close(fd);
+            BOOST_THROW_EXCEPTION(system_error(err, system_category(), "unable to stat " + path.string()));
+        }
+        size = st.st_size;
+        if (size == 0) return;  // 不能映射长度为 0 的文件
+
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            BOOST_THROW_EXCEPTION(system_error(err, system_category(), "unable to map " + path.string()));
+        }
+        data = static_cast<const char *>(addr);
+        madvise(const_cast<char *>(data), size, MADV_SEQUENTIAL);
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    ~mapped_file() {
+        if (data) munmap(const_cast<char *>(data), size);
+        close(fd);
+    }
+
+    string_view view() const {
+        return {data, size};
+    }
+
+    /**
+     * @brief 释放 p 之前的映射页面，之后再访问这些页面会重新从页缓存读取
+     */
+    void release(const char *p) {
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t offset = (p - data) & ~(page_size - 1);
+        if (offset <= released) return;
+        madvise(const_cast<char *>(data) + released, offset - released, MADV_DONTNEED);
+        released = offset;
+    }
+
+private:
+    int fd = -1;
+    const char *data = nullptr;
+    size_t size = 0;
+    size_t released = 0;
+};
+
+// 预先规范化的标准输出中，每隔这么多字节的原始输入记录一个行首位置
+constexpr size_t INDEX_INTERVAL = 64 << 10;
+
+enum class normalization {
+    LOOSE,     // diff -b -Z -B --strip-trailing-cr：合并连续的空白字符，去掉行末空白字符和空行
+    TRAILING,  // diff -Z -B --strip-trailing-cr：去掉行末空白字符和空行
+    STRICT,    // diff --strip-trailing-cr：只去掉行末的 \r
+    IDENTITY   // 已经规范化的内容，原样输出
+};
+
+/**
+ * @brief 将输入逐行规范化，以若干段连续内容的形式输出，不复制输入
+ */
+struct normalized_stream {
+    normalized_stream(string_view data, normalization norm, mapped_file *source)
+        : cur(data.data()), end(data.data() + data.size()), norm(norm), source(source), unreleased(cur) {}
+
+    /**
+     * @brief 返回规范化后的下一段内容，输入结束时返回空
+     */
+    string_view next() {
+        if (norm == normalization::IDENTITY) {
+            if (cur == end) return {};
+            if (source && cur - unreleased >= (ptrdiff_t)RELEASE_CHUNK) {
+                source->release(cur);
+                unreleased = cur;
+            }
+            string_view chunk(cur, min<size_t>(end - cur, RELEASE_CHUNK));
+            cur += chunk.size();
+            return chunk;
+        }
+
+        while (true) {
+            if (in_line) {
+                if (pos == line_end) {
+                    in_line = false;
+                    // 严格比较时文件末尾是否有换行符也算作差异
+                    if (norm != normalization::STRICT || has_newline) return "\n";
+                    continue;
+                }
+                if (norm != normalization::LOOSE) {
+                    string_view content(pos, line_end - pos);
+                    pos = line_end;
+                    return content;
+                }
+                if (is_space(*pos)) {
+                    // 已经去掉了行末空白字符，空白字符后面一定还有其他字符
+                    while (is_space(*pos)) ++pos;
+                    return " ";
+                }
+                const char *token_end = find_space(pos, line_end);
+                string_view token(pos, token_end - pos);
+                pos = token_end;
+                return token;
+            }
+
+            if (cur == end) return {};
+            if (source && cur - unreleased >= (ptrdiff_t)RELEASE_CHUNK) {
+                source->release(cur);
+                unreleased = cur;
+            }
+
+            const char *line = cur;
+            const char *newline = static_cast<const char *>(memchr(cur, '\n', end - cur));
+            has_newline = newline != nullptr;
+            line_end = has_newline ? newline : end;
+            cur = has_newline ? newline + 1 : end;
+
+            // 与 diff --strip-trailing-cr 相同，没有换行符的最后一行不去掉 \r
+            if (has_newline && line_end > line && line_end[-1] == '\r') --line_end;
+            if (norm != normalization::STRICT) {
+                while (line_end > line && is_space(line_end[-1])) --line_end;
+                if (line_end == line) continue;  // 空行
+            }
+            pos = line;
+            in_line = true;
+        }
+    }
+
+    /**
+     * @brief 下一行的行首，当前行还没有输出完时返回空
+     */
+    const char *line_start() const {
+        return in_line ? nullptr : cur;
+    }
+
+private:
+    const char *cur, *end;  // 尚未处理的输入
+    normalization norm;
+    mapped_file *source;
+    const char *unreleased;
+
+    bool in_line = false;
+    bool has_newline = false;
+    const char *pos = nullptr, *line_end = nullptr;  // 当前行尚未输出的内容
+};
+
+/**
+ * @brief 预先规范化的标准输出（见 normalize_answer）及其行首位置索引
+ * 文件 <norm> 是规范化后的内容，<norm>.index 依次是原始标准输出的长度和修改时间（纳秒）、规范化后的长度，
+ * 以及若干对（原始输入中的行首位置，规范化结果中的对应位置），均为 uint64_t。
+ * 标准输出的长度或者修改时间改变时（如重新生成随机测试数据）规范化结果失效。
+ * 规范化是逐行进行的，因此从原始输入的任意行首开始规范化，结果与规范化结果中对应位置之后的内容相同。
+ */
+struct normalized_answer {
+    mapped_file content;
+    vector<pair<uint64_t, uint64_t>> index;
+
+    normalized_answer(const filesystem::path &file, vector<pair<uint64_t, uint64_t>> index)
+        : content(file), index(move(index)) {}
+
+    /**
+     * @brief 返回不超过原始输入位置 offset 的最后一个行首，以及它在规范化结果中的位置
+     */
+    pair<size_t, size_t> checkpoint(size_t offset) const {
+        auto it = upper_bound(index.begin(), index.end(), make_pair(uint64_t(offset), UINT64_MAX));
+        return it == index.begin() ? make_pair<size_t, size_t>(0, 0) : pair<size_t, size_t>(prev(it)->first, prev(it)->second);
+    }
+};
+
+const char *normalization_name(normalization norm) {
+    return norm == normalization::LOOSE ? "loose" : "trailing";
+}
+
+/**
+ * @brief 标准输出的长度和修改时间，用于确认规范化结果与标准输出对应
+ */
+bool answer_version(const filesystem::path &answer, uint64_t &size, uint64_t &mtime) {
+    struct stat st;
+    if (stat(answer.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief 读取预先规范化的标准输出，不存在或者与标准输出不对应时返回空
+ */
+unique_ptr<normalized_answer> load_normalized(const filesystem::path &dir, normalization norm, const filesystem::path &answer) {
+    uint64_t size, mtime;
+    if (dir.empty() || !answer_version(answer, size, mtime)) return nullptr;
+    filesystem::path file = dir / normalization_name(norm);
+    ifstream fin(file.string() + ".index", ios::binary);
+    uint64_t header[3];
+    if (!fin.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] != size || header[1] != mtime) return nullptr;
+
+    vector<pair<uint64_t, uint64_t>> index;
+    for (uint64_t entry[2]; fin.read(reinterpret_cast<char *>(entry), sizeof(entry));)
+        index.emplace_back(entry[0], entry[1]);
+    error_code ec;
+    if (filesystem::file_size(file, ec) != header[2] || ec) return nullptr;
+    try {
+        return make_unique<normalized_answer>(file, move(index));
+    } catch (system_error &) {
+        return nullptr;
+    }
+}
+
+bool normalized_equal(string_view user, normalization user_norm, string_view answer, normalization answer_norm, mapped_file *user_file, mapped_file *answer_file) {
+    normalized_stream a(user, user_norm, user_file), b(answer, answer_norm, answer_file);
+    string_view x, y;
+    while (true) {
+        if (x.empty()) x = a.next();
+        if (y.empty()) y = b.next();
+        if (x.empty() || y.empty()) return x.empty() && y.empty();
+
+        size_t n = min(x.size(), y.size());
+        if (mismatch_offset(x.data(), y.data(), n) != n) return false;
+        x.remove_prefix(n);
+        y.remove_prefix(n);
+    }
+}
+
+/**
+ * @brief 按空白字符切分出的词法单元流，不复制输入
+ */
+struct token_stream {
+    token_stream(string_view data, mapped_file *source)
+        : cur(data.data()), end(data.data() + data.size()), source(source), unreleased(cur) {}
+
+    /**
+     * @brief 返回下一个词法单元，输入结束时返回空
+     */
+    string_view next() {
+        while (cur != end && is_space(*cur)) ++cur;
+        if (cur == end) return {};
+        if (source && cur - unreleased >= (ptrdiff_t)RELEASE_CHUNK) {
+            source->release(cur);
+            unreleased = cur;
+        }
+        const char *token_end = find_space(cur, end);
+        string_view token(cur, token_end - cur);
+        cur = token_end;
+        return token;
+    }
+
+private:
+    const char *cur, *end;
+    mapped_file *source;
+    const char *unreleased;
+};
+
+/**
+ * @brief 一次检查 8 个字节是否都是数字
+ */
+inline bool is_eight_digits(uint64_t v) {
+    return !(((v + 0x4646464646464646) | (v - 0x3030303030303030)) & 0x8080808080808080);
+}
+
+/**
+ * @brief 将 8 个数字字符转换为整数，只需要 3 次乘法（按小端序读入）
+ */
+inline uint32_t parse_eight_digits(uint64_t v) {
+    const uint64_t mask = 0x000000FF000000FF;
+    const uint64_t mul1 = 0x000F424000000064;  // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001;  // 1 + (10000 << 32)
+    v -= 0x3030303030303030;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return uint32_t(v);
+}
+
+/**
+ * @brief 解析十进制实数 [+-]?(d+(.d*)?|.d+)([eE][+-]?d+)?，整个词法单元都必须是实数
+ * 有效数字不超过 19 位且指数较小时结果可以用一次乘除法精确得到，否则交给 strtod 保证正确舍入。
+ */
+optional<double> parse_number(string_view token) {
+    const char *p = token.data(), *end = p + token.size();
+    bool negative = false;
+    if (p != end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+
+    // 只累加前 19 位数字，超过 19 位时不会用到 mantissa
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    auto parse_digits = [&] {
+        const char *begin = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (uint64_t v; end - p >= 8 && digits + 8 <= 19; p += 8, digits += 8) {
+            memcpy(&v, p, 8);
+            if (!is_eight_digits(v)) break;
+            mantissa = mantissa * 100000000 + parse_eight_digits(v);
+        }
+#endif
+        for (; p != end && *p >= '0' && *p <= '9'; ++p, ++digits)
+            if (digits < 19) mantissa = mantissa * 10 + (*p - '0');
+        return int(p - begin);
+    };
+
+    int count = parse_digits();
+    if (p != end && *p == '.') {
+        ++p;
+        int fraction = parse_digits();
+        exponent -= fraction;
+        count += fraction;
+    }
+    if (count == 0) return nullopt;
+
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative_exponent = false;
+        if (p != end && (*p == '+' || *p == '-')) negative_exponent = *p++ == '-';
+        const char *begin = p;
+        int value = 0;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+            if (value < 100000) value = value * 10 + (*p - '0');
+        if (p == begin) return nullopt;
+        exponent += negative_exponent ? -value : value;
+    }
+    if (p != end) return nullopt;
+
+    // 尾数和 10 的幂都能用 double 精确表示时，一次乘除法的结果就是正确舍入的
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (digits > 19 || mantissa > (uint64_t(1) << 53) || exponent < -22 || exponent > 22)
+        return strtod(string(token).c_str(), nullptr);
+    double value = exponent < 0 ? double(mantissa) / powers[-exponent] : double(mantissa) * powers[exponent];
+    return negative ? -value : value;
+}
+
+/**
+ * @brief 比较两个词法单元，都是实数时允许误差
+ */
+bool token_equal(string_view user, string_view answer, const compare_options &options) {
+    if (user == answer) return true;
+    auto expected = parse_number(answer);
+    if (!expected) return false;
+    auto actual = parse_number(user);
+    if (!actual) return false;
+    if (!isfinite(*expected) || !isfinite(*actual)) return *expected == *actual;
+    double diff = fabs(*actual - *expected);
+    return diff <= options.absolute_error || diff <= options.relative_error * fabs(*expected);
+}
+
+bool tokens_equal(string_view user, string_view answer, const compare_options &options, mapped_file *user_file, mapped_file *answer_file) {
+    token_stream a(user, user_file), b(answer, answer_file);
+    while (true) {
+        string_view x = a.next(), y = b.next();
+        if (x.empty() || y.empty()) return x.empty() && y.empty();
+        if (!token_equal(x, y, options)) return false;
+    }
+}
+
+/**
+ * @param loose_answer, trailing_answer 预先规范化的标准输出，为空时同时规范化双方的输出
+ */
+compare_result compare_impl(string_view user, string_view answer, const compare_options &options, mapped_file *user_file, mapped_file *answer_file,
+                            normalized_answer *loose_answer = nullptr, normalized_answer *trailing_answer = nullptr) {
+    // 大部分正确的输出与标准输出完全相同，先逐字节比较，找到第一处差异
+    size_t n = min(user.size(), answer.size()), offset = 0;
+    while (offset < n) {
+        size_t chunk = min(n - offset, RELEASE_CHUNK);
+        size_t diff = mismatch_offset(user.data() + offset, answer.data() + offset, chunk);
+        offset += diff;
+        if (diff < chunk) break;
+        if (user_file) user_file->release(user.data() + offset);
+        if (answer_file) answer_file->release(answer.data() + offset);
+    }
+    if (offset == user.size() && offset == answer.size()) return compare_result::ACCEPTED;
+
+    // 规范化是逐行进行的，差异所在行之前的内容完全相同，只需要从差异所在行的行首开始比较
+    const void *newline = memrchr(user.data(), '\n', offset);
+    size_t line = newline ? static_cast<const char *>(newline) - user.data() + 1 : 0;
+
+    // 有预先规范化的标准输出时只规范化选手输出，从差异所在行之前最近的行首开始与规范化结果逐字节比较
+    auto equal = [&](normalization norm, normalized_answer *normalized) {
+        if (!normalized)
+            return normalized_equal(user.substr(line), norm, answer.substr(line), norm, user_file, answer_file);
+        auto [raw, pos] = normalized->checkpoint(line);
+        return normalized_equal(user.substr(raw), norm, normalized->content.view().substr(pos), normalization::IDENTITY, user_file, &normalized->content);
+    };
+
+    compare_mode mode = options.mode;
+    if (mode == compare_mode::FLOAT)
+        return tokens_equal(user.substr(line), answer.substr(line), options, user_file, answer_file) ? compare_result::ACCEPTED : compare_result::WRONG_ANSWER;
+
+    if (!equal(normalization::LOOSE, loose_answer))
+        return compare_result::WRONG_ANSWER;
+    if (mode == compare_mode::IGNORE_SPACE)
+        return compare_result::ACCEPTED;
+
+    bool same = mode == compare_mode::EXACT ? equal(normalization::STRICT, nullptr) : equal(normalization::TRAILING, trailing_answer);
+    return same ? compare_result::ACCEPTED : compare_result::PRESENTATION_ERROR;
+}
+
+/**
+ * @brief 流式比较中的一种规范化方式，选手输出逐行规范化后与标准输出规范化后的内容逐段比较
+ */
+struct stream_track {
+    /**
+     * @param answer_norm 标准输出的规范化方式，answer 是预先规范化的标准输出时为 IDENTITY
+     */
+    stream_track(string_view answer, normalization norm, normalization answer_norm, mapped_file *source)
+        : norm(norm), expected(answer, answer_norm, source) {}
+
+    /**
+     * @brief 比较选手输出的完整的一行（包括换行符），或者没有换行符的最后一行
+     */
+    void match(string_view line) {
+        if (!ok) return;
+        normalized_stream actual(line, norm, nullptr);
+        for (string_view x = actual.next(); !x.empty(); x = actual.next()) {
+            while (!x.empty()) {
+                if (pending.empty()) pending = expected.next();
+                size_t n = min(x.size(), pending.size());
+                if (n == 0 || mismatch_offset(x.data(), pending.data(), n) != n) {
+                    ok = false;
+                    return;
+                }
+                x.remove_prefix(n);
+                pending.remove_prefix(n);
+            }
+        }
+    }
+
+    /**
+     * @brief 选手输出结束时，标准输出也必须结束
+     */
+    bool finish() {
+        if (ok && pending.empty()) pending = expected.next();
+        return ok && pending.empty();
+    }
+
+    normalization norm;
+    normalized_stream expected;
+    string_view pending;  // 标准输出中尚未比较的内容
+    bool ok = true;
+};
+
+/**
+ * @brief 流式比较中的词法单元比较，用于 FLOAT 比较方式
+ */
+struct token_track {
+    token_track(string_view answer, const compare_options &options, mapped_file *source)
+        : options(options), expected(answer, source) {}
+
+    void match(string_view line) {
+        if (!ok) return;
+        token_stream actual(line, nullptr);
+        for (string_view x = actual.next(); !x.empty(); x = actual.next()) {
+            string_view y = expected.next();
+            if (y.empty() || !token_equal(x, y, options)) {
+                ok = false;
+                return;
+            }
+        }
+    }
+
+    bool finish() {
+        return ok && expected.next().empty();
+    }
+
+    compare_options options;
+    token_stream expected;
+    bool ok = true;
+};
+
+}  // namespace
+
+struct stream_comparator::impl {
+    impl(const filesystem::path &answer, const compare_options &options, const filesystem::path &normalized)
+        : answer_file(answer),
+          limit(answer_file.view().size() + max(answer_file.view().size(), STREAM_MARGIN)) {
+        if (!compares_output(options.mode)) BOOST_THROW_EXCEPTION(invalid_argument("Compare mode does not compare output"));
+        if (options.mode == compare_mode::FLOAT) {
+            tokens.emplace(answer_file.view(), options, &answer_file);
+            return;
+        }
+        add_track(loose, normalization::LOOSE, loose_answer, answer, normalized);
+        if (options.mode == compare_mode::IGNORE_TRAILING_SPACE)
+            add_track(strict, normalization::TRAILING, trailing_answer, answer, normalized);
+        else if (options.mode == compare_mode::EXACT)
+            strict.emplace(answer_file.view(), normalization::STRICT, normalization::STRICT, &answer_file);
+    }
+
+    /**
+     * @brief 有预先规范化的标准输出时直接与规范化结果比较
+     */
+    void add_track(optional<stream_track> &track, normalization norm, unique_ptr<normalized_answer> &answer,
+                   const filesystem::path &answer_path, const filesystem::path &normalized) {
+        answer = load_normalized(normalized, norm, answer_path);
+        if (answer)
+            track.emplace(answer->content.view(), norm, normalization::IDENTITY, &answer->content);
+        else
+            track.emplace(answer_file.view(), norm, norm, &answer_file);
+    }
+
+    void match(string_view line) {
+        if (tokens) tokens->match(line);
+        if (loose) loose->match(line);
+        if (strict) strict->match(line);
+    }
+
+    bool wrong_answer() const {
+        return received > limit || (tokens && !tokens->ok) || (loose && !loose->ok);
+    }
+
+    mapped_file answer_file;
+    unique_ptr<normalized_answer> loose_answer, trailing_answer;
+    size_t limit, received = 0;
+    optional<token_track> tokens;   // FLOAT 比较方式
+    optional<stream_track> loose;   // 决定是否为 Wrong Answer
+    optional<stream_track> strict;  // 决定是否为 Presentation Error
+    string partial_line;            // 选手输出中尚未结束的一行
+};
+
+stream_comparator::stream_comparator(const filesystem::path &answer, const compare_options &options, const filesystem::path &normalized)
+    : d(make_unique<impl>(answer, options, normalized)) {}
+
+stream_comparator::~stream_comparator() = default;
+
+bool stream_comparator::feed(string_view data) {
+    d->received += data.size();
+    while (!d->wrong_answer() && !data.empty()) {
+        const char *newline = static_cast<const char *>(memchr(data.data(), '\n', data.size()));
+        if (!newline) {
+            d->partial_line.append(data);
+            break;
+        }
+        size_t n = newline - data.data() + 1;
+        if (d->partial_line.empty()) {
+            d->match(data.substr(0, n));
+        } else {
+            d->partial_line.append(data.substr(0, n));
+            d->match(d->partial_line);
+            d->partial_line.clear();
+        }
+        data.remove_prefix(n);
+    }
+    return !d->wrong_answer();
+}
+
+compare_result stream_comparator::finish() {
+    if (d->wrong_answer()) return compare_result::WRONG_ANSWER;
+    if (!d->partial_line.empty()) {
+        d->match(d->partial_line);
+        d->partial_line.clear();
+    }
+    if (d->tokens && !d->tokens->finish()) return compare_result::WRONG_ANSWER;
+    if (d->loose && !d->loose->finish()) return compare_result::WRONG_ANSWER;
+    if (d->strict && !d->strict->finish()) return compare_result::PRESENTATION_ERROR;
+    return compare_result::ACCEPTED;
+}
+
+optional<compare_options> builtin_compare_options(const string &compare_script) {
+    static const map<string, compare_mode> modes = {
+        {"diff-all", compare_mode::EXACT},
+        {"diff-ign-space", compare_mode::IGNORE_SPACE},
+        {"diff-ign-trailing", compare_mode::IGNORE_TRAILING_SPACE},
+        {"float", compare_mode::FLOAT},
+        {"gtest", compare_mode::GTEST},
+        {"valgrind", compare_mode::VALGRIND}};
+
+    // float:<绝对误差>[:<相对误差>]
+    size_t colon = compare_script.find(':');
+    auto it = modes.find(compare_script.substr(0, colon));
+    if (it == modes.end()) return nullopt;
+
+    compare_options options(it->second);
+    if (colon == string::npos) return options;
+    if (options.mode != compare_mode::FLOAT)
+        throw invalid_argument("Compare script " + it->first + " accepts no parameters");
+
+    vector<double> errors;
+    for (size_t begin = colon + 1;; begin = colon + 1) {
+        colon = compare_script.find(':', begin);
+        string value = compare_script.substr(begin, colon == string::npos ? string::npos : colon - begin);
+        auto error = parse_number(value);
+        if (!error || *error < 0 || !isfinite(*error))
+            throw invalid_argument("Unrecognized tolerance " + value + " in compare script " + compare_script);
+        errors.push_back(*error);
+        if (colon == string::npos) break;
+    }
+    if (errors.size() > 2)
+        throw invalid_argument("Too many parameters in compare script " + compare_script);
+    options.absolute_error = errors.front();
+    options.relative_error = errors.back();
+    return options;
+}
+
+compare_result compare_output(string_view user, string_view answer, const compare_options &options) {
+    if (!compares_output(options.mode)) BOOST_THROW_EXCEPTION(invalid_argument("Compare mode does not compare output"));
+    return compare_impl(user, answer, options, nullptr, nullptr);
+}
+
+compare_result compare_files(const filesystem::path &user, const filesystem::path &answer, const compare_options &options, const filesystem::path &normalized) {
+    if (!compares_output(options.mode)) BOOST_THROW_EXCEPTION(invalid_argument("Compare mode does not compare output"));
+    mapped_file user_file(user), answer_file(answer);
+    unique_ptr<normalized_answer> loose, trailing;
+    if (options.mode != compare_mode::FLOAT) loose = load_normalized(normalized, normalization::LOOSE, answer);
+    if (options.mode == compare_mode::IGNORE_TRAILING_SPACE) trailing = load_normalized(normalized, normalization::TRAILING, answer);
+    return compare_impl(user_file.view(), answer_file.view(), options, &user_file, &answer_file, loose.get(), trailing.get());
+}
+
+/**
+ * @brief 将 answer 规范化后写入 file，并写入行首位置索引 file.index，先写入临时文件再重命名
+ */
+static void write_normalized(const filesystem::path &answer, normalization norm, const filesystem::path &file) {
+    uint64_t size, mtime;
+    if (!answer_version(answer, size, mtime))
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to stat " + answer.string()));
+    mapped_file answer_file(answer);
+    string_view data = answer_file.view();
+
+    filesystem::path temp = file, temp_index = file;
+    temp += ".tmp";
+    temp_index += ".index.tmp";
+    ofstream fout(temp, ios::binary), findex(temp_index, ios::binary);
+    uint64_t header[3] = {size, mtime, 0};
+    findex.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    normalized_stream stream(data, norm, &answer_file);
+    uint64_t written = 0, indexed = 0;
+    for (string_view piece = stream.next(); !piece.empty(); piece = stream.next()) {
+        fout.write(piece.data(), piece.size());
+        written += piece.size();
+        const char *line = stream.line_start();
+        if (line && uint64_t(line - data.data()) >= indexed + INDEX_INTERVAL) {
+            indexed = line - data.data();
+            uint64_t entry[2] = {indexed, written};
+            findex.write(reinterpret_cast<const char *>(entry), sizeof(entry));
+        }
+    }
+    header[2] = written;
+    findex.seekp(0);
+    findex.write(reinterpret_cast<const char *>(header), sizeof(header));
+    fout.close();
+    findex.close();
+    if (!fout || !findex)
+        BOOST_THROW_EXCEPTION(system_error(EIO, system_category(), "unable to write " + file.string()));
+
+    // 先重命名规范化结果，索引存在时规范化结果一定是完整的
+    filesystem::rename(temp, file);
+    filesystem::path index = file;
+    index += ".index";
+    filesystem::rename(temp_index, index);
+}
+
+void normalize_answer(const filesystem::path &answer, const filesystem::path &dir, const compare_options &options) {
+    vector<normalization> norms;
+    if (options.mode == compare_mode::EXACT || options.mode == compare_mode::IGNORE_SPACE || options.mode == compare_mode::IGNORE_TRAILING_SPACE)
+        norms.push_back(normalization::LOOSE);
+    if (options.mode == compare_mode::IGNORE_TRAILING_SPACE)
+        norms.push_back(normalization::TRAILING);
+    if (norms.empty()) return;
+
+    filesystem::create_directories(dir);
+    for (normalization norm : norms)
+        if (!load_normalized(dir, norm, answer))
+            write_normalized(answer, norm, dir / normalization_name(norm));
+}
+
+
+compare_result compare_fifo(const filesystem::path &fifo, const filesystem::path &answer, const compare_options &options,
+                            const atomic_bool &stop, const function<void()> &on_wrong_answer, const filesystem::path &normalized) {
+    // 以非阻塞方式打开，否则在选手程序打开管道之前会一直阻塞
+    int fd = open(fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        BOOST_THROW_EXCEPTION(system_error(errno, system_category(), "unable to open " + fifo.string()));
+    auto close_fd = [&] {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    };
+
+    // 无法读取标准输出时仍然要读完管道，否则选手程序会一直阻塞在打开管道上，直到超出 wall time 被误判为 TLE。
+    // 异常在选手程序的输出读取完毕后再抛出
+    optional<stream_comparator> comparator;
+    exception_ptr error;
+    try {
+        comparator.emplace(answer, options, normalized);
+    } catch (...) {
+        error = current_exception();
+    }
+
+    vector<char> buffer(1 << 16);
+    bool stopping = false;
+    while (true) {
+        // 写入端打开之前 poll 不会返回 POLLHUP，写入端关闭并且管道中的数据读完后才会返回 POLLHUP
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, stopping ? 0 : 100);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            close_fd();
+            BOOST_THROW_EXCEPTION(system_error(err, system_category(), "unable to poll " + fifo.string()));
+        }
+        if (ready == 0) {
+            // 评测结束后管道中已经没有数据，写入端也从没有打开过
+            if (stopping) break;
+            stopping = stop;
+            continue;
+        }
+
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            int err = errno;
+            close_fd();
+            BOOST_THROW_EXCEPTION(system_error(err, system_category(), "unable to read " + fifo.string()));
+        }
+        if (n == 0) break;  // 写入端已经关闭
+        if (comparator && !comparator->feed({buffer.data(), (size_t)n})) {
+            on_wrong_answer();
+            close_fd();
+            return compare_result::WRONG_ANSWER;
+        }
+    }
+    close_fd();
+    if (error) rethrow_exception(error);
+    return comparator->finish();
+}
+
+}  // namespace judge
@@ -1,6 +1,9 @@
 #include "judge/programming.hpp"
 
 #include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <boost/algorithm/algorithm.hpp>
 #include <boost/algorithm/string.hpp>
@@ -13,14 +16,20 @@
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
 #include "common/defer.hpp"
 #include "common/net_utils.hpp"
 #include "common/stl_utils.hpp"
+#include "common/system.hpp"
 #include "common/utils.hpp"
 #include "config.hpp"
+#include "judge/comparator.hpp"
+#include "judge/report_parser.hpp"
+#include "judge/standard_check.hpp"
 #include "logging.hpp"
 #include "runguard.hpp"
 #include "server/judge_server.hpp"
@@ -103,55 +112,179 @@ bool generate_random_data(const filesystem::path &datadir, const filesystem::pat
 }
 
 /**
- * @brief 执行程序评测任务
- * @param client_task 当前评测任务信息
- * @param submit 当前评测任务归属的选手提交信息
- * @param task 当前评测任务数据点的信息
- * @param execcpuset 当前评测任务能允许运行在那些 cpu 核心上
- * @param awake_callback 获取评测任务中途评测部分结果后的 callback，用于返回评测报告
+ * @brief 在依赖链上找到 taskid 依赖的下一个已经评测的测试点
+ * 依赖链优先使用 file_depends_on，没有时使用 depends_on
+ * @return 不存在时返回 -1
  */
-static judge_task_result judge_impl(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset, function<void()> awake_callback) {
-    LOG_INFO << "in the function judge_impl";  // debug
-    // 获取一个类似 5-random_check 的任务名，方便查找提交文件夹
-    string taskid = boost::lexical_cast<string>(client_task.id);
-    string taskname = task.tag;
-    boost::remove_if(taskname, boost::is_any_of("/\\"));
+static int next_file_dependency(programming_submission &submit, int taskid) {
+    const judge_task &task = submit.judge_tasks[taskid];
+    for (taskid = task.file_depends_on < 0 ? task.depends_on : task.file_depends_on;
+         taskid >= 0 && taskid < (int)submit.results.size();
+         taskid = submit.judge_tasks[taskid].file_depends_on < 0 ? submit.judge_tasks[taskid].depends_on : submit.judge_tasks[taskid].file_depends_on) {
+        // TODO: 暂时未静默跳过未完成测试的运行环境依赖
+        if (submit.results[taskid].status != status::PENDING) return taskid;
+    }
+    return -1;
+}
+
+/**
+ * @brief 获取依赖链从 taskid 开始的所有运行目录合并后的单层目录
+ * 依赖链上的运行目录原本作为多个 lowerdir 依次叠加，依赖链很长时（比如每个测试点依赖上一个测试点）
+ * overlayfs 的层数会超过内核限制，路径查找也会变慢。因此将 taskid 的运行目录与其依赖链的快照合并为一个快照，
+ * 快照通过硬链接共享文件，创建后不再修改，由所有依赖 taskid 的测试点共享，overlayfs 的层数保持不变。
+ * 层的顺序与原来的 lowerdir 一致：依赖链的根在最上层。
+ * @param taskid 已经评测的测试点
+ * @return 依赖链只有 taskid 时直接返回其运行目录
+ */
+static filesystem::path get_run_dir_snapshot(programming_submission &submit, int taskid) {
+    int next = next_file_dependency(submit, taskid);
+    if (next < 0) return submit.results[taskid].run_dir;
+
+    filesystem::path snapshot = get_work_dir(submit) / ("snapshot-" + to_string(taskid));
+    filesystem::path upper = get_run_dir_snapshot(submit, next);
+
+    scoped_lock guard(submit.snapshot_mut);
+    if (filesystem::exists(snapshot)) return snapshot;
+
+    // 先合并到临时文件夹再重命名，快照存在时一定是完整的
+    filesystem::path tmp = snapshot;
+    tmp += ".tmp";
+    filesystem::remove_all(tmp);
+    flatten_overlay_layers({upper, submit.results[taskid].run_dir}, tmp);
+    filesystem::rename(tmp, snapshot);
+    return snapshot;
+}
+
+/**
+ * @brief 结束 runguard 在叶子 cgroup judger/worker_<cpuset> 中运行的所有进程，仅支持 cgroup v2
+ */
+static void kill_worker_cgroup(const string &execcpuset) {
+    ofstream fout("/sys/fs/cgroup/judger/worker_" + execcpuset + "/cgroup.kill");
+    if (fout) fout << 1;
+}
+
+/**
+ * @brief 创建测试点的运行文件夹
+ * @param id 测试点编号
+ * @param taskname 返回类似 5-random_check 的任务名，方便查找提交文件夹
+ */
+static filesystem::path make_run_dir(programming_submission &submit, const judge_task &task, size_t id, string &taskname) {
+    string taskid = boost::lexical_cast<string>(id);
+    taskname = task.tag;
+    // 运行文件夹的路径会写入 batch.opt，去掉单引号以免破坏引号
+    taskname.erase(remove_if(taskname.begin(), taskname.end(), boost::is_any_of("/\\'")), taskname.end());
     boost::replace_all(taskname, " ", "_");
     if (taskname.empty())
         taskname = taskid + "-" + boost::lexical_cast<string>(boost::uuids::random_generator()());
     else
         taskname = taskid + "-" + taskname;
 
-    filesystem::path cachedir = get_cache_dir(submit);
     filesystem::path workdir = get_work_dir(submit);          // 本提交的工作文件夹
     filesystem::path rundir = workdir / ("run-" + taskname);  // 本测试点的运行文件夹
     filesystem::create_directories(rundir);
+    if (TMPFS_RUN_DIR && task.file_limit > 0) {
+        // 运行文件夹内除了选手程序的输出，还有标准错误输出、比较器的输出以及 overlayfs 的 upper 层，留出一些余量
+        long size_kb = task.file_limit * 2 + 65536;
+        if (mount_tmpfs(rundir.c_str(), size_kb) != 0)
+            LOG_WARN << "Unable to mount tmpfs on " << rundir << ": " << strerror(errno) << ", fall back to disk";
+    }
+    return rundir;
+}
 
-    judge_task_result result{task.tag, client_task.id};
-    result.run_dir = rundir;
+/**
+ * @brief DATA_DIR 中暂存的一份测试数据
+ * 同时评测的测试点经常使用同一份测试数据（同一道题的多个提交，或者同一提交中依赖同一测试数据的测试点），
+ * 因此每份测试数据只暂存一次，由使用它的测试点共享，最后一个测试点结束后删除。
+ */
+struct staged_data {
+    filesystem::path dir;  // 暂存的文件夹，由暂存顺序决定，不同的测试数据不会共用同一个文件夹
+    int refs = 0;          // 正在使用的测试点数量
+    bool ready = false;    // 暂存是否已经完成
+    mutex mut;             // 暂存测试数据期间加锁，其他测试点等待暂存完成
+};
 
-    auto &exec_mgr = submit.judge_server->get_executable_manager();
+static mutex staging_mut;
+static map<filesystem::path, shared_ptr<staged_data>> staging;  // 缓存中的测试数据文件夹 -> 暂存的测试数据
+static size_t staging_count = 0;                                // 已经创建的暂存文件夹数量
 
-    auto check_script = exec_mgr.get_check_script(task.check_script);
-    check_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
-    auto check_script_lock = check_script->shared_lock();
+/**
+ * @brief 释放 stage_data_dir 暂存的测试数据，没有测试点使用时删除
+ * @param source 暂存时传入的缓存中的测试数据文件夹
+ */
+static void release_data_dir(const filesystem::path &source) {
+    scoped_lock guard(staging_mut);
+    auto it = staging.find(source);
+    if (it == staging.end()) return;
+    if (--it->second->refs == 0) {
+        error_code ec;
+        filesystem::remove_all(it->second->dir, ec);
+        staging.erase(it);
+    }
+}
 
-    auto run_script = exec_mgr.get_run_script(task.run_script);
-    run_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
-    auto run_script_lock = run_script->shared_lock();
+/**
+ * @brief 将缓存中的测试数据暂存到 DATA_DIR 中，见 link_or_clone_directory
+ * 测试数据文件夹只作为 overlayfs 的 lowerdir 或者只读绑定，暂存的结果不会被修改，可以安全地共享。
+ * 暂存文件夹的名字包含进程号和序号，与其他测试数据以及共用 DATA_DIR 的其他评测客户端都不会冲突。
+ * @param source 缓存中的测试数据文件夹
+ * @return 暂存的测试数据文件夹，使用完后需要以 source 调用 release_data_dir
+ */
+static filesystem::path stage_data_dir(const filesystem::path &source) {
+    shared_ptr<staged_data> data;
+    {
+        scoped_lock guard(staging_mut);
+        auto &entry = staging[source];
+        if (!entry) {
+            entry = make_shared<staged_data>();
+            entry->dir = DATA_DIR / fmt::format("data-{}-{}", getpid(), staging_count++);
+        }
+        ++entry->refs;
+        data = entry;
+    }
 
-    unique_ptr<judge::program> exec_compare_script = exec_mgr.get_compare_script(task.compare_script);
-    auto &compare_script = task.compare_script.empty() && submit.compare ? submit.compare : exec_compare_script;
-    compare_script->fetch(execcpuset, cachedir / "compare", CHROOT_DIR, exec_mgr);
-    auto compare_script_lock = compare_script->shared_lock();
+    scoped_lock guard(data->mut);
+    if (!data->ready) {
+        try {
+            error_code ec;
+            filesystem::remove_all(data->dir, ec);  // 上一次暂存失败留下的文件
+            link_or_clone_directory(source, data->dir);
+        } catch (...) {
+            release_data_dir(source);
+            throw;
+        }
+        data->ready = true;
+    }
+    return data->dir;
+}
 
+/**
+ * @brief 为使用内置比较器的测试点预先规范化标准输出（见 normalize_answer），结果保存在测试数据文件夹的 normalized 中
+ * 需要持有测试数据文件夹的锁，规范化失败时比较时仍然可以同时规范化双方的输出，因此只记录日志
+ */
+static void prepare_normalized_answer(const programming_submission &submit, const judge_task &task, const filesystem::path &datadir) {
+    if (task.compare_script.empty() && submit.compare) return;
+    filesystem::path answer = datadir / "output" / "testdata.out";
+    try {
+        auto options = builtin_compare_options(task.compare_script);
+        if (options && filesystem::exists(answer)) normalize_answer(answer, datadir / "normalized", *options);
+    } catch (exception &e) {
+        LOG_WARN << "Unable to normalize " << answer << ": " << e.what();
+    }
+}
+
+/**
+ * @brief 准备测试点的输入输出数据
+ * 提交发生更新时，将直接清理整个文件夹内所有内容
+ * @return 测试数据文件夹，随机数据生成失败时返回空路径，此时 result 中保存了失败原因
+ */
+static filesystem::path prepare_data_dir(programming_submission &submit, judge_task &task, const string &execcpuset, judge_task_result &result) {
+    filesystem::path cachedir = get_cache_dir(submit);
     filesystem::path datadir;
 
     int depends_on = task.depends_on;
     judge_task *father = nullptr;
     if (depends_on >= 0) father = &submit.judge_tasks[depends_on];
 
-    // 获得输入输出数据，提交发生更新时，将直接清理整个文件夹内所有内容
     if (task.is_random) {
         // 生成随机测试数据
         filesystem::path random_data_dir = cachedir / "random_data";
@@ -174,7 +307,8 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
                 lock.release();
 
                 if (!generate_random_data(datadir, cachedir, number, submit, task, result, execcpuset))
-                    return result;
+                    return {};
+                prepare_normalized_answer(submit, task, datadir);
             } else {
                 int number = random(0, MAX_RANDOM_DATA_NUM - 1);
                 task.subcase_id = number;  // 标记当前测试点使用了哪个随机测试
@@ -185,8 +319,9 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
                 filesystem::path errorpath = datadir / ".error";  // 文件存在表示该组测试数据生成失败
                 if (filesystem::exists(errorpath)) {              // 该组测试数据生成失败则重试，如果仍然失败返回
                     if (!generate_random_data(datadir, cachedir, number, submit, task, result, execcpuset))
-                        return result;
+                        return {};
                 }
+                prepare_normalized_answer(submit, task, datadir);
             }
         }
     } else {
@@ -209,6 +344,7 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
                 for (auto &asset : test_data.outputs)
                     asset->fetch(datadir / "output");
             }
+            prepare_normalized_answer(submit, task, datadir);
         } else {  // 该数据点不需要测试数据
             datadir = standard_data_dir / "-1";
             // 创建一个空的数据文件夹提供给测试点使用
@@ -217,71 +353,134 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
             filesystem::create_directories(datadir / "output");
         }
     }
+    return datadir;
+}
 
-    if (USE_DATA_DIR) {  // 如果要拷贝测试数据，我们随机 UUID 并创建文件夹拷贝数据
-        filesystem::path newdir = DATA_DIR / taskname;
-        filesystem::copy(datadir, newdir, filesystem::copy_options::recursive);
-        datadir = newdir;
-    }
-    result.data_dir = datadir;
-
-    defer {  // 评测结束后删除拷贝的评测数据
-        if (USE_DATA_DIR) {
-            filesystem::remove(datadir);
+/**
+ * @brief 获取测试点的运行环境依赖的运行文件夹，检查脚本将其作为 overlayfs 的 lowerdir
+ * @return 多个文件夹用冒号隔开，不依赖其他测试点的运行环境时返回空
+ */
+static string get_base_dir(programming_submission &submit, size_t id, const string &taskname) {
+    string basedir;
+    if (int depend = next_file_dependency(submit, id); depend >= 0) {
+        try {
+            basedir = get_run_dir_snapshot(submit, depend).string();
+        } catch (exception &e) {
+            // 无法创建快照时退回到逐层叠加依赖链上的运行目录
+            LOG_WARN << "Unable to snapshot run directories that " << taskname << " depends on: " << e.what();
+            vector<string> basedirs;
+            for (; depend >= 0; depend = next_file_dependency(submit, depend))
+                basedirs.push_back(submit.results[depend].run_dir.string());
+            reverse(basedirs.begin(), basedirs.end());
+            basedir = boost::algorithm::join(basedirs, ":");
         }
-    };
-
-    process_builder pb;
-    pb.directory(rundir);
-    if (task.file_limit > 0) pb.environment("FILELIMIT", task.file_limit);
-    if (task.memory_limit > 0) pb.environment("MEMLIMIT", task.memory_limit);
-    if (task.proc_limit > 0) pb.environment("PROCLIMIT", task.proc_limit);
-
-    if (task.actions.size() && task.action_delay > 0) {
-        LOG_INFO << "task.action_delay = " << task.action_delay;  // debug
-        pb.awake_period(task.action_delay, [&]() {
-            result.actions.clear();
-            for (auto &action : task.actions) {
-                action_result res;
-                res.tag = action.tag;
-                res.success = action.act(submit, task, result, res.result);
-                result.actions.push_back(res);
-            }
-
-            awake_callback();
-        });
     }
+    return basedir;
+}
 
-    vector<string> basedirs;
-    for (int taskid = task.file_depends_on < 0 ? task.depends_on : task.file_depends_on;
-         taskid >= 0 && taskid < (int)submit.results.size();
-         taskid = submit.judge_tasks[taskid].file_depends_on < 0 ? submit.judge_tasks[taskid].depends_on : submit.judge_tasks[taskid].file_depends_on) {
-        // TODO: 暂时未静默跳过未完成测试的运行环境依赖
-        if (submit.results[taskid].status == status::PENDING) continue;
-        basedirs.push_back(submit.results[taskid].run_dir.string());
+/**
+ * @brief 获取测试点使用的内置比较方式，并设置检查脚本需要的环境变量
+ * 比较脚本是 diff、float、gtest 或 valgrind 时使用内置比较器，省去启动比较脚本（以及 Python 解释器）的开销，需要检查脚本支持 SKIP_COMPARE
+ * @return 不使用内置比较器时返回空
+ */
+static optional<compare_options> setup_builtin_compare(programming_submission &submit, const judge_task &task, const filesystem::path &check_script_dir, process_builder &pb) {
+    optional<compare_options> builtin_compare;
+    if (!(task.compare_script.empty() && submit.compare))
+        builtin_compare = builtin_compare_options(task.compare_script);
+    if (builtin_compare && builtin_compare->mode == compare_mode::FLOAT) {
+        pb.environment("FLOAT_ABS_ERROR", builtin_compare->absolute_error);
+        pb.environment("FLOAT_REL_ERROR", builtin_compare->relative_error);
     }
-    reverse(basedirs.begin(), basedirs.end());
+    if (builtin_compare && !filesystem::exists(check_script_dir / ".builtin_compare"))
+        builtin_compare.reset();
+    if (builtin_compare) pb.environment("SKIP_COMPARE", 1);
+    return builtin_compare;
+}
+
+/**
+ * @brief 调用 check script 来执行真正的评测，这里会调用 run script 运行选手程序，调用 compare script 运行比较器，并返回评测结果
+ * <check-script> <datadir> <timelimit> <chrootdir> <workdir> <basedir> <run-uuid> <compile-script> <run-script> <compare-script> <source files> <assist files> <run args>
+ * @return check script 的返回值
+ */
+static int run_check_script(process_builder &pb, programming_submission &submit, const judge_task &task, const string &execcpuset,
+                            const filesystem::path &check_script, const filesystem::path &run_script, const filesystem::path &compare_script,
+                            const filesystem::path &datadir, const string &basedir, const string &taskname) {
+    auto &exec_mgr = submit.judge_server->get_executable_manager();
 
     optional<string> walltime;
     if (execcpuset.find(",") != string::npos || execcpuset.find("-") != string::npos)
         walltime = "-w";
 
-    LOG_INFO << "in the function judge_impl: before pb.run";  // debug
+    return pb.run(check_script / "run",
+                  "-n", execcpuset, "--",
+                  walltime,
+                  datadir, task.time_limit, CHROOT_DIR, get_work_dir(submit),
+                  basedir,
+                  taskname,
+                  get_run_path(submit.submission->get_compile_script(exec_mgr)),
+                  run_script,
+                  compare_script,
+                  boost::algorithm::join(submit.submission->source_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
+                  boost::algorithm::join(submit.submission->assist_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
+                  task.run_args);
+}
+
+/**
+ * @brief 使用内置检查流程代替 standard 和 standard-trusted 检查脚本，参数与 run_check_script 一一对应
+ * @return 与 check script 相同的返回值
+ */
+static int run_standard_check(programming_submission &submit, const judge_task &task, const string &execcpuset, const filesystem::path &rundir,
+                              const filesystem::path &run_script, const filesystem::path &compare_script,
+                              const filesystem::path &datadir, const string &basedir, bool skip_compare, bool stream_compare) {
+    auto &exec_mgr = submit.judge_server->get_executable_manager();
+
+    standard_check_options opt;
+    opt.trusted = task.check_script == "standard-trusted";
+    opt.rundir = rundir;
+    opt.datadir = datadir;
+    opt.chrootdir = CHROOT_DIR;
+    opt.basedir = basedir;
+    opt.compile_script = get_run_path(submit.submission->get_compile_script(exec_mgr));
+    opt.run_script = run_script;
+    opt.compare_script = compare_script;
+    opt.run_args = task.run_args;
+    opt.cpuset = execcpuset;
+    opt.wall_time = execcpuset.find(",") != string::npos || execcpuset.find("-") != string::npos;
+    opt.time_limit = task.time_limit;
+    opt.memory_limit = task.memory_limit;
+    opt.file_limit = task.file_limit;
+    opt.proc_limit = task.proc_limit;
+    opt.skip_compare = skip_compare;
+    opt.stream_compare = stream_compare;
+
+    // 与 setup_builtin_compare 一致，float 比较脚本通过环境变量获得误差
+    optional<compare_options> float_compare;
+    if (!(task.compare_script.empty() && submit.compare))
+        float_compare = builtin_compare_options(task.compare_script);
+    if (float_compare && float_compare->mode == compare_mode::FLOAT) {
+        opt.compare_env.push_back("FLOAT_ABS_ERROR=" + boost::lexical_cast<string>(float_compare->absolute_error));
+        opt.compare_env.push_back("FLOAT_REL_ERROR=" + boost::lexical_cast<string>(float_compare->relative_error));
+    }
+
+    // 只有固定测试数据的题目可以缓存比较结果：随机测试的输入数据每次不同，没有题目编号的提交不缓存题目数据，
+    // 依赖其他测试点（file_depends_on）时比较程序还能读取 basedir 中本次提交的其他输出，也不缓存。
+    // 题目缓存文件夹在题目更新时被清空，比较程序被重新编译时 run 的修改时间也会改变
+    error_code ec;
+    auto compare_time = filesystem::last_write_time(compare_script / "run", ec);
+    if (VERDICT_CACHE && !skip_compare && !task.is_random && task.testcase_id >= 0 && !submit.prob_id.empty() && basedir.empty() && !ec) {
+        string compare_id = task.compare_script.empty() ? "custom" : task.compare_script;
+        replace(compare_id.begin(), compare_id.end(), '/', '_');
+        opt.verdict_cache = get_cache_dir(submit) / "verdicts" / compare_id / to_string(task.testcase_id) /
+                            to_string(compare_time.time_since_epoch().count());
+    }
 
-    // 调用 check script 来执行真正的评测，这里会调用 run script 运行选手程序，调用 compare script 运行比较器，并返回评测结果
-    // <check-script> <datadir> <timelimit> <chrootdir> <workdir> <basedir> <run-uuid> <compile-script> <run-script> <compare-script> <source files> <assist files> <run args>
-    int ret = pb.run(check_script->get_run_path() / "run",
-                     "-n", execcpuset, "--",
-                     walltime,
-                     datadir, task.time_limit, CHROOT_DIR, workdir,
-                     boost::algorithm::join(basedirs, ":"),
-                     taskname,
-                     get_run_path(submit.submission->get_compile_script(exec_mgr)),
-                     run_script->get_run_path(),
-                     compare_script->get_run_path(cachedir / "compare"),
-                     boost::algorithm::join(submit.submission->source_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
-                     boost::algorithm::join(submit.submission->assist_files | boost::adaptors::transformed([](auto &a) { return a->name; }), ":"),
-                     task.run_args);
+    return standard_check(opt);
+}
+
+/**
+ * @brief 根据 check script 的返回值设置评测结果，并读取运行文件夹中的报告和错误信息
+ */
+static void set_check_result(int ret, const filesystem::path &rundir, judge_task_result &result) {
     result.report = read_file_content(rundir / "feedback" / "report.txt", "");
     result.error_log = read_file_content(rundir / "system.out", "No detailed information", judge::MAX_IO_SIZE);
     switch (ret) {
@@ -338,10 +537,54 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
             result.status = status::SYSTEM_ERROR;
             break;
     }
+}
+
+/**
+ * @brief 用内置比较器的比较结果修正评测结果
+ */
+static void set_compare_result(judge_task_result &result, compare_result res) {
+    switch (res) {
+        case compare_result::ACCEPTED:
+            break;
+        case compare_result::WRONG_ANSWER:
+            result.status = status::WRONG_ANSWER;
+            result.score = 0;
+            break;
+        case compare_result::PRESENTATION_ERROR:
+            result.status = status::PRESENTATION_ERROR;
+            result.score = 0;
+            break;
+    }
+}
 
-    auto metadata = read_runguard_result(rundir / "program.meta");
+/**
+ * @brief 检查脚本跳过了比较，程序正常结束时返回 E_ACCEPTED，此时由内置比较器比较选手输出文件
+ */
+static void compare_output_file(const compare_options &options, const filesystem::path &rundir, const filesystem::path &datadir, judge_task_result &result) {
+    if (result.status != status::ACCEPTED) return;
+    try {
+        // gtest 和 valgrind 转换选手程序运行文件夹中的 XML 报告，返回值与比较脚本相同
+        if (options.mode == compare_mode::GTEST)
+            set_check_result(convert_gtest_report(rundir / "run" / "test_detail.xml", rundir / "feedback"), rundir, result);
+        else if (options.mode == compare_mode::VALGRIND)
+            set_check_result(convert_valgrind_report(rundir / "run" / "valgrind.xml", rundir / "feedback"), rundir, result);
+        else
+            set_compare_result(result, compare_files(rundir / "run" / "testdata.out", datadir / "output" / "testdata.out", options, datadir / "normalized"));
+    } catch (exception &e) {
+        result.status = status::COMPARE_ERROR;
+        result.score = 0;
+        result.error_log += string("\n") + e.what();
+    }
+}
+
+/**
+ * @brief 读取 runguard 记录的运行时间、内存和资源采样，并执行测试点的操作
+ */
+static void collect_run_result(programming_submission &submit, judge_task &task, judge_task_result &result) {
+    auto metadata = read_runguard_result(result.run_dir / "program.meta", result.run_dir / "program.record");
     result.run_time = metadata.wall_time;  // TODO: 支持题目选择 cpu_time 或者 wall_time 进行时间
     result.memory_used = metadata.memory;
+    result.samples = read_runguard_samples(result.run_dir / "program.samples");
 
     result.actions.clear();
     for (auto &action : task.actions) {
@@ -350,10 +593,242 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
         res.success = action.act(submit, task, result, res.result);
         result.actions.push_back(res);
     }
+}
+
+/**
+ * @brief 执行程序评测任务
+ * @param client_task 当前评测任务信息
+ * @param submit 当前评测任务归属的选手提交信息
+ * @param task 当前评测任务数据点的信息
+ * @param execcpuset 当前评测任务能允许运行在那些 cpu 核心上
+ * @param awake_callback 获取评测任务中途评测部分结果后的 callback，用于返回评测报告
+ */
+static judge_task_result judge_impl(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset, function<void()> awake_callback) {
+    LOG_INFO << "in the function judge_impl";  // debug
+    string taskname;
+    filesystem::path cachedir = get_cache_dir(submit);
+    filesystem::path rundir = make_run_dir(submit, task, client_task.id, taskname);
+
+    judge_task_result result{task.tag, client_task.id};
+    result.run_dir = rundir;
+
+    auto &exec_mgr = submit.judge_server->get_executable_manager();
+
+    auto check_script = exec_mgr.get_check_script(task.check_script);
+    check_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
+    auto check_script_lock = check_script->shared_lock();
+
+    auto run_script = exec_mgr.get_run_script(task.run_script);
+    run_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
+    auto run_script_lock = run_script->shared_lock();
+
+    // 比较脚本 id 中冒号后面是内置比较器的参数（如 float:1e-4），比较脚本本身通过环境变量获得参数
+    unique_ptr<judge::program> exec_compare_script = exec_mgr.get_compare_script(task.compare_script.substr(0, task.compare_script.find(':')));
+    auto &compare_script = task.compare_script.empty() && submit.compare ? submit.compare : exec_compare_script;
+    compare_script->fetch(execcpuset, cachedir / "compare", CHROOT_DIR, exec_mgr);
+    auto compare_script_lock = compare_script->shared_lock();
+
+    // 获得输入输出数据
+    filesystem::path sourcedir = prepare_data_dir(submit, task, execcpuset, result);
+    if (sourcedir.empty()) return result;
+    // 将测试数据暂存到 DATA_DIR，同一份测试数据同时只暂存一份
+    filesystem::path datadir = USE_DATA_DIR ? stage_data_dir(sourcedir) : sourcedir;
+    result.data_dir = datadir;
+
+    defer {  // 评测结束后释放暂存的评测数据
+        if (USE_DATA_DIR) {
+            release_data_dir(sourcedir);
+        }
+    };
+
+    process_builder pb;
+    pb.directory(rundir);
+    if (task.file_limit > 0) pb.environment("FILELIMIT", task.file_limit);
+    if (task.memory_limit > 0) pb.environment("MEMLIMIT", task.memory_limit);
+    if (task.proc_limit > 0) pb.environment("PROCLIMIT", task.proc_limit);
+
+    if (task.actions.size() && task.action_delay > 0) {
+        LOG_INFO << "task.action_delay = " << task.action_delay;  // debug
+        pb.awake_period(task.action_delay, [&]() {
+            result.actions.clear();
+            for (auto &action : task.actions) {
+                action_result res;
+                res.tag = action.tag;
+                res.success = action.act(submit, task, result, res.result);
+                result.actions.push_back(res);
+            }
+
+            awake_callback();
+        });
+    }
+
+    string basedir = get_base_dir(submit, client_task.id, taskname);
+
+    optional<compare_options> builtin_compare = setup_builtin_compare(submit, task, check_script->get_run_path(), pb);
+
+    // 流式比较：选手程序的标准输出写入命名管道，评测系统边读取边比较，确定答案错误时立即结束选手程序
+    filesystem::path output_fifo;
+    if (builtin_compare && STREAM_COMPARE && compares_output(builtin_compare->mode)) {
+        output_fifo = rundir / "run" / ".stdout";
+        error_code ec;
+        filesystem::create_directories(rundir / "run", ec);
+        if (!ec) filesystem::permissions(rundir / "run", filesystem::perms::all, ec);
+        // mkfifo 受 umask 影响，选手程序以其他用户运行，需要可写
+        if (ec || mkfifo(output_fifo.c_str(), 0666) != 0 || chmod(output_fifo.c_str(), 0666) != 0) {
+            LOG_WARN << "Unable to create output pipe " << output_fifo << ", fall back to comparing output file";
+            output_fifo.clear();
+        } else {
+            pb.environment("STREAM_COMPARE", 1);
+        }
+    }
+
+    atomic_bool program_exited = false;
+    bool killed_by_comparator = false;
+    future<compare_result> stream_result;
+    if (!output_fifo.empty()) {
+        stream_result = async(launch::async, [&, options = *builtin_compare] {
+            return compare_fifo(output_fifo, datadir / "output" / "testdata.out", options, program_exited, [&] {
+                killed_by_comparator = true;
+                kill_worker_cgroup(execcpuset);
+            }, datadir / "normalized");
+        });
+    }
+    defer {  // 必须在等待 stream_result 之前通知比较线程选手程序已经结束，否则管道从未被打开时比较线程不会退出
+        program_exited = true;
+    };
+
+    LOG_INFO << "in the function judge_impl: before pb.run";  // debug
+
+    // 中途执行操作依赖 process_builder 的定时唤醒，这种测试点仍然使用 check script
+    int ret;
+    if (NATIVE_CHECK && !(task.actions.size() && task.action_delay > 0) && has_standard_check(task.check_script, run_script->get_run_path()))
+        ret = run_standard_check(submit, task, execcpuset, rundir,
+                                 run_script->get_run_path(), compare_script->get_run_path(cachedir / "compare"),
+                                 datadir, basedir, builtin_compare.has_value(), !output_fifo.empty());
+    else
+        ret = run_check_script(pb, submit, task, execcpuset,
+                               check_script->get_run_path(), run_script->get_run_path(), compare_script->get_run_path(cachedir / "compare"),
+                               datadir, basedir, taskname);
+    set_check_result(ret, rundir, result);
+
+    if (stream_result.valid()) {
+        program_exited = true;
+        try {
+            compare_result res = stream_result.get();
+            // 被比较器结束的选手程序会因为信号退出，此时以比较结果为准
+            if (killed_by_comparator || result.status == status::ACCEPTED) set_compare_result(result, res);
+        } catch (exception &e) {
+            if (result.status == status::ACCEPTED) {
+                result.status = status::COMPARE_ERROR;
+                result.score = 0;
+                result.error_log += string("\n") + e.what();
+            }
+        }
+        // 依赖本测试点的测试点不能再打开这个管道
+        error_code ec;
+        filesystem::remove(output_fifo, ec);
+    } else if (builtin_compare) {
+        compare_output_file(*builtin_compare, rundir, datadir, result);
+    }
 
+    collect_run_result(submit, task, result);
     return result;
 }
 
+/**
+ * @brief 批量执行多个测试点的程序评测任务
+ * 这些测试点除了测试数据以外完全相同（见 batchable），因此只需要启动一次 check script：
+ * 环境变量 BATCH_CASES 指向的文件中每行是一个测试点的运行文件夹和测试数据文件夹，
+ * check script 在一次 runguard 中依次运行各测试点，并将每个测试点的返回值写入其运行文件夹下的 check.exitcode。
+ * 批量评测不支持流式比较和中途执行操作。
+ * @param ids 同一批的测试点编号
+ * @return 与 ids 一一对应的评测结果
+ */
+static vector<judge_task_result> judge_batch_impl(programming_submission &submit, const vector<size_t> &ids, const string &execcpuset) {
+    judge_task &task = submit.judge_tasks[ids.front()];  // 同一批测试点的脚本和限制都相同
+    filesystem::path cachedir = get_cache_dir(submit);
+
+    auto &exec_mgr = submit.judge_server->get_executable_manager();
+
+    auto check_script = exec_mgr.get_check_script(task.check_script);
+    check_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
+    auto check_script_lock = check_script->shared_lock();
+
+    auto run_script = exec_mgr.get_run_script(task.run_script);
+    run_script->fetch(execcpuset, CHROOT_DIR, exec_mgr);
+    auto run_script_lock = run_script->shared_lock();
+
+    unique_ptr<judge::program> exec_compare_script = exec_mgr.get_compare_script(task.compare_script.substr(0, task.compare_script.find(':')));
+    auto &compare_script = task.compare_script.empty() && submit.compare ? submit.compare : exec_compare_script;
+    compare_script->fetch(execcpuset, cachedir / "compare", CHROOT_DIR, exec_mgr);
+    auto compare_script_lock = compare_script->shared_lock();
+
+    vector<judge_task_result> results;
+    vector<string> tasknames(ids.size());
+    vector<size_t> cases;                 // 测试数据准备好的测试点在 ids 中的下标
+    vector<filesystem::path> sourcedirs;  // 已经暂存的测试数据在缓存中的文件夹
+    defer {  // 评测结束后释放暂存的评测数据
+        for (auto &sourcedir : sourcedirs)
+            release_data_dir(sourcedir);
+    };
+    for (size_t i = 0; i < ids.size(); ++i) {
+        judge_task &kase = submit.judge_tasks[ids[i]];
+        results.emplace_back(kase.tag, ids[i]);
+        results[i].run_dir = make_run_dir(submit, kase, ids[i], tasknames[i]);
+        results[i].data_dir = prepare_data_dir(submit, kase, execcpuset, results[i]);
+        if (results[i].data_dir.empty()) continue;
+        if (USE_DATA_DIR) {
+            filesystem::path sourcedir = results[i].data_dir;
+            results[i].data_dir = stage_data_dir(sourcedir);
+            sourcedirs.push_back(sourcedir);
+        }
+        cases.push_back(i);
+    }
+
+    if (cases.empty()) return results;
+
+    // 批量评测文件夹存放 check script 和 runguard 自身的输出，每个测试点的输出仍然在各自的运行文件夹中
+    filesystem::path batchdir = get_work_dir(submit) / ("batch-" + tasknames[cases.front()]);
+    filesystem::create_directories(batchdir);
+    {
+        ofstream fout(batchdir / "cases");
+        for (size_t i : cases)
+            fout << results[i].run_dir.string() << '\t' << results[i].data_dir.string() << '\n';
+    }
+
+    process_builder pb;
+    pb.directory(batchdir);
+    if (task.file_limit > 0) pb.environment("FILELIMIT", task.file_limit);
+    if (task.memory_limit > 0) pb.environment("MEMLIMIT", task.memory_limit);
+    if (task.proc_limit > 0) pb.environment("PROCLIMIT", task.proc_limit);
+    pb.environment("BATCH_CASES", (batchdir / "cases").string());
+
+    optional<compare_options> builtin_compare = setup_builtin_compare(submit, task, check_script->get_run_path(), pb);
+
+    int ret = run_check_script(pb, submit, task, execcpuset,
+                               check_script->get_run_path(), run_script->get_run_path(), compare_script->get_run_path(cachedir / "compare"),
+                               results[cases.front()].data_dir, get_base_dir(submit, ids.front(), tasknames[cases.front()]), tasknames[cases.front()]);
+    if (ret != 0)
+        LOG_WARN << "Batch check script exited with " << ret << ": " << read_file_content(batchdir / "system.out", "No detailed information", judge::MAX_IO_SIZE);
+
+    for (size_t i : cases) {
+        judge_task_result &result = results[i];
+        ifstream fin(result.run_dir / "check.exitcode");
+        int case_ret;
+        if (!(fin >> case_ret)) {
+            // check script 在运行到这个测试点之前就失败了
+            result.status = status::SYSTEM_ERROR;
+            result.error_log = read_file_content(batchdir / "system.out", "No detailed information", judge::MAX_IO_SIZE);
+            continue;
+        }
+
+        set_check_result(case_ret, result.run_dir, result);
+        if (builtin_compare) compare_output_file(*builtin_compare, result.run_dir, result.data_dir, result);
+        collect_run_result(submit, submit.judge_tasks[ids[i]], result);
+    }
+    return results;
+}
+
 static void compile(judge::program *program, const filesystem::path &workdir, const string &execcpuset, const executable_manager &exec_mgr, const program_limit &limit, judge_task_result &task_result, bool executable) {
     try {
         // 将程序存放在 workdir 下，program->fetch 会自行组织 workdir 内的文件存储结构
@@ -403,7 +878,7 @@ static judge_task_result compile(const message::client_task &client_task, progra
         result.run_dir = workdir / "compile";
         compile(submit.submission.get(), workdir, execcpuset, exec_mgr, task, result, false);
 
-        auto metadata = read_runguard_result(result.run_dir / "compile.meta");
+        auto metadata = read_runguard_result(result.run_dir / "compile.meta", result.run_dir / "compile.record");
         result.run_time = metadata.wall_time;
         result.memory_used = metadata.memory;
         if (result.status != status::ACCEPTED) return result;
@@ -540,6 +1015,54 @@ bool programming_judger::verify(submission &submit) const {
     return true;
 }
 
+/**
+ * @brief 两个测试点能否合并为一批评测
+ * 只有除测试数据以外完全相同的测试点才能合并。随机测试需要在运行前生成数据，
+ * 中途执行操作、使用多个核心的测试点需要单独的检查脚本进程，因此都不合并。
+ */
+static bool batchable(const judge_task &a, const judge_task &b) {
+    return !a.is_random && !b.is_random && a.actions.empty() && b.actions.empty() && a.cores == 1 && b.cores == 1 &&
+           a.check_script == b.check_script && a.run_script == b.run_script && a.compare_script == b.compare_script &&
+           a.depends_on == b.depends_on && a.file_depends_on == b.file_depends_on &&
+           a.time_limit == b.time_limit && a.memory_limit == b.memory_limit && a.file_limit == b.file_limit && a.proc_limit == b.proc_limit &&
+           a.run_args == b.run_args;
+}
+
+/**
+ * @brief 发送可以开始评测的评测任务
+ * 开启批量评测且检查脚本支持时（检查脚本文件夹中存在 .batch），可以合并的评测任务每 BATCH_SIZE 个只发送一个评测消息，
+ * 同一批的其他评测任务记录在 submit.batches 中。调用者需要持有 submit.mut。
+ * @param ready 可以开始评测的评测任务
+ */
+static void dispatch(concurrent_queue<message::client_task> &task_queue, programming_submission &submit, const vector<size_t> &ready) {
+    vector<bool> dispatched(ready.size());
+    for (size_t i = 0; i < ready.size(); ++i) {
+        if (dispatched[i]) continue;
+        size_t id = ready[i];
+        judge_task &task = submit.judge_tasks[id];
+
+        vector<size_t> batch{id};
+        if (BATCH_SIZE > 1 && !task.check_script.empty() && filesystem::exists(EXEC_DIR / "check" / task.check_script / ".batch")) {
+            for (size_t j = i + 1; j < ready.size() && (int)batch.size() < BATCH_SIZE; ++j) {
+                if (!dispatched[j] && batchable(task, submit.judge_tasks[ready[j]])) {
+                    dispatched[j] = true;
+                    batch.push_back(ready[j]);
+                }
+            }
+        }
+
+        for (size_t k : batch) submit.results[k].status = status::RUNNING;
+        judge::message::client_task client_task = {
+            .submit = &submit,
+            .id = id,
+            .name = task.tag,
+            .cores = task.cores,
+            .expect_runtime = task.time_limit * 5 * batch.size()};
+        if (batch.size() > 1) submit.batches[id] = move(batch);
+        task_queue.push(client_task);
+    }
+}
+
 bool programming_judger::distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const {
     LOG_DEBUG << "Programming judger start to distribute.";
 
@@ -566,18 +1089,13 @@ bool programming_judger::distribute(concurrent_queue<message::client_task> &task
     }
 
     // 寻找没有依赖的评测点，并发送评测消息
-    for (size_t i = 0; i < sub.judge_tasks.size(); ++i) {
-        if (sub.judge_tasks[i].depends_on < 0) {  // 不依赖任何任务的任务可以直接开始评测
-            sub.results[i].status = status::RUNNING;
-            judge::message::client_task client_task = {
-                .submit = &submit,
-                .id = i,
-                .name = sub.judge_tasks[i].tag,
-                .cores = sub.judge_tasks[i].cores,
-                .expect_runtime = sub.judge_tasks[i].time_limit * 5};
-            task_queue.push(client_task);
-        }
-    }
+    vector<size_t> ready;
+    for (size_t i = 0; i < sub.judge_tasks.size(); ++i)
+        if (sub.judge_tasks[i].depends_on < 0)  // 不依赖任何任务的任务可以直接开始评测
+            ready.push_back(i);
+
+    scoped_lock guard(sub.mut);
+    dispatch(task_queue, sub, ready);
     return true;
 }
 
@@ -605,7 +1123,17 @@ static void summarize(programming_submission &submit) {
                 break;
             }
         }
-        if (!getenv("RESERVE_SUBMISSION") && removedir) filesystem::remove_all(workdir);
+        if (!getenv("RESERVE_SUBMISSION") && removedir) {
+            // 先卸载运行文件夹上的 tmpfs，否则 remove_all 只能清空而无法删除挂载点
+            if (TMPFS_RUN_DIR) {
+                for (auto &result : submit.results)
+                    if (!result.run_dir.empty() && unmount_dir(result.run_dir.c_str()) != 0)
+                        LOG_ERROR << "Unable to unmount " << result.run_dir << ": " << strerror(errno);
+            }
+            filesystem::remove_all(workdir);
+        } else if (TMPFS_RUN_DIR) {
+            LOG_WARN << "Submission directory " << workdir << " is reserved, tmpfs mounted on its run directories should be unmounted manually";
+        }
     } catch (exception &e) {
         LOG_ERROR << "Unable to delete directory " << workdir << ":" << e.what();
     }
@@ -632,6 +1160,7 @@ void process(const programming_judger &judger, concurrent_queue<message::client_
     if (result.status == status::SYSTEM_ERROR)
         LOG_ERROR << "Testcase error: " << result.error_log;
 
+    vector<size_t> ready;
     for (size_t i = 0; i < submit.judge_tasks.size(); ++i) {
         judge_task &kase = submit.judge_tasks[i];
         // 寻找依赖当前评测任务的评测任务
@@ -659,14 +1188,7 @@ void process(const programming_judger &judger, concurrent_queue<message::client_
 
             if (satisfied) {
                 // 评测任务 i 的依赖关系满足予以评测
-                submit.results[i].status = status::RUNNING;
-                judge::message::client_task client_task = {
-                    .submit = &submit,
-                    .id = i,
-                    .name = kase.tag,
-                    .cores = kase.cores,
-                    .expect_runtime = submit.judge_tasks[i].time_limit * 5};
-                testcase_queue.push(client_task);
+                ready.push_back(i);
             } else {
                 // 评测任务 i 的依赖关系不满足，由于依赖关系是树，因此将子树全部设置为 DEPENDENCY_NOT_SATISFIED
                 judge_task_result next_result;
@@ -684,6 +1206,8 @@ void process(const programming_judger &judger, concurrent_queue<message::client_
         }
     }
 
+    dispatch(testcase_queue, submit, ready);
+
     ++submit.finished;
 
     LOG_INFO << "in function process: submit.finished = " << submit.finished << " submit.judge_tasks.size() = " << submit.judge_tasks.size();  // debug
@@ -724,6 +1248,37 @@ void programming_judger::judge(const message::client_task &client_task, concurre
 
     LOG_DEBUG << "Judge: task.check_script = " << task.check_script;
 
+    vector<size_t> batch;
+    {
+        scoped_lock guard(submit->mut);
+        if (auto it = submit->batches.find(client_task.id); it != submit->batches.end()) {
+            batch = move(it->second);
+            submit->batches.erase(it);
+        }
+    }
+
+    if (!batch.empty()) {
+        vector<judge_task_result> results;
+        try {
+            results = judge_batch_impl(*submit, batch, execcpuset);
+        } catch (exception &ex) {
+            results.clear();
+            for (size_t id : batch) {
+                judge_task_result &result = results.emplace_back(submit->judge_tasks[id].tag, id);
+                result.status = status::SYSTEM_ERROR;
+                result.error_log = ex.what();
+            }
+        }
+
+        auto end = chrono::system_clock::now();
+
+        scoped_lock guard(submit->mut);
+        // 最后一个测试点的 process 可能结束整个提交，只有它需要汇总
+        for (size_t i = 0; i < results.size(); ++i)
+            process(*this, task_queue, *submit, results[i], (end - begin) / results.size(), i + 1 == results.size());
+        return;
+    }
+
     try {
         if (task.check_script == "compile")
             result = compile(client_task, *submit, task, execcpuset);
@@ -0,0 +1,447 @@
+#include "judge/report_parser.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "nlohmann/json.hpp"
+
+namespace judge {
+using namespace std;
+using ordered_json = nlohmann::ordered_json;
+
+namespace {
+
+// 与 exec/compare/gtest 一致，最多报告 10 个失败的测试组，消息最长 1000 个字符
+constexpr size_t MAX_GTEST_REPORTS = 10;
+constexpr size_t MAX_GTEST_MESSAGE = 1000;
+
+// XML 文件可能被选手程序改写，限制嵌套深度防止递归解析耗尽栈空间
+constexpr int MAX_XML_DEPTH = 256;
+
+/**
+ * @brief 逐个读取 XML 的标签和文本
+ * 只支持评测需要的子集：元素、属性、文本、CDATA、预定义实体和字符引用，跳过声明、注释和 DOCTYPE。
+ */
+class xml_reader {
+public:
+    enum class token {
+        START,  // 开始标签，name 和 attributes 有效；自闭合标签之后紧跟一个 END
+        END,    // 结束标签，name 有效
+        TEXT,   // 文本或者 CDATA，text 有效
+        DONE    // 文件结束
+    };
+
+    explicit xml_reader(istream &in) : buf(*in.rdbuf()) {}
+
+    token next() {
+        if (pending_end) {
+            pending_end = false;
+            return token::END;
+        }
+        // 跳过声明和注释时继续读取下一个标记，不使用递归，防止大量注释耗尽栈空间
+        while (true) {
+            int c = buf.sgetc();
+            if (c == EOF) return token::DONE;
+            if (c != '<') {
+                text.clear();
+                while ((c = buf.sgetc()) != EOF && c != '<') {
+                    buf.sbumpc();
+                    if (c == '&') text += read_entity();
+                    else text += (char)c;
+                }
+                return token::TEXT;
+            }
+
+            buf.sbumpc();
+            c = get();
+            if (c == '?') {
+                skip_until("?>");
+                continue;
+            } else if (c == '!') {
+                if (consume("--")) {
+                    skip_until("-->");
+                    continue;
+                } else if (consume("[CDATA[")) {
+                    text = read_until("]]>");
+                    return token::TEXT;
+                }
+                skip_until(">");  // <!DOCTYPE ...>
+                continue;
+            } else if (c == '/') {
+                name = read_name();
+                skip_space();
+                expect('>');
+                return token::END;
+            }
+
+            buf.sungetc();
+            name = read_name();
+            attributes.clear();
+            while (true) {
+                skip_space();
+                c = get();
+                if (c == '>') break;
+                if (c == '/') {
+                    expect('>');
+                    pending_end = true;
+                    break;
+                }
+                buf.sungetc();
+                string key = read_name();
+                skip_space();
+                expect('=');
+                skip_space();
+                int quote = get();
+                if (quote != '"' && quote != '\'') fail("quote expected");
+                string value;
+                while ((c = get()) != quote) {
+                    if (c == '&') value += read_entity();
+                    else value += (char)c;
+                }
+                attributes.emplace_back(move(key), move(value));
+            }
+            return token::START;
+        }
+    }
+
+    string name, text;
+    vector<pair<string, string>> attributes;
+
+private:
+    [[noreturn]] void fail(const string &reason) {
+        throw runtime_error("Malformed XML: " + reason);
+    }
+
+    int get() {
+        int c = buf.sbumpc();
+        if (c == EOF) fail("unexpected end of file");
+        return c;
+    }
+
+    void expect(char expected) {
+        if (get() != expected) fail(string("'") + expected + "' expected");
+    }
+
+    void skip_space() {
+        int c;
+        while ((c = buf.sgetc()) == ' ' || c == '\t' || c == '\r' || c == '\n') buf.sbumpc();
+    }
+
+    string read_name() {
+        string result;
+        int c;
+        while ((c = buf.sgetc()) != EOF && c != '>' && c != '/' && c != '=' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            result += (char)c;
+            buf.sbumpc();
+        }
+        if (result.empty()) fail("name expected");
+        return result;
+    }
+
+    /**
+     * @brief 如果接下来的字符是 s，跳过它们并返回 true。只用于 <! 之后，不匹配时不需要回退
+     */
+    bool consume(const char *s) {
+        for (; *s; ++s) {
+            if (buf.sgetc() != *s) return false;
+            buf.sbumpc();
+        }
+        return true;
+    }
+
+    string read_until(const string &end) {
+        string result;
+        while (result.size() < end.size() || result.compare(result.size() - end.size(), end.size(), end) != 0)
+            result += (char)get();
+        result.resize(result.size() - end.size());
+        return result;
+    }
+
+    void skip_until(const string &end) {
+        size_t matched = 0;
+        while (matched < end.size()) {
+            char c = get();
+            matched = c == end[matched] ? matched + 1 : (c == end[0] ? 1 : 0);
+        }
+    }
+
+    /**
+     * @brief 读取 & 之后的实体，返回对应的 UTF-8 字符
+     */
+    string read_entity() {
+        string entity;
+        int c;
+        while ((c = get()) != ';') {
+            entity += (char)c;
+            if (entity.size() > 10) fail("entity too long");
+        }
+        if (entity == "lt") return "<";
+        if (entity == "gt") return ">";
+        if (entity == "amp") return "&";
+        if (entity == "quot") return "\"";
+        if (entity == "apos") return "'";
+        if (entity.size() < 2 || entity[0] != '#') fail("unknown entity &" + entity + ";");
+
+        uint32_t code;
+        try {
+            size_t pos;
+            bool hex = entity[1] == 'x' || entity[1] == 'X';
+            code = stoul(entity.substr(hex ? 2 : 1), &pos, hex ? 16 : 10);
+            if (pos + (hex ? 2 : 1) != entity.size()) throw invalid_argument(entity);
+        } catch (logic_error &) {
+            fail("invalid character reference &" + entity + ";");
+        }
+        string utf8;
+        if (code < 0x80) {
+            utf8 += (char)code;
+        } else if (code < 0x800) {
+            utf8 += (char)(0xc0 | (code >> 6));
+            utf8 += (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            utf8 += (char)(0xe0 | (code >> 12));
+            utf8 += (char)(0x80 | ((code >> 6) & 0x3f));
+            utf8 += (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x110000) {
+            utf8 += (char)(0xf0 | (code >> 18));
+            utf8 += (char)(0x80 | ((code >> 12) & 0x3f));
+            utf8 += (char)(0x80 | ((code >> 6) & 0x3f));
+            utf8 += (char)(0x80 | (code & 0x3f));
+        } else {
+            fail("invalid character reference &" + entity + ";");
+        }
+        return utf8;
+    }
+
+    streambuf &buf;
+    bool pending_end = false;
+};
+
+/**
+ * @brief 跳过声明和空白文本，读取根元素的开始标签
+ */
+void read_root(xml_reader &reader) {
+    while (true) {
+        switch (reader.next()) {
+            case xml_reader::token::START:
+                return;
+            case xml_reader::token::TEXT:
+                continue;
+            default:
+                throw runtime_error("Malformed XML: no root element");
+        }
+    }
+}
+
+string strip(const string &s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == string::npos) return "";
+    return s.substr(begin, s.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+/**
+ * @brief 按 xmltodict 的规则读取当前元素（开始标签已经读取）直到对应的结束标签
+ * 属性为 @ 开头的键，同名子元素合并为列表，只有文本的元素为字符串，空元素为 null，
+ * 既有文本又有属性或子元素时文本为 #text
+ */
+ordered_json read_element(xml_reader &reader, int depth) {
+    if (depth > MAX_XML_DEPTH) throw runtime_error("Malformed XML: elements are nested too deeply");
+
+    ordered_json obj = ordered_json::object();
+    for (auto &[key, value] : reader.attributes) obj["@" + key] = value;
+    string text;
+    while (true) {
+        switch (reader.next()) {
+            case xml_reader::token::START: {
+                string name = reader.name;
+                ordered_json child = read_element(reader, depth + 1);
+                auto it = obj.find(name);
+                if (it == obj.end()) {
+                    obj[name] = move(child);
+                } else {
+                    if (!it->is_array()) *it = ordered_json::array({move(*it)});
+                    it->push_back(move(child));
+                }
+                break;
+            }
+            case xml_reader::token::TEXT:
+                text += reader.text;
+                break;
+            case xml_reader::token::END: {
+                text = strip(text);
+                if (obj.empty()) return text.empty() ? ordered_json(nullptr) : ordered_json(text);
+                if (!text.empty()) obj["#text"] = text;
+                return obj;
+            }
+            case xml_reader::token::DONE:
+                throw runtime_error("Malformed XML: unexpected end of file");
+        }
+    }
+}
+
+/**
+ * @brief 与比较脚本中的 as_list 一致：字段不存在时设为空列表，不是列表时包装为列表
+ */
+ordered_json &as_list(ordered_json &obj, const string &field) {
+    if (!obj.is_object()) throw runtime_error("Unexpected valgrind output: " + field + " is not found");
+    if (!obj.contains(field)) return obj[field] = ordered_json::array();
+    ordered_json &value = obj[field];
+    if (!value.is_array()) value = ordered_json::array({move(value)});
+    return value;
+}
+
+/**
+ * @brief 与 Python 的 textwrap.shorten 一致：合并连续的空白字符，超出 width 时在单词边界截断并添加 " [...]"
+ */
+string shorten(const string &s, size_t width) {
+    vector<string> words;
+    size_t length = 0;
+    for (size_t i = 0; i < s.size();) {
+        size_t begin = s.find_first_not_of(" \t\r\n\v\f", i);
+        if (begin == string::npos) break;
+        size_t end = s.find_first_of(" \t\r\n\v\f", begin);
+        if (end == string::npos) end = s.size();
+        words.push_back(s.substr(begin, end - begin));
+        length += words.size() > 1 ? end - begin + 1 : end - begin;
+        i = end;
+    }
+
+    string result;
+    if (length <= width) {
+        for (auto &word : words) result += (result.empty() ? "" : " ") + word;
+        return result;
+    }
+
+    const string placeholder = " [...]";
+    for (auto &word : words) {
+        size_t next = result.size() + (result.empty() ? 0 : 1) + word.size();
+        if (next + placeholder.size() > width) break;
+        result += (result.empty() ? "" : " ") + word;
+    }
+    // 第一个单词就超长时 textwrap.shorten 只返回去掉前导空格的 "[...]"
+    return result.empty() ? placeholder.substr(1) : result + placeholder;
+}
+
+string attribute(const xml_reader &reader, const string &key, bool required) {
+    for (auto &[name, value] : reader.attributes)
+        if (name == key) return value;
+    if (required) throw runtime_error("Unexpected gtest output: @" + key + " is not found in " + reader.name);
+    return "";
+}
+
+}  // namespace
+
+int convert_gtest_report(const filesystem::path &xml, const filesystem::path &feedback) {
+    // 与比较脚本一致，即使没有生成 XML 文件也创建 report.txt 和 score.txt
+    ofstream report(feedback / "report.txt"), score(feedback / "score.txt");
+    ifstream in(xml, ios::binary);
+    if (!in) throw runtime_error("Unable to open " + xml.string());
+
+    xml_reader reader(in);
+    read_root(reader);
+    if (reader.name != "testsuites") throw runtime_error("Unexpected gtest output: testsuites is not found");
+
+    string failures = attribute(reader, "failures", true);
+    string time = attribute(reader, "time", true);
+    int error_cases;
+    try {
+        error_cases = stoi(failures);
+    } catch (logic_error &) {
+        throw runtime_error("Unexpected gtest output: invalid failures " + failures);
+    }
+
+    int pass_cases = 0, disabled_cases = 0;
+    ordered_json reports = ordered_json::array();
+
+    // 只关心 testsuites > testsuite > testcase > failure，其他元素（如 properties）跳过
+    int depth = 1;
+    string suite, testcase, param;
+    bool notrun = false, failed = false;
+    string message;
+    for (auto tok = reader.next(); tok != xml_reader::token::DONE && depth > 0; tok = reader.next()) {
+        if (tok == xml_reader::token::START) {
+            ++depth;
+            if (depth > MAX_XML_DEPTH) throw runtime_error("Malformed XML: elements are nested too deeply");
+            if (depth == 2 && reader.name == "testsuite") {
+                suite = attribute(reader, "name", true);
+            } else if (depth == 3 && reader.name == "testcase") {
+                testcase = attribute(reader, "name", true);
+                param = attribute(reader, "value_param", false);
+                notrun = attribute(reader, "status", false) == "notrun";
+                failed = false;
+                message.clear();
+            } else if (depth == 4 && reader.name == "failure") {
+                // 只记录第一个失败，没有属性的空 failure 在 xmltodict 中为 None，视为通过
+                if (!failed && !reader.attributes.empty()) {
+                    failed = true;
+                    message = attribute(reader, "message", false);
+                }
+            }
+        } else if (tok == xml_reader::token::TEXT) {
+            if (depth == 4 && !failed && !strip(reader.text).empty()) failed = true;
+        } else if (tok == xml_reader::token::END) {
+            if (depth == 3 && reader.name == "testcase") {
+                if (notrun) {
+                    ++disabled_cases;
+                } else if (!failed) {
+                    ++pass_cases;
+                } else if (reports.size() < MAX_GTEST_REPORTS) {
+                    reports.push_back({{"suite", suite},
+                                       {"case", testcase},
+                                       {"name", suite + "/" + testcase},
+                                       {"message", shorten(message, MAX_GTEST_MESSAGE)},
+                                       {"param", shorten(param, MAX_GTEST_MESSAGE)}});
+                }
+            }
+            --depth;
+        }
+    }
+    if (depth > 0) throw runtime_error("Malformed XML: unexpected end of file");
+
+    int total_cases = pass_cases + error_cases;
+    ordered_json result = {{"total_cases", total_cases},
+                           {"pass_cases", pass_cases},
+                           {"error_cases", error_cases},
+                           {"disabled_cases", disabled_cases},
+                           {"time", time},
+                           {"report", reports},
+                           {"type", "gtest"}};
+    report << result.dump(4);
+
+    if (error_cases == 0) return E_ACCEPTED;
+    if (pass_cases == 0) return E_WRONG_ANSWER;
+    score << pass_cases << " " << total_cases;
+    return E_PARTIAL_CORRECT;
+}
+
+int convert_valgrind_report(const filesystem::path &xml, const filesystem::path &feedback) {
+    ofstream report(feedback / "report.txt");
+    ifstream in(xml, ios::binary);
+    if (!in) throw runtime_error("Unable to open " + xml.string());
+
+    xml_reader reader(in);
+    read_root(reader);
+    if (reader.name != "valgrindoutput") throw runtime_error("Internal error: valgrindoutput is not found during parsing memory check result");
+    ordered_json output = read_element(reader, 1);
+
+    // 没有 error 时认为是正确的
+    if (!output.is_object() || !output.contains("error")) return E_ACCEPTED;
+
+    for (auto &error : as_list(output, "error")) {
+        for (auto &stack : as_list(error, "stack")) {
+            for (auto &frame : as_list(stack, "frame")) {
+                if (!frame.is_object()) continue;
+                frame.erase("obj");
+                frame.erase("dir");
+            }
+        }
+    }
+    report << output.dump(4);
+    return E_WRONG_ANSWER;
+}
+
+}  // namespace judge
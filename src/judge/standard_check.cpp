@@ -0,0 +1,350 @@
+#include "judge/standard_check.hpp"
+
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <fstream>
+
+#include "common/utils.hpp"
+#include "config.hpp"
+#include "judge/checker_server.hpp"
+#include "judge/verdict_cache.hpp"
+#include "runguard.hpp"
+
+namespace judge {
+using namespace std;
+
+// 比较脚本的返回值，与 exec/utils/utils.sh 一致
+static constexpr int RESULT_AC = 42;
+static constexpr int RESULT_WA = 43;
+static constexpr int RESULT_PE = 44;
+static constexpr int RESULT_PC = 54;
+
+static string get_env_or_empty(const char *key) {
+    const char *value = getenv(key);
+    return value ? value : "";
+}
+
+/**
+ * @brief 创建文件夹并设置权限，相当于 mkdir -m <perms> -p
+ */
+static void make_dir(const filesystem::path &dir, filesystem::perms perms) {
+    filesystem::create_directories(dir);
+    filesystem::permissions(dir, perms);
+}
+
+/**
+ * @brief 创建空文件，文件存在时不修改内容，相当于 touch
+ */
+static void touch(const filesystem::path &file) {
+    ofstream fout(file, ios::app);
+}
+
+/**
+ * @brief 递归修改文件夹内所有文件的权限，相当于 chmod -R
+ */
+static void change_mode_recursive(const filesystem::path &dir, filesystem::perms perms, filesystem::perm_options opts) {
+    error_code ec;
+    filesystem::permissions(dir, perms, opts, ec);
+    for (auto it = filesystem::recursive_directory_iterator(dir, ec); !ec && it != filesystem::recursive_directory_iterator(); it.increment(ec))
+        if (!it->is_symlink()) filesystem::permissions(it->path(), perms, opts, ec);
+}
+
+/**
+ * @brief 将比较脚本以选手用户身份写入的文件改为属于评测系统，相当于 chown -R "$(id -un):"
+ * rootless 模式下文件本来就属于评测系统用户，不需要（也无法）修改
+ */
+static void own_recursive(const filesystem::path &dir) {
+    if (!get_env_or_empty("ROOTLESS").empty()) return;
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+    error_code ec;
+    lchown(dir.c_str(), uid, gid);
+    for (auto it = filesystem::recursive_directory_iterator(dir, ec); !ec && it != filesystem::recursive_directory_iterator(); it.increment(ec))
+        lchown(it->path().c_str(), uid, gid);
+}
+
+bool has_standard_check(const string &check_script, const filesystem::path &run_script) {
+    if (check_script == "standard-trusted") return true;
+    return check_script == "standard" && !filesystem::exists(run_script / ".landlock");
+}
+
+int program_verdict(const filesystem::path &metafile, bool check_exit_code, string &message) {
+    if (access(metafile.c_str(), R_OK) != 0) {
+        message = "Error: '" + metafile.filename().string() + "' is not readable";
+        return E_INTERNAL_ERROR;
+    }
+    error_code ec;
+    if (filesystem::file_size(metafile, ec) == 0) {
+        message = "\n****************runguard crash*****************";
+        return E_INTERNAL_ERROR;
+    }
+
+    auto meta = read_runguard_meta(metafile);
+    string usage = fmt::format("    runtime: {}s cpu, {}s wall\n    memory used: {} bytes", meta["cpu-time"], meta["wall-time"], meta["memory-bytes"]);
+    auto verdict = [&](const string &what, int code) {
+        message = what + "\n" + usage;
+        return code;
+    };
+
+    if (!meta["internal-error"].empty())
+        return verdict("Internal Error", E_INTERNAL_ERROR);
+    if (meta["time-result"].find("timelimit") != string::npos)
+        return verdict("Time Limit Exceeded", E_TIME_LIMIT);
+    if (boost::starts_with(meta["memory-result"], "oom"))
+        return verdict("Memory Limit Exceeded", E_MEM_LIMIT);
+
+    vector<string> truncated;
+    boost::split(truncated, meta["output-truncated"], boost::is_any_of(","));
+    if (find(truncated.begin(), truncated.end(), "stdout") != truncated.end())
+        return verdict("Output Limit Exceeded", E_OUTPUT_LIMIT);
+
+    if (!meta["signal"].empty()) {
+        int signal = -1;
+        try {
+            signal = boost::lexical_cast<int>(meta["signal"]);
+        } catch (boost::bad_lexical_cast &) {
+        }
+        switch (signal) {
+            case 11:  // SIGSEGV
+                return verdict("Segmentation Fault", E_SEG_FAULT);
+            case 8:  // SIGFPE
+                return verdict("Floating Point Exception", E_FLOATING_POINT);
+            case 9:  // SIGKILL
+                return verdict("Memory Limit Exceeded", E_MEM_LIMIT);
+            case 31:  // SIGSYS
+                return verdict("Restrict Function", E_RESTRICT_FUNCTION);
+            default:
+                return verdict("Runtime Error", E_RUNTIME_ERROR);
+        }
+    }
+
+    // 我们不检查信任的选手程序的返回值，比如 C 程序的 main 函数没有写 return 会导致返回值非零，这种不是崩溃导致的
+    if (check_exit_code && !meta["exitcode"].empty() && meta["exitcode"] != "0")
+        return verdict("Non-zero exitcode " + meta["exitcode"], E_RUNTIME_ERROR);
+
+    message = usage;
+    return E_ACCEPTED;
+}
+
+int standard_check(const standard_check_options &opt) {
+    filesystem::path systemout = filesystem::absolute(opt.rundir / "system.out");  // 子进程会切换到运行文件夹
+    ofstream log(systemout, ios::app);
+    auto say = [&](const string &text) { log << text << endl; };  // 子进程也会写入 system.out，必须及时刷新
+    auto append = [&](const filesystem::path &file) {
+        ifstream fin(file);
+        if (fin) log << fin.rdbuf() << flush;
+    };
+    auto error = [&](const string &text) {
+        say("Error: " + text);
+        return E_INTERNAL_ERROR;
+    };
+
+    filesystem::path testin = opt.datadir / "input";
+    filesystem::path testout = opt.datadir / "output";
+    if (!filesystem::is_directory(testin)) return error("input data does not exist: " + testin.string());
+    if (!filesystem::is_directory(testout)) return error("output data does not exist: " + testout.string());
+    if (!filesystem::is_directory(opt.compare_script)) return error("Compare script does not exist");
+    if (!filesystem::is_directory(opt.run_script)) return error("Run script does not exist");
+
+    string runguard = get_env_or_empty("RUNGUARD");
+    if (runguard.empty() || access(runguard.c_str(), X_OK) != 0) return error("runguard does not exist");
+    string runuser = get_env_or_empty("RUNUSER"), rungroup = get_env_or_empty("RUNGROUP");
+
+    // 设置脚本权限，确保可以直接运行
+    error_code ec;
+    auto exec_perms = filesystem::perms::owner_exec | filesystem::perms::group_exec | filesystem::perms::others_exec;
+    filesystem::permissions(opt.run_script / "run", exec_perms, filesystem::perm_options::add, ec);
+    filesystem::permissions(opt.compare_script / "run", exec_perms, filesystem::perm_options::add, ec);
+
+    using filesystem::perms;
+    change_mode_recursive(opt.rundir, perms::all, filesystem::perm_options::add);
+
+    touch(opt.rundir / "program.meta");
+    touch(opt.rundir / "program.err");
+    make_dir(opt.rundir / "run", perms::all);  // 运行的临时文件都在这里
+    make_dir(opt.rundir / "feedback", perms::all);
+    make_dir(opt.rundir / "work", perms(0755));
+    make_dir(opt.rundir / "work" / "judge", perms::all);
+    if (!opt.trusted) {
+        touch(opt.rundir / "compare.meta");
+        touch(opt.rundir / "compare.err");
+        make_dir(opt.rundir / "work" / "compare", perms(0755));
+        make_dir(opt.rundir / "work" / "data", perms(0755));
+        make_dir(opt.rundir / "work" / "run", perms::all);
+    }
+    make_dir(opt.rundir / "ofs", perms::all);
+    make_dir(opt.rundir / "ofs" / "merged", perms::all);
+    make_dir(opt.rundir / "ofs" / "judge", perms::all);
+    make_dir(opt.rundir / "merged", perms(0755));
+
+    // 所有 runguard 调用共用的参数
+    vector<string> common{runguard};
+    if (!get_env_or_empty("DEBUG").empty()) common.push_back("-v");
+    if (!opt.cpuset.empty()) common.insert(common.end(), {"-P", opt.cpuset, "--cgroup-leaf", "worker_" + opt.cpuset});
+    if (!get_env_or_empty("ROOTLESS").empty()) common.push_back("--userns");
+    string opttime = opt.wall_time ? "--wall-time" : "--cpu-time";
+
+    // 将测试数据文件夹（内含输入数据，且其中 testdata.in 为标准输入数据文件名），编译好的程序，运行文件夹通过 overlayfs 绑定
+    vector<string> mounts{
+        "--mount", "type=overlay,lower=" + opt.chrootdir.string() + ",upper=work,work=ofs/merged,target=merged",
+        "--mount", "type=overlay,lower=" + (opt.basedir.empty() ? "" : opt.basedir + ":") + testin.string() + ",upper=run,work=ofs/judge,target=merged/judge"};
+    if (!opt.trusted) mounts.insert(mounts.end(), {"--mount", "type=bind,source=" + opt.run_script.string() + ",target=merged/run,ro"});
+    mounts.insert(mounts.end(), {"--mount", "type=bind,source=/proc,target=merged/proc", "--mount", "type=dev,target=merged/dev"});
+
+    vector<string> args = common;
+    if (opt.memory_limit > 0) args.insert(args.end(), {"--memory-limit", to_string(opt.memory_limit), "-VMEMLIMIT=" + to_string(opt.memory_limit)});
+    if (opt.file_limit > 0) args.insert(args.end(), {"--file-limit", to_string(opt.file_limit)});
+    if (opt.proc_limit > 0) args.insert(args.end(), {"--nproc", to_string(opt.proc_limit)});
+    if (opt.trusted && filesystem::exists(opt.compile_script / ".syscall64")) {
+        args.push_back("--allowed-syscall=" + (opt.compile_script / ".syscall64").string());
+        if (string cache = get_env_or_empty("SECCOMPCACHE"); !cache.empty()) args.push_back("--seccomp-cache=" + cache);
+    }
+    if (string netns = get_env_or_empty("RUNNETNS"); !netns.empty()) args.push_back("--netns=" + netns);
+    if (string pool = get_env_or_empty("RUNNSPOOL"); !pool.empty() && !opt.cpuset.empty() && filesystem::is_directory(pool + "/worker_" + opt.cpuset))
+        args.insert(args.end(), {"--ns-pool", pool + "/worker_" + opt.cpuset});
+    if (string interval = get_env_or_empty("SAMPLE_INTERVAL"); !interval.empty())
+        args.insert(args.end(), {"--sample-interval", interval, "--out-samples", "program.samples"});
+    if (string iomax = get_env_or_empty("IOMAX"); !iomax.empty()) args.insert(args.end(), {"--io-max", iomax});
+    if (string ioweight = get_env_or_empty("IOWEIGHT"); !ioweight.empty()) args.insert(args.end(), {"--io-weight", ioweight});
+    args.insert(args.end(), mounts.begin(), mounts.end());
+    args.insert(args.end(), {"--root", "merged", "--work", "/judge", "--no-core-dumps", "--user", runuser, "--group", rungroup,
+                             opttime, boost::lexical_cast<string>(opt.time_limit)});
+
+    // 评测系统开启流式比较时创建命名管道 run/.stdout，选手程序的标准输出直接写入管道
+    bool stream = opt.stream_compare && filesystem::is_fifo(opt.rundir / "run" / ".stdout");
+    if (opt.trusted) {
+        args.insert(args.end(), {"--standard-input-file", (testin / "testdata.in").string(),
+                                 "--standard-output-file", stream ? "run/.stdout" : "run/testdata.out"});
+    } else if (stream) {
+        // 由 runguard 在沙箱外打开管道作为标准输出，运行脚本再通过 /proc/self/fd/1 重定向到管道
+        args.insert(args.end(), {"--standard-output-file", "run/.stdout"});
+    }
+    args.insert(args.end(), {"--standard-error-file", "program.err", "--out-meta", "program.meta", "--out-record", "program.record", "-VONLINE_JUDGE=1", "--"});
+    if (opt.trusted)
+        args.push_back("/judge/run");
+    else
+        args.insert(args.end(), {"/run/run", "testdata.in", stream ? "/proc/self/fd/1" : "testdata.out", "/judge/run"});
+    args.insert(args.end(), opt.run_args.begin(), opt.run_args.end());
+
+    say("Running user program " + opt.rundir.string());
+    process_builder().directory(opt.rundir).output(systemout).run(args);
+
+    if (opt.trusted) change_mode_recursive(opt.rundir / "run", perms::all, filesystem::perm_options::replace);
+
+    // 评测系统使用内置比较器（见 include/judge/comparator.hpp）时设置 SKIP_COMPARE，这里不再运行比较脚本
+    int exitcode = 0;
+    if (!opt.skip_compare) {
+        // 选手输出与之前某次提交完全相同时直接使用缓存的比较结果，必须在比较程序运行之前计算摘要
+        string digest = opt.verdict_cache.empty() ? "" : output_digest(opt.rundir / "run");
+        optional<int> cached = digest.empty() ? nullopt : load_verdict(opt.verdict_cache / digest, opt.rundir);
+
+        // 比较程序支持常驻运行时（如 testlib 检查器）交给评测核心的常驻检查器，省去每个测试点启动比较程序的开销
+        optional<int> served;
+        if (!cached && has_checker_server(opt.compare_script))
+            served = check_with_server(opt.compare_script, opt.cpuset, testin / "testdata.in", opt.rundir / "run" / "testdata.out",
+                                       testout / "testdata.out", opt.rundir / "feedback", opt.rundir / "compare.err");
+
+        if (cached) {
+            exitcode = *cached;
+            say("Using cached verdict " + digest);
+        } else if (served) {
+            exitcode = *served;
+        } else if (opt.trusted) {
+            process_builder pb;
+            pb.directory(opt.rundir).output(systemout).environment("ONLINE_JUDGE", 1);
+            for (auto &env : opt.compare_env) {
+                size_t eq = env.find('=');
+                pb.environment(env.substr(0, eq), eq == string::npos ? "" : env.substr(eq + 1));
+            }
+            exitcode = pb.run(opt.compare_script / "run", testin, "run", testout, "feedback");
+        } else {
+            // 挂载原本程序所需的环境以及比较器所需的文件夹
+            vector<string> compare_args = common;
+            compare_args.insert(compare_args.end(), mounts.begin(), mounts.end());
+            compare_args.insert(compare_args.end(), {
+                "--mount", "type=bind,source=" + opt.datadir.string() + ",target=merged/data,ro",
+                "--mount", "type=bind,source=" + opt.compare_script.string() + ",target=merged/compare,ro",
+                "--mount", "type=bind,source=feedback,target=merged/feedback",
+                "--root", "merged", "--work", "/judge", "--no-core-dumps", "--user", runuser, "--group", rungroup,
+                "--memory-limit", to_string(SCRIPT_MEM_LIMIT), opttime, to_string(SCRIPT_TIME_LIMIT), "--file-limit", to_string(SCRIPT_FILE_LIMIT),
+                "--standard-output-file", "compare.out", "--standard-error-file", "compare.err", "--out-meta", "compare.meta"});
+            for (auto &env : opt.compare_env) compare_args.push_back("-V" + env);
+            compare_args.insert(compare_args.end(), {"-VONLINE_JUDGE=1", "--", "/compare/run", "/data/input", "/judge", "/data/output", "/feedback"});
+            exitcode = process_builder().directory(opt.rundir).output(systemout).run(compare_args);
+        }
+
+        // 比较脚本以选手用户身份写入 feedback，改为属于评测系统以便之后追加内容
+        own_recursive(opt.rundir / "feedback");
+        change_mode_recursive(opt.rundir / "feedback", perms::group_write | perms::others_write, filesystem::perm_options::remove);
+
+        if (!opt.trusted) {
+            if (filesystem::file_size(opt.rundir / "compare.out", ec) > 0 && !ec) {
+                say("\n---------- output validator stdout messages ----------");
+                append(opt.rundir / "compare.out");
+            }
+            if (filesystem::file_size(opt.rundir / "compare.err", ec) > 0 && !ec) {
+                say("\n---------- output validator stderr messages ----------");
+                append(opt.rundir / "compare.err");
+            }
+
+            append(opt.rundir / "compare.meta");
+            auto compare_meta = read_runguard_meta(opt.rundir / "compare.meta");
+            if (compare_meta["time-result"].find("timelimit") != string::npos) {
+                say("Comparing aborted after " + to_string(SCRIPT_TIME_LIMIT) + " seconds");
+                return E_COMPARE_ERROR;
+            }
+            if (!compare_meta["internal-error"].empty()) {
+                say("Internal Error");
+                return E_INTERNAL_ERROR;
+            }
+        }
+
+        // 只缓存确定的比较结果，比较失败可能是偶然的（如比较程序被系统结束）
+        bool scored = exitcode != RESULT_PC || filesystem::exists(opt.rundir / "feedback" / "score.txt");
+        if (!cached && !digest.empty() && scored &&
+            (exitcode == RESULT_AC || exitcode == RESULT_WA || exitcode == RESULT_PE || exitcode == RESULT_PC))
+            store_verdict(opt.verdict_cache / digest, exitcode, opt.rundir);
+    }
+
+    append(opt.rundir / "program.meta");
+    string message;
+    int verdict = program_verdict(opt.rundir / "program.meta", opt.trusted || !filesystem::exists(opt.run_script / ".ignore_exit_code"), message);
+    if (verdict != E_ACCEPTED) {
+        say(message);
+        return verdict;
+    }
+
+    if (opt.skip_compare) {
+        say("Program finished, output will be compared by judge");
+        say(message);
+        return E_ACCEPTED;
+    }
+
+    if (exitcode == RESULT_PC && !filesystem::exists(opt.rundir / "feedback" / "score.txt")) {
+        say("Compare script reports partial correct without score record.");
+        return E_COMPARE_ERROR;
+    }
+
+    switch (exitcode) {
+        case RESULT_AC:
+            say("Accepted\n" + message);
+            return E_ACCEPTED;
+        case RESULT_WA:
+            say("Wrong Answer\n" + message);
+            return E_WRONG_ANSWER;
+        case RESULT_PE:
+            say("Presentation Error\n" + message);
+            return E_PRESENTATION_ERROR;
+        case RESULT_PC:
+            say("Partial Correct\n" + message);
+            return E_PARTIAL_CORRECT;
+        default:
+            say("Comparing failed with exitcode " + to_string(exitcode));
+            return E_COMPARE_ERROR;
+    }
+}
+
+}  // namespace judge
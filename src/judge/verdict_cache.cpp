@@ -0,0 +1,102 @@
+#include "judge/verdict_cache.hpp"
+
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/uuid/detail/sha1.hpp>
+#include <fstream>
+#include <vector>
+
+#include "logging.hpp"
+
+namespace judge {
+using namespace std;
+
+// 与 feedback 文件夹一起缓存的比较程序输出
+static const char *COMPARE_OUTPUTS[] = {"compare.out", "compare.err"};
+
+string output_digest(const filesystem::path &dir) {
+    error_code ec;
+    if (!filesystem::is_directory(dir, ec)) return "";
+
+    // 遍历顺序不确定，按相对路径排序后再计算摘要
+    vector<filesystem::path> files;
+    for (auto it = filesystem::recursive_directory_iterator(dir, ec); !ec && it != filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        auto status = it->symlink_status(ec);
+        if (ec) return "";
+        if (filesystem::is_directory(status)) continue;
+        if (!filesystem::is_regular_file(status)) return "";
+        files.push_back(it->path());
+    }
+    if (ec) return "";
+    sort(files.begin(), files.end());
+
+    boost::uuids::detail::sha1 sha1;
+    char buffer[65536];
+    for (auto &file : files) {
+        // 路径和长度以 \0 结尾，不同的文件划分不会得到相同的字节序列
+        string header = file.lexically_relative(dir).string() + '\0' + to_string(filesystem::file_size(file, ec)) + '\0';
+        if (ec) return "";
+        sha1.process_bytes(header.data(), header.size());
+
+        ifstream fin(file, ios::binary);
+        if (!fin) return "";
+        while (fin.read(buffer, sizeof(buffer)) || fin.gcount() > 0)
+            sha1.process_bytes(buffer, fin.gcount());
+        if (fin.bad()) return "";
+    }
+
+    boost::uuids::detail::sha1::digest_type digest;
+    sha1.get_digest(digest);
+    string hex;
+    for (auto word : digest) hex += fmt::format("{:0{}x}", word, sizeof(word) * 2);
+    return hex;
+}
+
+optional<int> load_verdict(const filesystem::path &entry, const filesystem::path &rundir) {
+    ifstream fin(entry / "exitcode");
+    int exitcode;
+    if (!(fin >> exitcode)) return nullopt;
+
+    error_code ec;
+    filesystem::copy(entry / "feedback", rundir / "feedback", filesystem::copy_options::recursive | filesystem::copy_options::overwrite_existing, ec);
+    for (const char *name : COMPARE_OUTPUTS)
+        if (!ec && filesystem::exists(entry / name))
+            filesystem::copy_file(entry / name, rundir / name, filesystem::copy_options::overwrite_existing, ec);
+    if (ec) {
+        LOG_WARN << "Unable to load cached verdict " << entry << ": " << ec.message();
+        return nullopt;
+    }
+    return exitcode;
+}
+
+void store_verdict(const filesystem::path &entry, int exitcode, const filesystem::path &rundir) {
+    error_code ec;
+    if (filesystem::exists(entry, ec)) return;
+
+    // 同一进程的多个评测核心可能同时保存同一个缓存项，临时文件夹名需要区分进程和调用
+    static atomic_int counter = 0;
+    filesystem::path temp = entry;
+    temp += fmt::format(".tmp-{}-{}", getpid(), counter++);
+
+    filesystem::create_directories(temp, ec);
+    if (!ec) filesystem::copy(rundir / "feedback", temp / "feedback", filesystem::copy_options::recursive, ec);
+    for (const char *name : COMPARE_OUTPUTS)
+        if (!ec && filesystem::exists(rundir / name))
+            filesystem::copy_file(rundir / name, temp / name, ec);
+    if (!ec) {
+        ofstream fout(temp / "exitcode");
+        if (!(fout << exitcode << endl)) ec = make_error_code(errc::io_error);
+    }
+    // 缓存项已经被其他评测核心保存时重命名失败，丢弃这次的结果即可
+    if (!ec) filesystem::rename(temp, entry, ec);
+    if (ec) {
+        error_code exists_ec;
+        if (!filesystem::exists(entry, exists_ec)) LOG_WARN << "Unable to store verdict to " << entry << ": " << ec.message();
+        filesystem::remove_all(temp, ec);
+    }
+}
+
+}  // namespace judge
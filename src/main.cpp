@@ -196,6 +196,11 @@ int main(int argc, char* argv[]) {
         ("cache-dir", po::value<string>(), "set the directory to store cached test data, compiled spj, random test generator, compiled executables. You can either pass it from environ CACHEDIR")
         ("data-dir", po::value<string>(), "set the directory to store test data to be judged, for ramdisk to speed up IO performance of user program. You can either pass it from environ DATADIR")
         ("run-dir", po::value<string>(), "set the directory to run user programs, store compiled user program. You can either pass it from environ RUNDIR")
+        ("tmpfs-run-dir", "mount a tmpfs sized by the output limit on the run directory of each test case, so that output of user programs never touches the disk. You can either pass it from environ TMPFSRUNDIR")
+        ("stream-compare", "pipe standard output of user programs to the built-in comparator, which kills the program on the first wrong line. You can either pass it from environ STREAMCOMPARE")
+        ("batch-size", po::value<int>(), "run up to the given number of test cases with the same program and limits in one sandbox session, default to 1(disabled). You can either pass it from environ BATCHSIZE")
+        ("native-check", "run the built-in check pipeline instead of standard and standard-trusted check scripts. You can either pass it from environ NATIVECHECK")
+        ("verdict-cache", "reuse verdicts of compare scripts in the built-in check pipeline for identical outputs, only for compare scripts that depend on nothing but the test data and the outputs. You can either pass it from environ VERDICTCACHE")
         ("chroot-dir", po::value<string>(), "set the chroot directory. You can either pass it from environ CHROOTDIR")
         ("script-mem-limit", po::value<unsigned>(), "set memory limit in KB for random data generator, scripts, default to 262144(256MB). You can either pass it from environ SCRIPTMEMLIMIT")
         ("script-time-limit", po::value<unsigned>(), "set time limit in seconds for random data generator, scripts, default to 10(10 second). You can either pass it from environ SCRIPTTIMELIMIT")
@@ -244,7 +249,9 @@ int main(int argc, char* argv[]) {
         judge::DEBUG = true;
     }
 
-    if (getuid() != 0) {
+    // rootless 模式下 runguard 通过用户命名空间隔离选手程序，评测系统不需要 root 权限
+    const char *rootless = getenv("ROOTLESS");
+    if (getuid() != 0 && !(rootless && *rootless)) {
         cerr << "You should run this program in privileged mode" << endl;
         if (!judge::DEBUG) return EXIT_FAILURE;
     }
@@ -312,6 +319,23 @@ int main(int argc, char* argv[]) {
     }
     if (!filesystem::exists(judge::RUN_DIR) && !filesystem::create_directories(judge::RUN_DIR))
         LOG_FATAL << "Run directory " << judge::RUN_DIR << " cannot be created";
+    if (vm.count("tmpfs-run-dir") || getenv("TMPFSRUNDIR")) {
+        judge::TMPFS_RUN_DIR = true;
+    }
+    if (vm.count("stream-compare") || getenv("STREAMCOMPARE")) {
+        judge::STREAM_COMPARE = true;
+    }
+    if (vm.count("batch-size")) {
+        judge::BATCH_SIZE = vm["batch-size"].as<int>();
+    } else if (getenv("BATCHSIZE")) {
+        judge::BATCH_SIZE = boost::lexical_cast<int>(getenv("BATCHSIZE"));
+    }
+    if (vm.count("native-check") || getenv("NATIVECHECK")) {
+        judge::NATIVE_CHECK = true;
+    }
+    if (vm.count("verdict-cache") || getenv("VERDICTCACHE")) {
+        judge::VERDICT_CACHE = true;
+    }
 
     if (vm.count("chroot-dir")) {
         judge::CHROOT_DIR = filesystem::path(vm.at("chroot-dir").as<string>());
@@ -245,6 +245,7 @@ void source_code::fetch(const string &cpuset, const fs::path &workdir, const fs:
 
     process_builder pb;
     if (!entry_point.empty()) pb.environment("ENTRY_POINT", entry_point);
+    if (sanitized_variant) pb.environment("SANITIZE", 1);
     if (limit.file_limit > 0) pb.environment("SCRIPTFILELIMIT", limit.file_limit);
     if (limit.time_limit > 0) pb.environment("SCRIPTTIMELIMIT", limit.time_limit);
     if (limit.memory_limit > 0) pb.environment("SCRIPTMEMLIMIT", limit.memory_limit);
@@ -2,11 +2,13 @@
 #include <boost/lexical_cast.hpp>
 #include <fstream>
 #include <map>
+#include <sstream>
+#include "runguard_record.hpp"
 
 namespace judge {
 using namespace std;
 
-static map<string, string> read_metadata(const filesystem::path &metadata_file) {
+map<string, string> read_runguard_meta(const filesystem::path &metadata_file) {
     map<string, string> mp;
     ifstream fin(metadata_file);
     string line;
@@ -34,19 +36,75 @@ void try_to_parse(const string &text, T &value) {
     }
 }
 
-runguard_result read_runguard_result(const filesystem::path &metafile) {
-    auto metadata = read_metadata(metafile);
+static const char *limit_reason_name(uint32_t reason) {
+    switch (reason) {
+        case RUNGUARD_LIMIT_WALL_TIME: return "wall-time";
+        case RUNGUARD_LIMIT_CPU_TIME: return "cpu-time";
+        case RUNGUARD_LIMIT_MEMORY: return "memory";
+        case RUNGUARD_LIMIT_OUTPUT: return "output";
+        case RUNGUARD_LIMIT_INSTRUCTIONS: return "instructions";
+        default: return "";
+    }
+}
+
+static bool read_record(const filesystem::path &recordfile, runguard_result &result) {
+    runguard_record record;
+    ifstream fin(recordfile, ios::binary);
+    if (!fin.read(reinterpret_cast<char *>(&record), sizeof(record))) return false;
+    if (record.magic != RUNGUARD_RECORD_MAGIC || record.version != RUNGUARD_RECORD_VERSION) return false;
+
+    result.wall_time = record.wall_time_usec / 1e6;
+    result.cpu_time = record.cpu_time_usec / 1e6;
+    result.user_time = record.user_time_usec / 1e6;
+    result.sys_time = record.sys_time_usec / 1e6;
+    result.instructions = record.instructions;
+    result.exitcode = record.exitcode;
+    result.signal = record.signal;
+    result.memory = record.memory_bytes;
+    if (record.flags & RUNGUARD_RECORD_TIME_HARD)
+        result.time_result = "hard-timelimit";
+    else if (record.flags & RUNGUARD_RECORD_TIME_SOFT)
+        result.time_result = "soft-timelimit";
+    result.limit_reason = limit_reason_name(record.limit_reason);
+    result.read_bytes = record.read_bytes;
+    result.write_bytes = record.write_bytes;
+    return true;
+}
+
+runguard_result read_runguard_result(const filesystem::path &metafile, const filesystem::path &recordfile) {
+    if (!recordfile.empty()) {
+        runguard_result result;
+        if (read_record(recordfile, result)) return result;
+    }
+
+    auto metadata = read_runguard_meta(metafile);
     runguard_result result;
     if (metadata.count("cpu-time")) try_to_parse(metadata.at("cpu-time"), result.cpu_time);
     if (metadata.count("sys-time")) try_to_parse(metadata.at("sys-time"), result.sys_time);
     if (metadata.count("user-time")) try_to_parse(metadata.at("user-time"), result.user_time);
     if (metadata.count("wall-time")) try_to_parse(metadata.at("wall-time"), result.wall_time);
+    if (metadata.count("instructions")) try_to_parse(metadata.at("instructions"), result.instructions);
     if (metadata.count("exitcode")) try_to_parse(metadata.at("exitcode"), result.exitcode);
     if (metadata.count("signal")) try_to_parse(metadata.at("signal"), result.signal);
     if (metadata.count("memory-bytes")) try_to_parse(metadata.at("memory-bytes"), result.memory);
     if (metadata.count("time-result")) try_to_parse(metadata.at("time-result"), result.time_result);
+    if (metadata.count("limit-reason")) try_to_parse(metadata.at("limit-reason"), result.limit_reason);
     if (metadata.count("internal-error")) try_to_parse(metadata.at("internal-error"), result.internal_error);
     return result;
 }
 
+vector<runguard_sample> read_runguard_samples(const filesystem::path &samplesfile) {
+    vector<runguard_sample> samples;
+    ifstream fin(samplesfile);
+    string line;
+    while (getline(fin, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream in(line);
+        runguard_sample s;
+        if (in >> s.time_usec >> s.memory_bytes >> s.cpu_usec >> s.user_usec >> s.system_usec >> s.pgfault >> s.pgmajfault >> s.voluntary_ctxt_switches >> s.nonvoluntary_ctxt_switches >> s.read_bytes >> s.write_bytes)
+            samples.push_back(s);
+    }
+    return samples;
+}
+
 }  // namespace judge
@@ -41,6 +41,8 @@ void from_json(const json &j, system_config &config) {
     j.at("fileApi").get_to(config.file_api);
     j.at("postRetryTime").get_to(config.post_retry_time);
     j.at("fileConnectTimeout").get_to(config.file_connect_timeout);
+    if (exists(j, "memoryCheckTool"))
+        j.at("memoryCheckTool").get_to(config.memory_check_tool);
 }
 
 void from_json(const json &j, time_limit_config &limit) {
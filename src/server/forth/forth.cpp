@@ -98,6 +98,7 @@ void from_json(const json &j, unique_ptr<source_code> &value) {
     assign_optional(j, value->source_files, "source_files");
     assign_optional(j, value->assist_files, "assist_files");
     assign_optional(j, value->compile_command, "compile_command");
+    assign_optional(j, value->sanitized_variant, "sanitize");
 }
 
 void from_json(const json &j, unique_ptr<git_repository> &value) {
@@ -203,6 +204,16 @@ void to_json(json &j, const action_result &result) {
     if (result.success) j["result"] = ensure_utf8(result.result);
 }
 
+/**
+ * @brief 采样点按 time_usec, memory_bytes, cpu_usec, user_usec, system_usec, pgfault, pgmajfault,
+ * voluntary_ctxt_switches, nonvoluntary_ctxt_switches, read_bytes, write_bytes 的顺序输出为数组，以减小报告大小
+ */
+void to_json(json &j, const runguard_sample &sample) {
+    j = {sample.time_usec, sample.memory_bytes, sample.cpu_usec, sample.user_usec, sample.system_usec,
+         sample.pgfault, sample.pgmajfault, sample.voluntary_ctxt_switches, sample.nonvoluntary_ctxt_switches,
+         sample.read_bytes, sample.write_bytes};
+}
+
 void to_json(json &j, const judge_task_result &result) {
     json report;
     try {
@@ -219,6 +230,7 @@ void to_json(json &j, const judge_task_result &result) {
          {"error_log", ensure_utf8(result.error_log)},
          {"report", report},
          {"actions", result.actions}};
+    if (!result.samples.empty()) j["samples"] = result.samples;
 }
 
 void to_json(json &j, const programming_judge_report &report) {
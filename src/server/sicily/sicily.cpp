@@ -295,7 +295,7 @@ static void set_status(configuration &sicily, const judge_task_result &task_resu
             status_string.at(task_result.status),
             is_multiple_cases ? current_case : -1,
             task_result.run_time,
-            task_result.memory_used >> 10,  // Sicily 的内存占用单位是 KB
+            (int)(task_result.memory_used >> 10),  // Sicily 的内存占用单位是 KB
             submit.sub_id);
     } else {
         sicily.db.execute(
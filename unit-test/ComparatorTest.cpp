@@ -0,0 +1,207 @@
+#include "gtest/gtest.h"
+#include "judge/comparator.hpp"
+#include <sys/stat.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace judge;
+
+TEST(ComparatorTest, BuiltinCompareOptionsTest) {
+    EXPECT_EQ(builtin_compare_options("diff-all")->mode, compare_mode::EXACT);
+    EXPECT_EQ(builtin_compare_options("diff-ign-space")->mode, compare_mode::IGNORE_SPACE);
+    EXPECT_EQ(builtin_compare_options("diff-ign-trailing")->mode, compare_mode::IGNORE_TRAILING_SPACE);
+    EXPECT_EQ(builtin_compare_options("gtest")->mode, compare_mode::GTEST);
+    EXPECT_EQ(builtin_compare_options("valgrind")->mode, compare_mode::VALGRIND);
+    EXPECT_FALSE(builtin_compare_options("asan"));
+    EXPECT_FALSE(builtin_compare_options(""));
+
+    auto options = builtin_compare_options("float");
+    EXPECT_EQ(options->mode, compare_mode::FLOAT);
+    EXPECT_DOUBLE_EQ(options->absolute_error, 1e-6);
+    EXPECT_DOUBLE_EQ(options->relative_error, 1e-6);
+    options = builtin_compare_options("float:1e-4");
+    EXPECT_DOUBLE_EQ(options->absolute_error, 1e-4);
+    EXPECT_DOUBLE_EQ(options->relative_error, 1e-4);
+    options = builtin_compare_options("float:0:1e-9");
+    EXPECT_DOUBLE_EQ(options->absolute_error, 0);
+    EXPECT_DOUBLE_EQ(options->relative_error, 1e-9);
+
+    EXPECT_THROW(builtin_compare_options("float:abc"), invalid_argument);
+    EXPECT_THROW(builtin_compare_options("float:-1"), invalid_argument);
+    EXPECT_THROW(builtin_compare_options("float:1:2:3"), invalid_argument);
+    EXPECT_THROW(builtin_compare_options("diff-all:1"), invalid_argument);
+}
+
+TEST(ComparatorTest, IdenticalTest) {
+    for (auto mode : {compare_mode::EXACT, compare_mode::IGNORE_SPACE, compare_mode::IGNORE_TRAILING_SPACE}) {
+        EXPECT_EQ(compare_output("", "", mode), compare_result::ACCEPTED);
+        EXPECT_EQ(compare_output("1 2\n3\n", "1 2\n3\n", mode), compare_result::ACCEPTED);
+        EXPECT_EQ(compare_output("1 2\r\n3\r\n", "1 2\n3\n", mode), compare_result::ACCEPTED);
+    }
+}
+
+TEST(ComparatorTest, WrongAnswerTest) {
+    for (auto mode : {compare_mode::EXACT, compare_mode::IGNORE_SPACE, compare_mode::IGNORE_TRAILING_SPACE}) {
+        EXPECT_EQ(compare_output("1 2\n3\n", "1 2\n4\n", mode), compare_result::WRONG_ANSWER);
+        EXPECT_EQ(compare_output("12\n", "1 2\n", mode), compare_result::WRONG_ANSWER);
+        EXPECT_EQ(compare_output("1 2\n", "1 2\n3\n", mode), compare_result::WRONG_ANSWER);
+        EXPECT_EQ(compare_output("", "1\n", mode), compare_result::WRONG_ANSWER);
+    }
+}
+
+TEST(ComparatorTest, ExactTest) {
+    EXPECT_EQ(compare_output("1  2\n", "1 2\n", compare_mode::EXACT), compare_result::PRESENTATION_ERROR);
+    EXPECT_EQ(compare_output("1 2 \n", "1 2\n", compare_mode::EXACT), compare_result::PRESENTATION_ERROR);
+    EXPECT_EQ(compare_output("1 2\n\n", "1 2\n", compare_mode::EXACT), compare_result::PRESENTATION_ERROR);
+    EXPECT_EQ(compare_output("1 2", "1 2\n", compare_mode::EXACT), compare_result::PRESENTATION_ERROR);
+}
+
+TEST(ComparatorTest, IgnoreSpaceTest) {
+    EXPECT_EQ(compare_output("1  \t2\n", "1 2\n", compare_mode::IGNORE_SPACE), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("1 2 \n\n\n", "1 2\n", compare_mode::IGNORE_SPACE), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("1 2", "1 2\n", compare_mode::IGNORE_SPACE), compare_result::ACCEPTED);
+}
+
+TEST(ComparatorTest, IgnoreTrailingSpaceTest) {
+    EXPECT_EQ(compare_output("1 2  \n\n", "1 2\n", compare_mode::IGNORE_TRAILING_SPACE), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("1  2\n", "1 2\n", compare_mode::IGNORE_TRAILING_SPACE), compare_result::PRESENTATION_ERROR);
+}
+
+TEST(ComparatorTest, FloatTest) {
+    compare_options options(compare_mode::FLOAT, 1e-6, 1e-6);
+    EXPECT_EQ(compare_output("1.0000001 2\n", "1 2\n", options), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("1.00001 2\n", "1 2\n", options), compare_result::WRONG_ANSWER);
+    EXPECT_EQ(compare_output("1000000.5\n", "1000000\n", options), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("1e-3 -.5  2.\n\n", "0.001\n-0.50 2\n", options), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("3.14159265358979323846264 yes\n", "3.141592653589793 yes", options), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("1 YES\n", "1 yes\n", options), compare_result::WRONG_ANSWER);
+    EXPECT_EQ(compare_output("1 2\n", "1 2 3\n", options), compare_result::WRONG_ANSWER);
+    EXPECT_EQ(compare_output("nan inf\n", "nan inf\n", options), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("nan\n", "0\n", options), compare_result::WRONG_ANSWER);
+    EXPECT_EQ(compare_output("0x1\n", "1\n", options), compare_result::WRONG_ANSWER);
+    EXPECT_EQ(compare_output("1e400\n", "1\n", options), compare_result::WRONG_ANSWER);
+
+    compare_options absolute(compare_mode::FLOAT, 0.01, 0);
+    EXPECT_EQ(compare_output("0.005\n", "0\n", absolute), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output("100.02\n", "100\n", absolute), compare_result::WRONG_ANSWER);
+}
+
+TEST(ComparatorTest, LongLineTest) {
+    // 超过 SIMD 向量宽度的行，差异出现在行中间
+    string answer(1000, 'a'), user = answer;
+    user[517] = 'b';
+    EXPECT_EQ(compare_output(user, answer, compare_mode::EXACT), compare_result::WRONG_ANSWER);
+    user[517] = ' ';
+    answer[517] = ' ';
+    user.insert(517, "\t ");
+    EXPECT_EQ(compare_output(user, answer, compare_mode::IGNORE_SPACE), compare_result::ACCEPTED);
+    EXPECT_EQ(compare_output(user, answer, compare_mode::EXACT), compare_result::PRESENTATION_ERROR);
+}
+
+TEST(ComparatorTest, StreamTest) {
+    auto answer = filesystem::temp_directory_path() / "comparator_test_answer.txt";
+    ofstream(answer) << "1 2\n3\n";
+
+    auto feed = [&](const string &output, compare_mode mode, size_t chunk) {
+        stream_comparator comparator(answer, mode);
+        for (size_t i = 0; i < output.size(); i += chunk)
+            if (!comparator.feed(string_view(output).substr(i, chunk))) return compare_result::WRONG_ANSWER;
+        return comparator.finish();
+    };
+
+    for (size_t chunk : {1, 2, 100}) {
+        EXPECT_EQ(feed("1 2\n3\n", compare_mode::EXACT, chunk), compare_result::ACCEPTED);
+        EXPECT_EQ(feed("1 2\r\n3", compare_mode::IGNORE_SPACE, chunk), compare_result::ACCEPTED);
+        EXPECT_EQ(feed("1  2\n3\n", compare_mode::EXACT, chunk), compare_result::PRESENTATION_ERROR);
+        EXPECT_EQ(feed("1 2\n4\n", compare_mode::EXACT, chunk), compare_result::WRONG_ANSWER);
+        EXPECT_EQ(feed("1 2\n", compare_mode::EXACT, chunk), compare_result::WRONG_ANSWER);
+        EXPECT_EQ(feed("1.0000001\n2 3", compare_mode::FLOAT, chunk), compare_result::ACCEPTED);
+        EXPECT_EQ(feed("1 2.01\n3\n", compare_mode::FLOAT, chunk), compare_result::WRONG_ANSWER);
+    }
+
+    // 第一行就错误时不再需要后面的输出
+    stream_comparator comparator(answer, compare_mode::EXACT);
+    EXPECT_FALSE(comparator.feed("1 3\n"));
+
+    // 远长于标准输出的输出直接判定为错误，不会缓存下来
+    stream_comparator spaces(answer, compare_mode::IGNORE_SPACE);
+    EXPECT_FALSE(spaces.feed(string(2 << 20, ' ')));
+
+    filesystem::remove(answer);
+}
+
+TEST(ComparatorTest, NormalizedAnswerTest) {
+    auto dir = filesystem::temp_directory_path() / "comparator_test_normalized";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    auto answer = dir / "answer.txt", user = dir / "user.txt", normalized = dir / "normalized";
+
+    // 标准输出足够长，差异出现在行首位置索引的多个间隔之后
+    string expected;
+    for (int i = 0; i < 50000; ++i) expected += to_string(i) + " \t" + to_string(i * 7) + (i % 100 ? "\n" : "\n\n");
+    ofstream(answer, ios::binary) << expected;
+
+    auto compare = [&](const string &output, compare_mode mode) {
+        ofstream(user, ios::binary) << output;
+        compare_result plain = compare_files(user, answer, mode);
+        normalize_answer(answer, normalized, mode);
+        compare_result result = compare_files(user, answer, mode, normalized);
+        EXPECT_EQ(result, plain);
+
+        stream_comparator comparator(answer, mode, normalized);
+        comparator.feed(output);
+        EXPECT_EQ(comparator.finish(), plain);
+        return result;
+    };
+
+    for (compare_mode mode : {compare_mode::EXACT, compare_mode::IGNORE_SPACE, compare_mode::IGNORE_TRAILING_SPACE}) {
+        EXPECT_EQ(compare(expected, mode), compare_result::ACCEPTED);
+
+        string output = expected;
+        output.replace(output.find("43210 \t"), 7, "43210  ");
+        EXPECT_EQ(compare(output, mode), mode == compare_mode::IGNORE_SPACE ? compare_result::ACCEPTED : compare_result::PRESENTATION_ERROR);
+
+        output = expected;
+        output.insert(output.find("\n", 400000), "  \r");
+        EXPECT_EQ(compare(output, mode), mode == compare_mode::EXACT ? compare_result::PRESENTATION_ERROR : compare_result::ACCEPTED);
+
+        output = expected;
+        output[output.find("43210 \t") + 2] = '9';
+        EXPECT_EQ(compare(output, mode), compare_result::WRONG_ANSWER);
+
+        EXPECT_EQ(compare(expected.substr(0, expected.size() - 100), mode), compare_result::WRONG_ANSWER);
+    }
+    EXPECT_TRUE(filesystem::exists(normalized / "loose.index"));
+    EXPECT_TRUE(filesystem::exists(normalized / "trailing.index"));
+
+    // 标准输出改变后不再使用旧的规范化结果
+    ofstream(answer, ios::binary) << "1 2\n";
+    EXPECT_EQ(compare_files(answer, answer, compare_mode::IGNORE_SPACE, normalized), compare_result::ACCEPTED);
+    ofstream(user, ios::binary) << "1   2";
+    EXPECT_EQ(compare_files(user, answer, compare_mode::IGNORE_SPACE, normalized), compare_result::ACCEPTED);
+
+    filesystem::remove_all(dir);
+}
+
+TEST(ComparatorTest, CompareFifoMissingAnswerTest) {
+    auto dir = filesystem::temp_directory_path() / "comparator_fifo_test";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    auto fifo = dir / ".stdout";
+    ASSERT_EQ(mkfifo(fifo.c_str(), 0666), 0);
+
+    // 标准输出不存在时仍然读完选手程序的输出，选手程序不会阻塞在打开管道上
+    atomic_bool stop = false;
+    thread program([&] {
+        ofstream(fifo, ios::binary) << "1 2\n";
+        stop = true;
+    });
+    EXPECT_THROW(compare_fifo(fifo, dir / "nonexistent", compare_mode::EXACT, stop, [] {}), exception);
+    program.join();
+    filesystem::remove_all(dir);
+}
@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "config.hpp"
+#include "judge/report_parser.hpp"
+#include "nlohmann/json.hpp"
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace judge;
+using json = nlohmann::json;
+
+static const char *GTEST_XML = R"(<?xml version="1.0" encoding="UTF-8"?>
+<testsuites tests="4" failures="2" disabled="1" errors="0" time="0.01" name="AllTests">
+  <testsuite name="A" tests="3" failures="1" disabled="1">
+    <testcase name="Pass" status="run" result="completed" classname="A" />
+    <testcase name="Fail" status="run" result="completed" classname="A">
+      <failure message="a.cpp:3&#x0A;Expected: &lt;1&gt; &amp;   2" type=""><![CDATA[a.cpp:3
+Expected: <1> &   2]]></failure>
+      <failure message="second" type=""><![CDATA[second]]></failure>
+    </testcase>
+    <testcase name="DISABLED_Skip" status="notrun" result="suppressed" classname="A" />
+  </testsuite>
+  <testsuite name="Inst/P" tests="1" failures="1" disabled="0">
+    <testcase name="Even/0" value_param="1" status="run" result="completed" classname="Inst/P">
+      <failure message="odd" type=""><![CDATA[odd]]></failure>
+    </testcase>
+  </testsuite>
+  <!-- 注释 -->
+</testsuites>
+)";
+
+static const char *VALGRIND_XML = R"(<?xml version="1.0"?>
+<valgrindoutput>
+<protocolversion>4</protocolversion>
+<error>
+  <unique>0x0</unique>
+  <kind>InvalidWrite</kind>
+  <what>Invalid write of size 4</what>
+  <stack>
+    <frame><ip>0x10916B</ip><obj>/judge/run</obj><fn>main</fn><dir>/judge</dir><file>a.cpp</file><line>5</line></frame>
+  </stack>
+  <auxwhat>Address 0x4dafc8c is 0 bytes after a block of size 12 alloc'd</auxwhat>
+  <stack>
+    <frame><ip>0x483C583</ip><fn>operator new[](unsigned long)</fn></frame>
+    <frame><ip>0x10915E</ip><fn>main</fn></frame>
+  </stack>
+</error>
+<suppcounts>
+</suppcounts>
+</valgrindoutput>
+)";
+
+static filesystem::path make_feedback(const string &name, const string &file, const string &content) {
+    auto dir = filesystem::temp_directory_path() / ("report_parser_test_" + name);
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir / "feedback");
+    if (!file.empty()) ofstream(dir / file) << content;
+    return dir;
+}
+
+static string read_file(const filesystem::path &path) {
+    ifstream fin(path);
+    return string(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+}
+
+TEST(ReportParserTest, GTestTest) {
+    auto dir = make_feedback("gtest", "test_detail.xml", GTEST_XML);
+    EXPECT_EQ(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), E_PARTIAL_CORRECT);
+    EXPECT_EQ(read_file(dir / "feedback" / "score.txt"), "1 3");
+
+    json report = json::parse(read_file(dir / "feedback" / "report.txt"));
+    EXPECT_EQ(report["total_cases"], 3);
+    EXPECT_EQ(report["pass_cases"], 1);
+    EXPECT_EQ(report["error_cases"], 2);
+    EXPECT_EQ(report["disabled_cases"], 1);
+    EXPECT_EQ(report["time"], "0.01");
+    ASSERT_EQ(report["report"].size(), 2);
+    EXPECT_EQ(report["report"][0]["name"], "A/Fail");
+    EXPECT_EQ(report["report"][0]["message"], "a.cpp:3 Expected: <1> & 2");  // 与 textwrap.shorten 一样合并空白字符
+    EXPECT_EQ(report["report"][1]["suite"], "Inst/P");
+    EXPECT_EQ(report["report"][1]["case"], "Even/0");
+    EXPECT_EQ(report["report"][1]["param"], "1");
+    filesystem::remove_all(dir);
+}
+
+TEST(ReportParserTest, GTestShortenTest) {
+    // 与 textwrap.shorten 一致：在单词边界截断，第一个单词就超出长度时只保留 "[...]"
+    string words;
+    for (int i = 0; i < 250; ++i) words += "word ";
+    string xml = R"(<testsuites failures="2" time="0"><testsuite name="A"><testcase name="B"><failure message=")" + words +
+                 R"("/></testcase><testcase name="C"><failure message=")" + string(2000, 'a') +
+                 R"("/></testcase></testsuite></testsuites>)";
+    auto dir = make_feedback("gtest_shorten", "test_detail.xml", xml);
+    EXPECT_EQ(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), E_WRONG_ANSWER);
+
+    json report = json::parse(read_file(dir / "feedback" / "report.txt"));
+    ASSERT_EQ(report["report"].size(), 2);
+    string message = report["report"][0]["message"];
+    EXPECT_EQ(message.size(), 1000);
+    EXPECT_EQ(message.substr(message.size() - 10), "word [...]");
+    EXPECT_EQ(report["report"][1]["message"], "[...]");
+    filesystem::remove_all(dir);
+}
+
+TEST(ReportParserTest, GTestResultTest) {
+    auto dir = make_feedback("gtest_ac", "test_detail.xml", R"(<testsuites failures="0" time="0"><testsuite name="A"><testcase name="B"/></testsuite></testsuites>)");
+    EXPECT_EQ(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), E_ACCEPTED);
+    dir = make_feedback("gtest_wa", "test_detail.xml", R"(<testsuites failures="1" time="0"><testsuite name="A"><testcase name="B"><failure message="x"/></testcase></testsuite></testsuites>)");
+    EXPECT_EQ(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), E_WRONG_ANSWER);
+
+    dir = make_feedback("gtest_error", "test_detail.xml", R"(<testsuites time="0"></testsuites>)");
+    EXPECT_THROW(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), runtime_error);
+    dir = make_feedback("gtest_malformed", "test_detail.xml", R"(<testsuites failures="0" time="0"><testsuite name="A">)");
+    EXPECT_THROW(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), runtime_error);
+    dir = make_feedback("gtest_missing", "", "");
+    EXPECT_THROW(convert_gtest_report(dir / "test_detail.xml", dir / "feedback"), runtime_error);
+    filesystem::remove_all(dir);
+}
+
+TEST(ReportParserTest, ValgrindTest) {
+    auto dir = make_feedback("valgrind", "valgrind.xml", VALGRIND_XML);
+    EXPECT_EQ(convert_valgrind_report(dir / "valgrind.xml", dir / "feedback"), E_WRONG_ANSWER);
+
+    json report = json::parse(read_file(dir / "feedback" / "report.txt"));
+    EXPECT_EQ(report["protocolversion"], "4");
+    EXPECT_TRUE(report["suppcounts"].is_null());
+    ASSERT_TRUE(report["error"].is_array());
+    ASSERT_EQ(report["error"].size(), 1);
+    auto &error = report["error"][0];
+    EXPECT_EQ(error["kind"], "InvalidWrite");
+    ASSERT_EQ(error["stack"].size(), 2);
+    ASSERT_TRUE(error["stack"][0]["frame"].is_array());
+    EXPECT_EQ(error["stack"][0]["frame"][0], json({{"ip", "0x10916B"}, {"fn", "main"}, {"file", "a.cpp"}, {"line", "5"}}));
+    EXPECT_EQ(error["stack"][1]["frame"].size(), 2);
+    EXPECT_EQ(error["auxwhat"], "Address 0x4dafc8c is 0 bytes after a block of size 12 alloc'd");
+    filesystem::remove_all(dir);
+}
+
+TEST(ReportParserTest, ValgrindResultTest) {
+    auto dir = make_feedback("valgrind_ac", "valgrind.xml", "<?xml version=\"1.0\"?>\n<valgrindoutput><protocolversion>4</protocolversion></valgrindoutput>\n");
+    EXPECT_EQ(convert_valgrind_report(dir / "valgrind.xml", dir / "feedback"), E_ACCEPTED);
+    EXPECT_EQ(read_file(dir / "feedback" / "report.txt"), "");
+
+    dir = make_feedback("valgrind_error", "valgrind.xml", "<testsuites/>");
+    EXPECT_THROW(convert_valgrind_report(dir / "valgrind.xml", dir / "feedback"), runtime_error);
+    dir = make_feedback("valgrind_nested", "valgrind.xml", "<valgrindoutput>" + string(100000, '<') + "a>");
+    EXPECT_THROW(convert_valgrind_report(dir / "valgrind.xml", dir / "feedback"), runtime_error);
+    dir = make_feedback("valgrind_missing", "", "");
+    EXPECT_THROW(convert_valgrind_report(dir / "valgrind.xml", dir / "feedback"), runtime_error);
+    filesystem::remove_all(dir);
+}
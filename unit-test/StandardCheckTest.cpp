@@ -0,0 +1,44 @@
+#include "gtest/gtest.h"
+#include "config.hpp"
+#include "judge/standard_check.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace std;
+using namespace judge;
+
+static int verdict_of(const string &meta, bool check_exit_code, string &message) {
+    auto metafile = filesystem::temp_directory_path() / "standard_check_test.meta";
+    ofstream(metafile) << meta;
+    int verdict = program_verdict(metafile, check_exit_code, message);
+    filesystem::remove(metafile);
+    return verdict;
+}
+
+TEST(StandardCheckTest, ProgramVerdictTest) {
+    string message;
+    EXPECT_EQ(verdict_of("cpu-time: 0.1\nwall-time: 0.2\nmemory-bytes: 1024\nexitcode: 0\n", true, message), E_ACCEPTED);
+    EXPECT_EQ(message, "    runtime: 0.1s cpu, 0.2s wall\n    memory used: 1024 bytes");
+
+    EXPECT_EQ(verdict_of("internal-error: cannot fork\n", true, message), E_INTERNAL_ERROR);
+    EXPECT_EQ(verdict_of("time-result: hard-timelimit\nexitcode: 137\n", true, message), E_TIME_LIMIT);
+    EXPECT_EQ(message.substr(0, message.find('\n')), "Time Limit Exceeded");
+    EXPECT_EQ(verdict_of("memory-result: oom\nsignal: 9\n", true, message), E_MEM_LIMIT);
+    EXPECT_EQ(verdict_of("output-truncated: stderr,stdout\n", true, message), E_OUTPUT_LIMIT);
+    EXPECT_EQ(verdict_of("output-truncated: stderr\nexitcode: 0\n", true, message), E_ACCEPTED);
+
+    EXPECT_EQ(verdict_of("signal: 11\n", true, message), E_SEG_FAULT);
+    EXPECT_EQ(verdict_of("signal: 8\n", true, message), E_FLOATING_POINT);
+    EXPECT_EQ(verdict_of("signal: 9\n", true, message), E_MEM_LIMIT);
+    EXPECT_EQ(verdict_of("signal: 31\n", true, message), E_RESTRICT_FUNCTION);
+    EXPECT_EQ(verdict_of("signal: 6\n", true, message), E_RUNTIME_ERROR);
+
+    EXPECT_EQ(verdict_of("exitcode: 3\n", true, message), E_RUNTIME_ERROR);
+    EXPECT_EQ(message.substr(0, message.find('\n')), "Non-zero exitcode 3");
+    EXPECT_EQ(verdict_of("exitcode: 3\n", false, message), E_ACCEPTED);
+
+    // runguard 崩溃时 meta 文件为空
+    EXPECT_EQ(verdict_of("", true, message), E_INTERNAL_ERROR);
+    EXPECT_EQ(program_verdict(filesystem::temp_directory_path() / "standard_check_test.nonexistent", true, message), E_INTERNAL_ERROR);
+}
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "judge/verdict_cache.hpp"
+#include <sys/stat.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace judge;
+
+static const filesystem::path TEST_DIR = filesystem::temp_directory_path() / "verdict_cache_test";
+
+static void write_file(const filesystem::path &file, const string &content) {
+    filesystem::create_directories(file.parent_path());
+    ofstream(file, ios::binary) << content;
+}
+
+static string read_file(const filesystem::path &file) {
+    ifstream fin(file, ios::binary);
+    stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+TEST(VerdictCacheTest, OutputDigestTest) {
+    filesystem::remove_all(TEST_DIR);
+    write_file(TEST_DIR / "a" / "testdata.out", "1 2 3\n");
+    write_file(TEST_DIR / "b" / "testdata.out", "1 2 3\n");
+    write_file(TEST_DIR / "c" / "testdata.out", "1 2 4\n");
+
+    string digest = output_digest(TEST_DIR / "a");
+    EXPECT_EQ(digest.size(), 40u);
+    EXPECT_EQ(digest, output_digest(TEST_DIR / "b"));
+    EXPECT_NE(digest, output_digest(TEST_DIR / "c"));
+
+    // 文件名和其他文件也是比较程序可以读取的内容
+    write_file(TEST_DIR / "d" / "testdata.ans", "1 2 3\n");
+    EXPECT_NE(digest, output_digest(TEST_DIR / "d"));
+    write_file(TEST_DIR / "b" / "sub" / "report.xml", "");
+    EXPECT_NE(digest, output_digest(TEST_DIR / "b"));
+
+    // 无法确定内容的文件不使用缓存
+    ASSERT_EQ(mkfifo((TEST_DIR / "a" / ".stdout").c_str(), 0666), 0);
+    EXPECT_EQ(output_digest(TEST_DIR / "a"), "");
+    EXPECT_EQ(output_digest(TEST_DIR / "nonexistent"), "");
+    filesystem::remove_all(TEST_DIR);
+}
+
+TEST(VerdictCacheTest, StoreAndLoadTest) {
+    filesystem::remove_all(TEST_DIR);
+    filesystem::path entry = TEST_DIR / "cache" / "0123";
+    EXPECT_FALSE(load_verdict(entry, TEST_DIR / "run1"));
+
+    write_file(TEST_DIR / "run1" / "feedback" / "score.txt", "1 2\n");
+    write_file(TEST_DIR / "run1" / "compare.err", "wrong answer on line 3\n");
+    store_verdict(entry, 54, TEST_DIR / "run1");
+
+    // 已经存在的缓存项不会被覆盖
+    write_file(TEST_DIR / "run2" / "feedback" / "report.txt", "");
+    store_verdict(entry, 42, TEST_DIR / "run2");
+
+    filesystem::create_directories(TEST_DIR / "run3" / "feedback");
+    auto exitcode = load_verdict(entry, TEST_DIR / "run3");
+    ASSERT_TRUE(exitcode);
+    EXPECT_EQ(*exitcode, 54);
+    EXPECT_EQ(read_file(TEST_DIR / "run3" / "feedback" / "score.txt"), "1 2\n");
+    EXPECT_EQ(read_file(TEST_DIR / "run3" / "compare.err"), "wrong answer on line 3\n");
+    EXPECT_FALSE(filesystem::exists(TEST_DIR / "run3" / "feedback" / "report.txt"));
+    EXPECT_FALSE(filesystem::exists(TEST_DIR / "run3" / "compare.out"));
+
+    // 没有留下临时文件夹
+    int entries = 0;
+    for (auto &p : filesystem::directory_iterator(TEST_DIR / "cache")) ++entries, (void)p;
+    EXPECT_EQ(entries, 1);
+    filesystem::remove_all(TEST_DIR);
+}